@@ -0,0 +1,108 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __BLOOMFILTER_H__
+#define __BLOOMFILTER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Blocked Bloom filter over Zobrist keys.
+ * Each key maps to a single 64 bytes block (one cache line), in which its k
+ * bits are set. Adding and testing are lock-free : bits are only ever set,
+ * so a key added before being inserted in a table is never rejected.
+ *
+ * Once "capacity" keys are added, new keys go to a chained filter twice as
+ * large, at half the false positive rate : the rate of the whole chain stays
+ * under twice the target, however many keys are added.
+ *
+ * A filter can be saved next to the table it covers, and mapped back
+ * instead of being rebuilt from the table's keys. The saved file records
+ * the size and modification time of the table, a filter saved for another
+ * version of the table is never mapped.
+ */
+class BloomFilter {
+public:
+    /*Size the filter for "capacity" keys at "falsePositive" rate*/
+    BloomFilter(size_t capacity, double falsePositive);
+    /*Also drops the chained filters*/
+    ~BloomFilter();
+    void add(uint64_t key);
+    /*False means "definitely not there"*/
+    bool mayContain(uint64_t key) const;
+
+    /*For the whole chain*/
+    size_t bytes() const;
+    unsigned int probes() const;
+    /*Number of filters in the chain*/
+    unsigned int stages() const;
+
+    /*
+     * Write the filter of "table" to "file", return false on failure.
+     * A filter which grew can't be saved.
+     */
+    bool save(const std::string &file, const std::string &table) const;
+    /*
+     * Map a filter saved for "table". Returns nullptr if there is none, or
+     * if the table changed since it was saved. Pages are copied on write :
+     * adding keys never modifies the file.
+     */
+    static BloomFilter *map(const std::string &file, const std::string &table);
+
+    /*Statistics, maintained by the owner of the filter*/
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> passed_;
+    std::atomic<uint64_t> falsePositives_;
+private:
+    BloomFilter();
+    BloomFilter(const BloomFilter &);
+    BloomFilter &operator=(const BloomFilter &);
+    size_t blockIndex(uint64_t key) const;
+    static uint64_t probeBits(uint64_t key);
+    void setBits(uint64_t key);
+    bool hasBits(uint64_t key) const;
+    /*Size of the blocks of this filter only*/
+    size_t blocksBytes() const;
+
+    static const unsigned int WORDS_PER_BLOCK = 8;
+    /*Each probe takes 9 bits (one of the 512 bits of a block)*/
+    static const unsigned int MAX_PROBES = 7;
+    /*The saved header takes one block, so that the blocks stay aligned*/
+    static const size_t HEADER_SIZE = 64;
+
+    std::atomic<uint64_t> *blocks_ = nullptr;
+    /*There are 2^blockBits_ blocks*/
+    unsigned int blockBits_ = 0;
+    unsigned int probes_ = 1;
+    size_t capacity_ = 0;
+    double falsePositive_ = 0;
+    /*Keys added to this filter rather than to the chained ones*/
+    std::atomic<uint64_t> added_;
+    std::atomic<BloomFilter *> next_;
+    /*Set when the blocks are in a mapped file rather than allocated*/
+    void *map_ = nullptr;
+    size_t mapSize_ = 0;
+};
+
+#endif
@@ -26,6 +26,8 @@
 #include <map>
 #include <mutex>
 
+#include "LockStats.h"
+
 /* Note : This naive lock implementation may be to restrictive and non scalable
  * Rewriting it may be on the todo list some day
  * Note on iterator : they are not threadsafe, despite the name of the class...
@@ -54,7 +56,8 @@ class ConcurrentMap : protected std::map<K, V> {
 template <typename K, typename V>
 const V &ConcurrentMap<K, V>::findVal(const K &key, const V &defVal, bool insertDef)
 {
-    std::unique_lock<std::mutex> lock(lock_);
+    std::unique_lock<std::mutex> lock = LockStats::acquire(lock_,
+                                                           LockStats::tables);
     auto found = this->find(key);
     if (found != this->end()) {
         return found->second;
@@ -72,6 +75,12 @@ const V &ConcurrentMap<K, V>::findOrInsert(const K &key, const V &value)
     return findVal(key, value, true);
 }
 
+template <typename K, typename V>
+bool ConcurrentMap<K, V>::modified()
+{
+    return modified_;
+}
+
 template <typename K, typename V>
 size_t ConcurrentMap<K, V>::size()
 {
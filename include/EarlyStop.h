@@ -0,0 +1,102 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __EARLYSTOP_H__
+#define __EARLYSTOP_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "InfoParser.h"
+
+namespace Comm {
+
+    /**
+     * Early stop policy of a search (see early_stop).
+     * It follows the best line while the engine searches, and tells when
+     * its verdict is known : a mate, an eval beyond cutoff_threshold or a
+     * draw (0.00), unchanged for early_stop_iterations depths, and reached
+     * at early_stop_depth (mates excepted).
+     * The search is only stopped once the other lines have reached the
+     * depth of this verdict too, as the oracle classifies all of them.
+     * In MIXED mode (see search_mode), the best line is checked from
+     * mixed_start_depth every mixed_depth_step depths instead, and the
+     * search stopped as soon as it is no longer contested.
+     * The stops of all the engines are counted, to tune these options.
+     */
+    class EarlyStop {
+        public:
+            enum Verdict {
+                NONE,
+                MATE,
+                THRESHOLD,
+                DRAW
+            };
+            enum Mode {
+                /*Stop on a known verdict, if early_stop is set*/
+                OPTIONS,
+                MIXED
+            };
+            /*Follow a new search, with the current options*/
+            void reset(Mode mode = OPTIONS);
+            bool enabled() const;
+            /*
+             * Called each time the (1 based) slot of info is updated.
+             * Return true (only once per search) when stop should be sent.
+             */
+            bool update(unsigned int slot, InfoParser &info);
+            /*Whether the current search was stopped by the policy*/
+            bool stopped() const;
+            static Verdict verdict(const PVInfo &best);
+            /*
+             * Whether a deeper search could change the verdict on best : its
+             * eval is close to the cutoff, or it moved since previous.
+             */
+            static bool contested(const PVInfo &best, const PVInfo &previous);
+            static std::string to_string();
+        private:
+            /*Follow the verdict of the best line, set stopDepth_*/
+            void follow(const PVInfo &best);
+            void followMixed(const PVInfo &best);
+
+            Mode mode_ = OPTIONS;
+            bool enabled_ = false;
+            bool stopped_ = false;
+            Verdict verdict_ = NONE;
+            /*Depth at which the current verdict was first seen*/
+            int since_ = 0;
+            /*Depth at which the verdict is known, 0 until then*/
+            int stopDepth_ = 0;
+            /*Mixed mode : next depth checked, and the best line there*/
+            int checkpoint_ = 0;
+            PVInfo previous_;
+            std::chrono::steady_clock::time_point start_;
+
+            static std::atomic<uint64_t> stops_[DRAW + 1];
+            /*Sums of the depths and times (ms) at which searches stopped*/
+            static std::atomic<uint64_t> depths_;
+            static std::atomic<uint64_t> times_;
+    };
+
+}
+#endif
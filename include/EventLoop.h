@@ -0,0 +1,95 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __EVENTLOOP_H__
+#define __EVENTLOOP_H__
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Stream.h"
+#include "StringView.h"
+
+namespace Comm {
+
+    /**
+     * One thread reading the output of all the engines.
+     * Sources are file descriptors (made non blocking), their complete lines
+     * are given to the source's handler, from the loop thread. It uses epoll
+     * on Linux, and poll elsewhere.
+     */
+    class EventLoop {
+        public:
+            /*Return non zero to stop reading from the source*/
+            typedef std::function<int(const StringView &line)> LineHandler;
+
+            EventLoop();
+            ~EventLoop();
+            /*
+             * Start reading fd, which stays owned by the caller, and return
+             * the id of the source. The thread is started on first call.
+             * The source is removed on end of file.
+             */
+            uint64_t add(int fd, const LineHandler &handler);
+            /*
+             * Once it returns, the handler is not running (unless remove is
+             * called from it) and will not be called again. The fd may then
+             * be closed.
+             */
+            void remove(uint64_t id);
+            size_t sources();
+
+            /*Lines given to a handler in a row, before looking at others*/
+            static const unsigned int MAX_LINES_PER_WAKEUP = 256;
+        private:
+            struct Source {
+                Source(int fd, const LineHandler &handler);
+                int fd;
+                LineReader reader;
+                LineHandler handler;
+                bool removed = false;
+            };
+            void run();
+            /*Return true if lines may be left in the source's buffer*/
+            bool dispatch(uint64_t id);
+            void unregister(Source *source);
+            void wakeup();
+            EventLoop(const EventLoop &);
+            EventLoop &operator=(const EventLoop &);
+
+            /*Recursive : handlers may end up calling remove*/
+            std::recursive_mutex lock_;
+            std::map<uint64_t, Source *> sources_;
+            Source *dispatching_ = nullptr;
+            uint64_t nextId_ = 1;
+            /*Id 0 is the wakeup pipe*/
+            int wakeFds_[2] = {-1, -1};
+            int pollFd_ = -1;
+            bool stop_ = false;
+            std::thread thread_;
+    };
+
+}
+#endif
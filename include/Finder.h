@@ -22,6 +22,8 @@
 #ifndef __FINDER_H__
 #define __FINDER_H__
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <vector>
 #include "Line.h"
@@ -39,15 +41,35 @@ public:
     int runFinder();
 
 protected:
+    /*
+     * State of the finder on one position. Positions may be run
+     * concurrently, each session then has its own engine.
+     */
+    struct Session {
+        int commId;
+        /*Where the output goes, standard output if null*/
+        std::string *output;
+        Board::Color playFor;
+        /*Number of moves "played" by the finder*/
+        int addedMoves;
+        /*Short result, for the summary once all positions are done*/
+        std::string summary;
+    };
     virtual int runFinderOnPosition(const Board::Position &pos,
-                                    const std::list<std::string> &moves) = 0;
+                                    const std::list<std::string> &moves,
+                                    Session &session) = 0;
+    /*How many positions may run at once, one by default*/
+    virtual unsigned int maxSessions() const;
     /*Thread *startReceiver();*/
     static void sendPositionToEngine(Board::Position &pos, int commId);
-
-    static Board::Color playFor_;
-
-    /*Number of moves "played" by the finder*/
-    int addedMoves_ = 0;
+    static void output(Session &session, const std::string &msg,
+                       int level = 0);
+    /*
+     * Engines not used by a session may be borrowed to help the sessions.
+     * Return -1 if they are all busy.
+     */
+    static int borrowEngine();
+    static void returnEngine(int commId);
 
     /*Id of our communicators*/
     static std::vector<int> commIds_;
@@ -57,6 +79,19 @@ protected:
     /*Options instance*/
     static Options &opt_;
 
+private:
+    /*
+     * Run the positions from next, until there is none left.
+     * If keepApart, the output of each position is printed once it's done.
+     */
+    void runSessions(int commId, std::atomic<size_t> &next,
+                     std::vector<std::string> &summaries, bool keepApart);
+    std::vector<std::pair<std::string, std::list<std::string>>> positions_;
+    /*Whole outputs of the positions are printed at once*/
+    std::mutex outputLock_;
+    static std::vector<int> spareIds_;
+    static std::mutex spareLock_;
+
 };
 
 #endif
@@ -22,22 +22,43 @@
 #ifndef __HASHTABLE_H__
 #define __HASHTABLE_H__
 
+#include <atomic>
 #include <cstdint>
 #include <map>
 #include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "BloomFilter.h"
 #include "ConcurrentMap.h"
 #include "SimpleChessboard.h"
+#include "TableIO.h"
 
 #define U64(u) (u##ULL)
 
 
 class Node;
+class NodeArena;
 
-/*FIXME : is registering the next Node really necessary ?!*/
-typedef std::pair<std::string, Node *> MoveNode;
-typedef std::vector<MoveNode> LegalNodes;
+/*
+ * Append-only lists hanging from a Node.
+ * Cells are pushed at the head with a CAS and are never removed, they are
+ * allocated in the arena of the worker adding them.
+ * Links only hold keys and moves, never pointers to other nodes : the
+ * nodes of a table shard may be dropped while others still refer to them.
+ */
+struct ParentLink {
+    uint64_t parent;
+    const ParentLink *next;
+};
+
+struct MoveLink {
+    /*Polyglot encoded move*/
+    uint16_t move;
+    const MoveLink *next;
+};
 
 class Node {
 public:
@@ -52,42 +73,109 @@ public:
         DRAW = 1 << 7,
         SIGNATURE_TABLE = 1 << 8
     };
-    Node(const Node *prev);
-    Node(const Node *prev, std::string pos, StatusFlag st);
-    ~Node();
-    void safeAddParent(const Node *parent);
-    void safeAddMove(MoveNode mv);
+    /*Nodes are built by NodeArena::create, which gives itself as first arg*/
+    Node(NodeArena *arena, uint64_t key);
+    Node(NodeArena *arena, uint64_t key, const std::string &pos,
+         StatusFlag st);
+    void safeAddParent(uint64_t parent, NodeArena *arena);
+    void safeAddMove(const std::string &mv, NodeArena *arena);
+    void safeAddMove(uint16_t mv, NodeArena *arena);
+    /*Unconditional store, for nodes not yet shared with other workers*/
     void updateStatus(StatusFlag st);
-    const std::vector<const Node *> &getParents() const;
-    const LegalNodes &getMoves() const;
-    const std::string &getPos() const;
+    /*
+     * Atomically move from status "from" to status "to".
+     * Return false if the node was not in the "from" status anymore.
+     */
+    bool transition(StatusFlag from, StatusFlag to);
+    uint64_t getKey() const;
+    /*Return false if the node has no parent*/
+    bool getLastParent(uint64_t &parent) const;
+    const ParentLink *getParents() const;
+    const MoveLink *getMoves() const;
+    unsigned int parentCount() const;
+    unsigned int moveCount() const;
+    std::string getPos() const;
     StatusFlag getStatus() const;
     std::string to_string() const;
     static std::string to_string(StatusFlag s);
     /*"Light" copy : copy only basic informations such as status and moves,
      * as it's the only things needed for exporting table*/
-    Node *lightCopy();
+    Node *lightCopy(NodeArena *arena) const;
 private:
+    const uint64_t key_;
     /*Fen string without clock informations*/
-    /*Actually its the full fen*/
-    std::string pos_;
-    /*
-     * FIXME: only store the move !
-     * And sort according to the natural ordering
-     */
-    //vector<UCIMove> legal_moves;
-    LegalNodes legal_moves_;
+    /*Actually its the full fen, stored in the arena (null if unknown)*/
+    const char *pos_ = nullptr;
     //Polyglot "learn" field, uint32_t
-    StatusFlag st_ = PENDING;
-    std::vector<const Node *> prev_;
-    std::mutex lockP_;
-    std::mutex lockM_;
-    /*
-     *bool lockP_ = false;
-     *bool lockM_ = false;
-     */
+    std::atomic<uint32_t> st_;
+    std::atomic<const ParentLink *> prev_;
+    std::atomic<const MoveLink *> moves_;
+};
+
+/*
+ * Chunked bump allocator for nodes, their fen and their links.
+ * An arena belongs to one worker thread : allocating is just a pointer bump,
+ * without any lock. Nothing is ever freed one by one and nothing allocated
+ * here has a destructor, so the whole arena is released at once when the
+ * owning HashTable is destroyed.
+ */
+class NodeArena {
+public:
+    NodeArena(size_t maxChunkSize = MAX_CHUNK_SIZE);
+    ~NodeArena();
+    template<class... Args>
+    Node *create(Args&&... args);
+    template<class T>
+    T *createPod(const T &value);
+    const char *copyString(const std::string &str);
+    void release();
+    /*Not synchronized with allocations : call once workers are done*/
+    size_t bytesUsed() const;
+    /*May be called while the owner allocates*/
+    size_t bytesReserved() const;
+    /*Global counters, across all the arenas of the process*/
+    static size_t totalReserved();
+    static size_t peakReserved();
+    static size_t totalChunks();
+
+    /*Chunks start small and double up to this size, in bytes*/
+    static const size_t MIN_CHUNK_SIZE = 8 << 10;
+    static const size_t MAX_CHUNK_SIZE = 4 << 20;
+private:
+    void *allocate(size_t size, size_t align);
+    void newChunk(size_t minSize);
+    NodeArena(const NodeArena &);
+    NodeArena &operator=(const NodeArena &);
+
+    const size_t maxChunkSize_;
+    /*Chunks and their size, in bytes*/
+    std::vector<std::pair<char *, size_t>> chunks_;
+    /*Bytes used in the last chunk*/
+    size_t curOffset_ = 0;
+    std::atomic<size_t> reserved_;
+
+    static std::atomic<size_t> totalReserved_;
+    static std::atomic<size_t> peakReserved_;
+    static std::atomic<size_t> totalChunks_;
 };
 
+template<class... Args>
+Node *NodeArena::create(Args&&... args)
+{
+    static_assert(std::is_trivially_destructible<Node>::value,
+                  "Nodes are released with their arena, without destructor");
+    return new (allocate(sizeof(Node), alignof(Node)))
+        Node(this, std::forward<Args>(args)...);
+}
+
+template<class T>
+T *NodeArena::createPod(const T &value)
+{
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Arena objects are released without destructor");
+    return new (allocate(sizeof(T), alignof(T))) T(value);
+}
+
 //map is internally ordered by key, ascending
 class HashTable : public ConcurrentMap<uint64_t, Node *>
 {
@@ -99,14 +187,70 @@ public:
     ~HashTable();
     std::string to_string();
     std::string show_pending();
+    /*
+     * Create an arena for the calling worker, owned by this table.
+     * Nodes inserted in this table should be allocated from one of its arenas.
+     */
+    NodeArena *newArena();
+    size_t arenaBytesUsed();
+    size_t arenaBytesReserved();
+    /*Estimated memory used by the table : arenas, map and filter*/
+    size_t memoryFootprint();
+
+    /*
+     * Put a bloom filter in front of the lookups, sized according to the
+     * current content and to the options. Must be called before the table
+     * is shared with other workers. The filter saved with a block table is
+     * mapped when it's still valid, otherwise it's rebuilt and saved.
+     */
+    void enableBloom();
+    const BloomFilter *bloom() const;
+    /*
+     * A filter for a table of "entries" positions, sized according to the
+     * options. Returns nullptr if the options disable the filters.
+     */
+    static BloomFilter *newBloom(size_t entries);
+    /*
+     * Like findVal, but most misses are rejected by the filter without lock.
+     * For tables backed by a block file, positions not yet in memory are
+     * looked up in the file.
+     */
+    Node *probe(uint64_t key);
+    /*Hides ConcurrentMap's one, to keep the filter and the file in sync*/
+    Node *findOrInsert(uint64_t key, Node *value);
 
     void autosave();
+    /*Save in the format matching the extension of file*/
+    void save(const std::string &file);
     void toPolyglot(const std::string &file);
+    void toBlockTable(const std::string &file);
+    /*
+     * Append all the positions to an open writer, for tables made of
+     * several HashTable. Not thread safe, call once workers are done.
+     */
+    void write(Table::Writer &writer);
+    /*Load a table, whatever its format*/
+    static HashTable *load(const std::string &file);
     static HashTable *fromPolyglot(const std::string &file);
+    /*
+     * Only the block index is loaded, entries are brought in memory when
+     * looked up with probe or findOrInsert.
+     */
+    static HashTable *fromBlockTable(const std::string &file);
+    /*Number of positions in the backing block file (0 if none)*/
+    uint64_t storedEntries() const;
+    uint64_t blockDecodes() const;
 private:
+    /*Bring the entry for key from the backing file in the map*/
+    Node *materialize(uint64_t key);
+    /*
+     * Bring all the backing file in the map and close it.
+     * Not thread safe, call once workers are done.
+     */
+    void materializeAll();
+    void write(const std::string &file, Table::Format format);
+    static Node *nodeFromEntry(const Table::Entry &e, NodeArena *arena);
     Node *unsafeFindPos(uint64_t hash);
-    void outputHeader(std::ostream &os);
-    void readHeader(std::istream &is);
     static int pieceOffset(int kind, Board::Rank r, Board::File f);
     static uint64_t piecesFromFEN(std::string pos);
     static uint64_t enpassantFromFEN(std::string enpassant);
@@ -115,6 +259,12 @@ private:
     static const uint64_t Random64_[781];
     uint16_t cutoffValue_ = 0;
     const std::string file_;
+    std::vector<NodeArena *> arenas_;
+    BloomFilter *bloom_ = nullptr;
+    Table::BlockTable *store_ = nullptr;
+    /*Arena for the materialized entries, only used under the table lock*/
+    NodeArena *storeArena_ = nullptr;
+    uint64_t blockDecodes_ = 0;
 };
 
 #endif
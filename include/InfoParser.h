@@ -0,0 +1,91 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __INFOPARSER_H__
+#define __INFOPARSER_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Line.h"
+#include "StringView.h"
+
+namespace Comm {
+
+    /*Result of one multipv slot, from the last info line with a pv*/
+    struct PVInfo {
+        int depth = 0;
+        int eval = 0;
+        bool isMat = false;
+        /*Polyglot encoded moves*/
+        std::vector<uint16_t> pv;
+    };
+
+    /**
+     * Parser for the info lines of a search.
+     * Tokens are read in place and pvs go to per slot storage, which is
+     * kept from one search to the next : once the vectors have grown to the
+     * longest pv, parsing an info line does not allocate.
+     * In deferred mode, only the last line with a pv of each slot is kept
+     * (found by scanning the tokens up to "pv"), and parsed on flush.
+     */
+    class InfoParser {
+        public:
+            /*Forget the previous search, keeping the storage*/
+            void clear(size_t slots, bool deferred = false);
+            /*
+             * Parse or record (in deferred mode) an info line.
+             * Return the (1 based) multipv slot of the line, 0 if none.
+             */
+            unsigned int add(const StringView &msg, size_t pos = 0);
+            /*Parse the lines recorded since the last flush*/
+            void flush();
+            /*
+             * Parse the tokens of an info line, from pos (after "info").
+             * Return the (1 based) multipv slot updated, 0 if none was.
+             */
+            unsigned int parse(const StringView &msg, size_t pos = 0);
+            const std::vector<PVInfo> &slots() const;
+            /*The first slot, its recorded line is parsed in deferred mode*/
+            const PVInfo &best();
+            /*Depth of a slot (0 based), 0 if empty, without parsing it*/
+            int depth(size_t slot) const;
+            /*Copy the slots with a pv to lines, which must be as large*/
+            void toLines(std::vector<Line> &lines) const;
+
+            /*Like Board::uciToPolyglot, return false if mv is not a move*/
+            static bool parseMove(const StringView &mv, uint16_t &move);
+            static bool parseInt(const StringView &token, int &value);
+        private:
+            /*Slot of a line with a pv, 0 if no pv, -1 if invalid*/
+            static int lineSlot(const StringView &msg, size_t pos);
+
+            bool deferred_ = false;
+            std::vector<PVInfo> slots_;
+            /*Deferred mode : last line of each slot, empty once parsed*/
+            std::vector<std::string> raw_;
+            /*The pv being parsed, copied to its slot if valid*/
+            std::vector<uint16_t> scratch_;
+    };
+
+}
+#endif
@@ -37,6 +37,7 @@ public:
     void update(Line &line);
     bool isMat() const;
     float getEval() const;
+    int getDepth() const;
     bool empty() const;
     std::string firstMove() const;
     const std::list<std::string> &getMoves() const;
@@ -0,0 +1,68 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCKSTATS_H__
+#define __LOCKSTATS_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/*
+ * Contention counters of the locks shared by the workers.
+ * Only the slow path is counted (the lock is held by another thread), an
+ * uncontended acquisition costs the same as a plain lock.
+ */
+namespace LockStats {
+    struct Counter {
+        const char *name;
+        std::atomic<uint64_t> contended;
+        /*Time spent waiting for the lock, in microseconds*/
+        std::atomic<uint64_t> waited;
+    };
+
+    extern Counter tables;
+    extern Counter nodeStack;
+    extern Counter tableCache;
+    extern Counter evaluations;
+    extern Counter splits;
+
+    inline std::unique_lock<std::mutex> acquire(std::mutex &m, Counter &c)
+    {
+        std::unique_lock<std::mutex> lock(m, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            auto waited = std::chrono::steady_clock::now() - start;
+            c.contended.fetch_add(1, std::memory_order_relaxed);
+            c.waited.fetch_add(std::chrono::duration_cast<
+                               std::chrono::microseconds>(waited).count(),
+                               std::memory_order_relaxed);
+        }
+        return lock;
+    }
+
+    std::string to_string();
+}
+
+#endif
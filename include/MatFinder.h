@@ -22,7 +22,13 @@
 #ifndef __MATFINDER_H__
 #define __MATFINDER_H__
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include "Line.h"
 #include "SimpleChessboard.h"
@@ -36,12 +42,50 @@ public:
 
 private:
     int runFinderOnPosition(const Board::Position &pos,
-                            const std::list<std::string> &moves);
-    int computeMultiPV(const std::vector<Line> &lines);
+                            const std::list<std::string> &moves,
+                            Session &session);
+    unsigned int maxSessions() const;
+
+    /*
+     * Replies of the defender searched on other engines (see
+     * split_subtrees), shared by a session and all its sub-searches.
+     * Positions are identified by their hash.
+     */
+    struct Split {
+        std::mutex lock;
+        std::condition_variable cond;
+        /*Closed by a sub-search, or still searched by one*/
+        std::set<uint64_t> closed;
+        /*
+         * With the session which started the sub-search : it's the only one
+         * waiting for it, so that no wait can go round in circles.
+         */
+        std::map<uint64_t, const Session *> running;
+        std::vector<std::thread> threads;
+        std::atomic<bool> stop{false};
+    };
+    /*Follow the best lines from pos until they are all closed*/
+    void closeLines(Board::Position &pos, Session &session, Split &split);
+    /*Start a sub-search for the other replies, if an engine is spare*/
+    void splitReplies(Board::Position &pos, const std::vector<Line> &lines,
+                      int pv, Session &session, Split &split);
+    void searchSubtree(std::string fen, uint64_t key, Board::Color playFor,
+                       int commId, Split &split);
+    /*
+     * Leave the replies closed by sub-searches, or searched by the ones of
+     * session, out of go. The keys of the ones still searched are added to
+     * pending. Return false if no reply is left.
+     */
+    bool restrictReplies(Board::Position &pos, const Session &session,
+                         Split &split, std::string &go,
+                         std::vector<uint64_t> &pending);
+    /*Wait until the sub-searches of pending are done*/
+    void waitReplies(Split &split, const std::vector<uint64_t> &pending);
+    int computeMultiPV(const std::vector<Line> &lines, Session &session);
     const Line &getBestLine(const Board::Position &pos,
-                            const std::vector<Line> &lines);
+                            const std::vector<Line> &lines,
+                            const Session &session);
     Line emptyLine_;
-    int commId_;
 
 };
 
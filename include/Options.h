@@ -25,6 +25,7 @@
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 
 class MoveComparator;
 class Config;
@@ -56,6 +57,9 @@ class Options {
         void setSearchMode(std::string sm);
 
         int getSearchDepth() const;
+        int getMixedStartDepth() const;
+        int getMixedDepthStep() const;
+        int getMixedMargin() const;
 
         bool buildOracleForWhite() const;
         void setOracleSide(std::string side);
@@ -73,8 +77,15 @@ class Options {
         const std::string &getEngineFullpath() const;
         int getEngineHashmapSize() const;
         int getEngineThreads() const;
+        bool getDeferredInfoParsing() const;
+        int getSearchTimeout() const;
+        const std::string &getResultCache() const;
+        const std::vector<std::string> &getRemoteEngines() const;
 
         int getCutoffThreshold() const;
+        bool earlyStop() const;
+        int getEarlyStopDepth() const;
+        int getEarlyStopIterations() const;
         int getEngineNumber() const;
         int getPlayforMovetime() const;
         int getPlayagainstMovetime() const;
@@ -86,12 +97,21 @@ class Options {
 
         int getMateThreshold() const;
         int getMaxLines() const;
+        bool splitSubtrees() const;
 
         int getBestmoveDeviation() const;
 
         unsigned int getMaxPiecesEnding() const;
         bool fullBuild() const;
 
+        int getBloomCapacity() const;
+        double getBloomFalsePositive() const;
+        bool compressedTables() const;
+        int getTableMemoryBudget() const;
+        unsigned int getMainTableShardBits() const;
+        int getMainTableMemoryBudget() const;
+        const std::string &getSpillFolder() const;
+
         MoveComparator *getMoveComparator() const;
         void setMoveComparator(MoveComparator *mc);
         void setMoveComparator(std::string smc);
@@ -111,6 +131,10 @@ class Options {
 
         SearchMode mode_ = TIME;
         int searchDepth_ = 10;
+        /*Mixed mode : first depth, its increment and the contested margin*/
+        int mixedStartDepth_ = 8;
+        int mixedDepthStep_ = 4;
+        int mixedMargin_ = 50;
 
         bool buildOracleForWhite_ = true;
 
@@ -120,8 +144,20 @@ class Options {
         std::string engineFullpath_ = "/usr/bin/stockfish";
         int engineHashmapSize_ = 1024;
         int engineThreads_ = 2;
+        /*Only parse the last info line of each pv, when bestmove arrives*/
+        bool deferredInfoParsing_ = false;
+        /*Seconds before a search is considered hung (0 for no limit)*/
+        int searchTimeout_ = 0;
+        /*File caching the engine results across runs (none if empty)*/
+        std::string resultCache_ = "";
+        /*engined addresses (host:port) to run the engines on, if any*/
+        std::vector<std::string> remoteEngines_;
 
         int finderCutoffThreshold_ = 100;
+        /*Send stop once the verdict of a search is known, see EarlyStop*/
+        bool earlyStop_ = false;
+        int earlyStopDepth_ = 10;
+        int earlyStopIterations_ = 3;
         int finderEngineNumber = 1;
         int playforMovetime_ = 1500;
         int playagainstMovetime_ = 1000;
@@ -130,6 +166,7 @@ class Options {
 
         int mateThreshold_ = 10000;
         int maxLines_ = 8;
+        bool splitSubtrees_ = false;
 
         int bestmoveDeviation_ = 19;
 
@@ -137,6 +174,20 @@ class Options {
         /*Build full oracle, or just until we reach an 6 piece ending*/
         bool fullBuild_ = false;
 
+        /*Bloom filters in front of signature tables, disabled if rate is 0*/
+        int bloomCapacity_ = 65536;
+        double bloomFalsePositive_ = 0.01;
+        /*Save new signature tables in the compressed block format*/
+        bool compressedTables_ = false;
+        /*Memory for the signature tables, in MB (0 for no limit)*/
+        int tableMemoryBudget_ = 0;
+        /*The main table is split in 2^bits shards, by key prefix*/
+        unsigned int mainTableShardBits_ = 0;
+        /*Memory for the main table shards, in MB (0 for no limit)*/
+        int mainTableMemoryBudget_ = 0;
+        /*Where the shards above the budget are written*/
+        std::string spillFolder_ = "spill";
+
         PositionList positions_;
 
         MoveComparator *comp_ = nullptr;
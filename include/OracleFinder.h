@@ -30,13 +30,29 @@
 #include "Line.h"
 #include "Finder.h"
 #include "Hashing.h"
+#include "ShardedTable.h"
+#include "TableCache.h"
 
-class NodeStack : private std::stack<Node *> {
+/*
+ * A position waiting to be explored. Its node is only created in the main
+ * table when a worker pops it, so that pending work does not keep any shard
+ * in memory.
+ */
+struct PendingNode {
+    uint64_t key;
+    std::string pos;
+    /*Key of the node which pushed this one, if any*/
+    bool hasParent;
+    uint64_t parent;
+};
+
+class NodeStack : private std::stack<PendingNode> {
     public:
         NodeStack(unsigned long workers);
-        void push(Node *n);
-        void push(std::vector<Node *> &nodes);
-        Node *poptop();
+        void push(const PendingNode &n);
+        void push(std::vector<PendingNode> &nodes);
+        /*Return false once all the workers are waiting for work*/
+        bool poptop(PendingNode &n);
         unsigned int size();
     private:
         std::mutex lock_;
@@ -46,14 +62,21 @@ class NodeStack : private std::stack<Node *> {
 };
 
 namespace OracleBuilder {
-    int buildOracle(Board::Color playFor,
-                    ConcurrentMap<std::string, HashTable *> &oracle,
+    int buildOracle(Board::Color playFor, ShardedTable &oracle,
+                    TableCache &signTables,
                     const std::vector<int> &communicators,
                     const Board::Position &pos,
                     const std::list<std::string> &moves);
-    void exploreNode(ConcurrentMap<std::string, HashTable *> &tables,
-                      NodeStack &nodes, Board::Color playFor, int commId);
-    void displayNodeHistory(const Node *start);
+    void exploreNode(ShardedTable &oracle, TableCache &signTables,
+                     NodeStack &nodes, Board::Color playFor);
+    /*
+     * Search fen in mixed mode : a single search, up to search_depth and
+     * playfor_movetime, stopped once the best line is no longer contested
+     * (see EarlyStop). The depth reached is reported in output.
+     */
+    std::vector<Line> mixedSearch(const std::string &fen, std::string &output);
+    /*Follow the parents through the table, the nodes may be in any shard*/
+    void displayNodeHistory(ShardedTable &oracle, const Node *start);
     bool cutNode(const Board::Position &pos, const Node *currentNode);
 }
 
@@ -65,10 +88,15 @@ public:
     static std::map<std::string, int> signStat_;
 
 private:
+    /*The signature tables of the running finder, for dumpStat*/
+    static TableCache *signTables_;
+    static ShardedTable *mainTable_;
     /*This should now create workers and handle termination*/
     int runFinderOnPosition(const Board::Position &pos,
-                            const std::list<std::string> &moves);
-    ConcurrentMap<std::string, HashTable *> oracleTables_;
+                            const std::list<std::string> &moves,
+                            Session &session);
+    ShardedTable oracle_;
+    TableCache tables_;
 };
 
 #endif
@@ -0,0 +1,89 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __RESULTCACHE_H__
+#define __RESULTCACHE_H__
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Line.h"
+
+namespace Comm {
+
+    /*
+     * On disk cache of the engine results, keyed by the position (its
+     * polyglot key) and by the search settings : engine name, go limits
+     * and MultiPV.
+     * The file is a header followed by one record per search, appended as
+     * soon as the search is over : an interrupted run loses at most the
+     * record being written, which is dropped at the next opening.
+     * Records are written in native endianness, like the table files.
+     * Thread safe.
+     */
+    class ResultCache {
+        public:
+            /*Load the cache, the file is created if it does not exist*/
+            ResultCache(const std::string &file);
+            static uint64_t settingsKey(const std::string &engine,
+                                        const std::string &limits,
+                                        const std::string &multiPV);
+            /*
+             * Fill lines with the cached result, the other lines are
+             * emptied. Return false if the search is not in the cache.
+             */
+            bool find(uint64_t position, uint64_t settings,
+                      std::vector<Line> &lines);
+            /*Lines with more than 255 moves are not cached*/
+            void add(uint64_t position, uint64_t settings,
+                     const std::vector<Line> &lines);
+            size_t size();
+            uint64_t hits();
+            uint64_t misses();
+
+            /*"CFRCACH1"*/
+            static const uint64_t MAGIC = 0x3148434143524643ULL;
+        private:
+            /*
+             * Encoded lines, as stored in the file.
+             * Return false if a line is too long to be stored whole.
+             */
+            static bool encode(const std::vector<Line> &lines,
+                               std::string &out);
+            static bool decode(const std::string &in,
+                               std::vector<Line> &lines);
+
+            const std::string file_;
+            std::mutex lock_;
+            std::map<std::pair<uint64_t, uint64_t>, std::string> results_;
+            std::ofstream out_;
+            uint64_t hits_ = 0;
+            uint64_t misses_ = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SHARDEDTABLE_H__
+#define __SHARDEDTABLE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TableCache.h"
+
+/*
+ * The main table of a build, split in 2^shardBits HashTable according to
+ * the high bits of the keys.
+ * Shards go through a TableCache : above the budget, the least recently
+ * used ones are written to the spill folder as block tables, and looked up
+ * from there through their index when needed again. Spill files are
+ * private to the process and removed on destruction.
+ * Nodes live in the arena of their shard, so a Node pointer is only valid
+ * while its shard is pinned.
+ * A sharded table is saved as one file per shard (see savedFile), which
+ * tablemerge can gather in a single table.
+ */
+class ShardedTable {
+public:
+    /*Budget in bytes, 0 means no limit*/
+    ShardedTable(unsigned int shardBits, size_t budget,
+                 const std::string &spillFolder);
+    ~ShardedTable();
+    /*
+     * Fill the shards from a table file, or from the shard files of a
+     * previous save to file, before any acquire
+     */
+    void load(const std::string &file);
+    /*
+     * Write each shard to its own file, skipping the shards not acquired
+     * since the last save to the same file.
+     * Without shards, file is a single table.
+     */
+    void save(const std::string &file);
+    /*File holding a shard of a table saved to file*/
+    std::string savedFile(const std::string &file, unsigned int shard) const;
+    unsigned int shardOf(uint64_t key) const;
+    unsigned int shardCount() const;
+    /*Pin the shard holding key, loading or creating it if needed*/
+    TableCache::Pin acquire(uint64_t key);
+    std::string to_string();
+
+private:
+    TableCache::Pin acquireShard(unsigned int shard);
+    void split(const std::vector<std::string> &files);
+    std::string shardSign(unsigned int shard) const;
+    std::string shardFile(unsigned int shard) const;
+    ShardedTable(const ShardedTable &);
+    ShardedTable &operator=(const ShardedTable &);
+
+    const unsigned int shardBits_;
+    const std::string spillFolder_;
+    /*Whether shards may be written to the spill folder*/
+    const bool spill_;
+    TableCache shards_;
+    /*Shards acquired since the last save, and the file it went to*/
+    std::unique_ptr<std::atomic<bool>[]> dirty_;
+    std::string savedTo_;
+};
+
+#endif
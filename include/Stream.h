@@ -23,11 +23,11 @@
 #define __STREAM_H__
 
 #include <iostream>
+#include <vector>
 #include <unistd.h>
 #include <ext/stdio_filebuf.h>
 
-#define BUFFER_SIZE (2048)
-
+#include "StringView.h"
 
 
 class Stream {
@@ -43,18 +43,41 @@ protected:
     std::ios_base::openmode openmode_;
 };
 
-class InputStream : public Stream {
+/*
+ * Line oriented reader on a file descriptor (which it does not own).
+ * Data comes in with large read(2) calls, and lines are handed out as views
+ * in the buffer, without copy. The buffer grows to hold the longest line,
+ * so lines are never truncated.
+ * On a non blocking descriptor, getline returns false when no complete line
+ * is available yet : use eof() to tell the end of the input.
+ */
+class LineReader {
 public:
-    //InputStream();
-    InputStream(int file_descriptor);
-    ~InputStream();
-    void open(int file_descriptor);
-    InputStream& operator>> (std::string& str);
-    size_t getline (char* s, std::streamsize n);
-    size_t getline (char* s, std::streamsize n, char delim);
+    LineReader(int file_descriptor, size_t readSize = READ_SIZE);
+    /*
+     * Get the next line, without its end of line. The view is valid until
+     * the next call. Return false on end of file or error, once the last
+     * (possibly unterminated) line has been returned.
+     */
+    bool getline(StringView &line);
+    /*Bytes currently buffered, including the returned line*/
+    size_t buffered() const;
+    /*End of file reached, and all the lines returned*/
+    bool eof() const;
 
+    static const size_t READ_SIZE = 64 << 10;
 private:
-    std::istream* stdistream_;
+    /*Make room for at least readSize_ bytes after end_*/
+    void reserve();
+
+    const int file_descriptor_;
+    const size_t readSize_;
+    std::vector<char> buffer_;
+    /*Unconsumed data is [begin_, end_), with no end of line before scan_*/
+    size_t begin_ = 0;
+    size_t scan_ = 0;
+    size_t end_ = 0;
+    bool eof_ = false;
 };
 
 class OutputStream : public Stream {
@@ -69,6 +92,4 @@ private:
     std::ostream* stdostream_;
 };
 
-size_t getline(InputStream &is, std::string &str);
-
 #endif
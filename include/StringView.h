@@ -0,0 +1,144 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __STRINGVIEW_H__
+#define __STRINGVIEW_H__
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+/*
+ * A non owning view on a range of characters, like C++17's string_view.
+ * The viewed characters must outlive the view.
+ */
+class StringView {
+public:
+    StringView();
+    StringView(const char *data, size_t size);
+    StringView(const char *str);
+    StringView(const std::string &str);
+    const char *data() const;
+    size_t size() const;
+    bool empty() const;
+    char operator[](size_t i) const;
+    const char *begin() const;
+    const char *end() const;
+    std::string str() const;
+    StringView substr(size_t pos, size_t count = npos) const;
+    /*
+     * The space separated token starting at or after pos, pos is moved past
+     * it. Empty once the view is exhausted.
+     */
+    StringView token(size_t &pos) const;
+    bool operator==(const StringView &other) const;
+    bool operator!=(const StringView &other) const;
+
+    static const size_t npos = (size_t)-1;
+private:
+    const char *data_ = "";
+    size_t size_ = 0;
+};
+
+inline StringView::StringView()
+{
+}
+
+inline StringView::StringView(const char *data, size_t size) : data_(data),
+    size_(size)
+{
+}
+
+inline StringView::StringView(const char *str) : data_(str),
+    size_(strlen(str))
+{
+}
+
+inline StringView::StringView(const std::string &str) : data_(str.data()),
+    size_(str.size())
+{
+}
+
+inline const char *StringView::data() const
+{
+    return data_;
+}
+
+inline size_t StringView::size() const
+{
+    return size_;
+}
+
+inline bool StringView::empty() const
+{
+    return size_ == 0;
+}
+
+inline char StringView::operator[](size_t i) const
+{
+    return data_[i];
+}
+
+inline const char *StringView::begin() const
+{
+    return data_;
+}
+
+inline const char *StringView::end() const
+{
+    return data_ + size_;
+}
+
+inline std::string StringView::str() const
+{
+    return std::string(data_, size_);
+}
+
+inline StringView StringView::substr(size_t pos, size_t count) const
+{
+    if (pos > size_)
+        pos = size_;
+    if (count > size_ - pos)
+        count = size_ - pos;
+    return StringView(data_ + pos, count);
+}
+
+inline StringView StringView::token(size_t &pos) const
+{
+    while (pos < size_ && (data_[pos] == ' ' || data_[pos] == '\t'))
+        pos++;
+    size_t start = pos;
+    while (pos < size_ && data_[pos] != ' ' && data_[pos] != '\t')
+        pos++;
+    return StringView(data_ + start, pos - start);
+}
+
+inline bool StringView::operator==(const StringView &other) const
+{
+    return size_ == other.size_ && !memcmp(data_, other.data_, size_);
+}
+
+inline bool StringView::operator!=(const StringView &other) const
+{
+    return !(*this == other);
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __TABLECACHE_H__
+#define __TABLECACHE_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "Hashing.h"
+
+/*
+ * The signature tables of a build, opened on first access.
+ * Tables are pinned while a worker uses them. When the estimated memory of
+ * the loaded tables goes over the budget, the least recently used unpinned
+ * tables are autosaved (if modified) and dropped, to be loaded again from
+ * their file on next access. Pinned tables are never dropped, so the budget
+ * may be exceeded while they are in use.
+ */
+class TableCache {
+    struct Slot;
+public:
+    /*Keeps a table in memory as long as it lives*/
+    class Pin {
+        public:
+            Pin();
+            Pin(Pin &&other);
+            Pin &operator=(Pin &&other);
+            ~Pin();
+            HashTable *get() const;
+            HashTable *operator->() const;
+            /*Unique across loads, unlike the table address*/
+            uint64_t serial() const;
+            void release();
+        private:
+            friend class TableCache;
+            Pin(TableCache *cache, Slot *slot);
+            Pin(const Pin &);
+            Pin &operator=(const Pin &);
+
+            TableCache *cache_ = nullptr;
+            Slot *slot_ = nullptr;
+    };
+
+    /*
+     * Budget in bytes, 0 means no limit.
+     * Without saveOnExit, the tables still in memory at destruction are
+     * dropped without being saved.
+     */
+    TableCache(size_t budget, bool saveOnExit = true);
+    /*Autosave (if saveOnExit) and drop all the loaded tables*/
+    ~TableCache();
+    /*Register the table file for a signature, without loading it*/
+    void addFile(const std::string &sign, const std::string &file);
+    /*
+     * Pin the table for sign, loading it if needed. Signatures without any
+     * table get a new empty one, to be saved in newFile.
+     */
+    Pin acquire(const std::string &sign, const std::string &newFile);
+    /*Statistics and state of the loaded tables, for dumpStat*/
+    std::string to_string(const std::string &title = "Signature tables");
+
+private:
+    enum SlotState {
+        UNLOADED,
+        /*Being loaded or saved, without the cache lock*/
+        BUSY,
+        LOADED
+    };
+    struct Slot {
+        std::string sign;
+        std::string file;
+        /*Whether file exists, or will be created on first save*/
+        bool onDisk = false;
+        SlotState state = UNLOADED;
+        HashTable *table = nullptr;
+        unsigned int pins = 0;
+        uint64_t serial = 0;
+        /*Last memoryFootprint of table, counted in used_*/
+        size_t footprint = 0;
+        /*Position in lru_, for unpinned loaded tables only*/
+        std::list<Slot *>::iterator lruPos;
+    };
+
+    void unpin(Slot *slot);
+    /*Called with the lock held, account for the new footprint of slot*/
+    void resize(Slot &slot, size_t footprint);
+    /*Called with the lock held, may release it while saving tables*/
+    void enforceBudget(std::unique_lock<std::mutex> &lock);
+    static HashTable *open(const Slot &slot);
+    TableCache(const TableCache &);
+    TableCache &operator=(const TableCache &);
+
+    const size_t budget_;
+    const bool saveOnExit_;
+    std::mutex lock_;
+    std::condition_variable ready_;
+    std::map<std::string, Slot> slots_;
+    /*Unpinned loaded tables, most recently used first*/
+    std::list<Slot *> lru_;
+    /*Sum of the footprints of the loaded tables, in bytes*/
+    size_t used_ = 0;
+    uint64_t nextSerial_ = 1;
+    uint64_t loads_ = 0;
+    uint64_t creations_ = 0;
+    uint64_t evictions_ = 0;
+    uint64_t hits_ = 0;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __TABLEIO_H__
+#define __TABLEIO_H__
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Streaming access to the table files written by HashTable::toPolyglot.
+ * A table file is a 16 bytes header followed by 16 bytes entries sorted by
+ * ascending key. Readers and writers only keep a fixed size buffer, so
+ * they can go through tables much bigger than the memory.
+ *
+ * Tables can also be stored in a compressed block format (".cbt" files) :
+ *   - the same 16 bytes header, with BLOCK_MAGIC instead of the null key ;
+ *   - blocks of up to BLOCK_ENTRIES sorted entries (see encodeBlock) ;
+ *   - the block index, one (first key, offset) pair per block ;
+ *   - a 16 bytes trailer : index offset and number of entries.
+ * Readers accept both formats, writers pick it from the file extension.
+ * Writers also save the bloom filter of block tables next to them (see
+ * bloomFile), so that loading a table doesn't need to decode all its blocks.
+ */
+namespace Table {
+
+    enum Format {
+        POLYGLOT,
+        BLOCK
+    };
+
+    /*One on-disk entry, laid out like a Polyglot book entry*/
+    struct Entry {
+        uint64_t key = 0;
+        uint16_t move = 0;
+        uint16_t weight = 0;
+        uint32_t learn = 0;
+    };
+
+    const size_t ENTRY_SIZE = 16;
+    /*Number of entries read or written at once*/
+    const size_t BUFFER_ENTRIES = 4096;
+
+    /*"HCFTBLK1", in place of the null key of polyglot headers*/
+    const uint64_t BLOCK_MAGIC = 0x314b4c4254464348ULL;
+    const uint16_t BLOCK_VERSION = 1;
+    const size_t BLOCK_ENTRIES = 256;
+    const char BLOCK_EXTENSION[] = ".cbt";
+
+    /*Raw (native endian) encoding of an entry, ENTRY_SIZE bytes*/
+    void decode(const char *buf, Entry &e);
+    void encode(const Entry &e, char *buf);
+
+    /*
+     * A block starts with a flag byte, the number of entries and the first
+     * key. Packed blocks then hold the block's palette of statuses, and a
+     * bit stream with, column by column : one bit per entry telling if it
+     * has a move, the status of each entry (as an index in the palette),
+     * the 15 bits of the non null moves, and the Rice coded key deltas.
+     * The weight is not stored : it is derived from the status, like in
+     * HashTable::toPolyglot. Blocks not fitting this model, or not getting
+     * smaller with it, are stored as raw entries.
+     */
+    void encodeBlock(const Entry *entries, size_t count,
+                     std::vector<char> &out);
+    /*Decode the block in [buf, end[, die if it is corrupted*/
+    void decodeBlock(const char *buf, const char *end,
+                     std::vector<Entry> &out);
+    /*Whether the block in buf is packed, for statistics*/
+    bool isPackedBlock(const char *buf);
+
+    /*Output format of a table, according to its extension*/
+    Format formatFromFilename(const std::string &file);
+    /*File holding the bloom filter of a block table*/
+    std::string bloomFile(const std::string &table);
+
+    /*
+     * Header helpers, the header is one entry sized record holding the
+     * threshold cutoff the table was built with.
+     * readHeader dies if the table is not usable with minCutoff.
+     */
+    void writeHeader(std::ostream &os, uint16_t cutoff,
+                     Format format = POLYGLOT);
+    uint16_t readHeader(std::istream &is, uint16_t minCutoff,
+                        const std::string &file, Format *format = nullptr);
+
+    /*
+     * Random access to a block table : the file is mapped, only the block
+     * index is read at opening. Each lookup decodes a single block.
+     */
+    class BlockTable {
+        public:
+            BlockTable(const std::string &file, uint16_t minCutoff);
+            ~BlockTable();
+            bool find(uint64_t key, Entry &e) const;
+            size_t blockCount() const;
+            /*Decode the block #b into out*/
+            void readBlock(size_t b, std::vector<Entry> &out) const;
+            /*Size in bytes of the block #b, and a pointer to its start*/
+            size_t blockSize(size_t b) const;
+            const char *blockData(size_t b) const;
+            uint64_t entries() const;
+            uint16_t cutoff() const;
+            /*Hint the kernel that the table is going to be read in order*/
+            void adviseSequential() const;
+            mutable std::atomic<uint64_t> blockDecodes_;
+        private:
+            BlockTable(const BlockTable &);
+            BlockTable &operator=(const BlockTable &);
+
+            const std::string file_;
+            int fd_ = -1;
+            const char *data_ = nullptr;
+            size_t size_ = 0;
+            uint16_t cutoff_ = 0;
+            uint64_t entries_ = 0;
+            uint64_t indexOffset_ = 0;
+            std::vector<uint64_t> firstKeys_;
+            std::vector<uint64_t> offsets_;
+    };
+
+    /*Conflict resolution : MATE > THRESHOLD > DRAW > PENDING*/
+    int statusPriority(uint32_t learn);
+
+    class Reader {
+        public:
+            Reader(const std::string &file, uint16_t minCutoff);
+            ~Reader();
+            /*Get the next entry, return false at the end of the table*/
+            bool next(Entry &e);
+            uint16_t cutoff() const;
+            const std::string &file() const;
+            uint64_t entriesRead() const;
+        private:
+            bool fill();
+
+            const std::string file_;
+            std::ifstream is_;
+            uint16_t cutoff_ = 0;
+            std::vector<char> buffer_;
+            /*Only for block tables*/
+            BlockTable *blocks_ = nullptr;
+            size_t nextBlock_ = 0;
+            std::vector<Entry> blockEntries_;
+            size_t bufEntries_ = 0;
+            size_t bufPos_ = 0;
+            uint64_t read_ = 0;
+            uint64_t lastKey_ = 0;
+    };
+
+    class Writer {
+        public:
+            Writer(const std::string &file, uint16_t cutoff,
+                   Format format = POLYGLOT);
+            ~Writer();
+            /*Entries must come by strictly ascending key*/
+            void write(const Entry &e);
+            void close();
+            uint64_t entriesWritten() const;
+        private:
+            void flush();
+            void flushBlock();
+            void saveBloom();
+
+            const std::string file_;
+            const uint16_t cutoff_;
+            const Format format_;
+            std::ofstream os_;
+            std::vector<char> buffer_;
+            size_t bufEntries_ = 0;
+            /*Only for block tables*/
+            std::vector<Entry> block_;
+            std::vector<char> encoded_;
+            std::vector<uint64_t> firstKeys_;
+            std::vector<uint64_t> offsets_;
+            uint64_t offset_ = 0;
+            uint64_t written_ = 0;
+            uint64_t lastKey_ = 0;
+    };
+
+    struct MergeStat {
+        uint64_t entries = 0;
+        uint64_t conflicts = 0;
+        /*Conflicts where the entries did not have the same status*/
+        uint64_t statusConflicts = 0;
+    };
+
+    /*
+     * K-way merge of sorted tables into one sorted table.
+     * All inputs must have a cutoff greater or equal to the output's one.
+     */
+    MergeStat merge(const std::vector<std::string> &inputs,
+                    const std::string &output, uint16_t cutoff);
+}
+
+#endif
@@ -22,13 +22,22 @@
 #ifndef __UCICOMMUNICATOR_H__
 #define __UCICOMMUNICATOR_H__
 
+#include <atomic>
 #include <string>
 #include <map>
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 
+#include "EarlyStop.h"
+#include "EventLoop.h"
+#include "InfoParser.h"
+#include "ResultCache.h"
 #include "Stream.h"
 #include "Line.h"
 
@@ -49,33 +58,98 @@ namespace Comm {
             UCICommunicator(const EngineOptions &options);
             virtual ~UCICommunicator();
 
-            void sendOption(const std::string &name, const std::string &value) const;
-            void sendOptions() const;
+            /*
+             * Commands are queued, and the whole batch is written at once
+             * by flush (eg: options, position and go for one search).
+             * Not thread safe : an engine is driven by one thread at a time.
+             */
+            void queue(const std::string &cmd);
+            bool flush();
+            /*Interrupt the search, from the io thread (see early_stop)*/
+            void stop();
+            /*
+             * optionsMap_ holds the values of the engine, an option is only
+             * queued if its value changes.
+             */
+            void sendOption(const std::string &name, const std::string &value);
+            /*All of optionsMap_, for a new engine*/
+            void sendOptions();
             const std::vector<Line> &getResultLines() const;
 
             /*Communicator specific*/
-            virtual void run() = 0;
+            /*Start the engine, its output is read by io*/
+            virtual void run(EventLoop &io) = 0;
             virtual bool ok() = 0;
-            virtual bool send(const std::string &cmd) const = 0;
-            virtual void quit() const;
+            /*Write some newline terminated commands to the engine*/
+            virtual bool send(const std::string &cmds) = 0;
+            virtual void quit();
+            /*Kill the engine without waiting for it to answer*/
+            virtual void terminate() = 0;
+
+            /*
+             * Send go (and the queued commands), the search is over once
+             * bestmove is received. If snapshot is set, the lines are
+             * copied to the returned future.
+             * If the position was already searched with the same settings,
+             * the lines come from the result cache and go is not sent.
+             * The search may be stopped early, according to mode.
+             * If go can't be sent, the future is broken and waitBestmove
+             * returns false.
+             */
+            std::future<std::vector<Line>> startSearch(const std::string &go,
+                    bool snapshot, EarlyStop::Mode mode = EarlyStop::OPTIONS);
+            /*Send isready and wait for readyok*/
+            bool ready();
+            /*
+             * Look for the queued position in the cache, the keys are kept
+             * to store the result of the search on bestmove.
+             */
+            bool fromCache(const std::string &go);
 
             /*UCI response specific*/
-            int parseUCIMsg(const std::string &msg);
-            void bestmove(std::istringstream &is);
-            void readyok(std::istringstream &is);
-            void info(std::istringstream &is);
-            bool waitBestmove();
+            int parseUCIMsg(const StringView &msg);
+            void bestmove();
+            void readyok();
+            /*
+             * Return false if the engine died, if go could not be sent, or
+             * if the search is not over after timeout (0 for no timeout).
+             */
+            bool waitBestmove(std::chrono::milliseconds timeout
+                              = std::chrono::milliseconds(0));
             bool waitReadyok();
-            void signalBestmove();
-            void signalReadyok();
             void clearLines();
 
+            /*The waits check these, so that no answer can be missed*/
             std::condition_variable readyok_cond_;
             std::mutex readyok_mutex_;
+            unsigned int pendingReadyok_ = 0;
             std::condition_variable bestmove_cond_;
             std::mutex bestmove_mutex_;
+            bool searching_ = false;
+            /*go could not be sent, the search is over without a result*/
+            bool failed_ = false;
+            bool snapshot_ = false;
+            std::promise<std::vector<Line>> result_;
 
             EngineOptions optionsMap_;
+            /*Writes of the driving thread and of the io thread (stop)*/
+            std::mutex send_mutex_;
+            /*Commands waiting for the next flush*/
+            std::string commands_;
+            /*From "id name", part of the result cache keys*/
+            std::string engineId_;
+            /*Last position queued, and where it is in commands_ if unsent*/
+            std::string position_;
+            size_t positionOffset_ = std::string::npos;
+            /*Set by the pool, null if results are not cached*/
+            ResultCache *cache_ = nullptr;
+            bool cacheable_ = false;
+            uint64_t cachePosition_ = 0;
+            uint64_t cacheSettings_ = 0;
+            /*Filled from the info lines, copied to linesVector_ on bestmove*/
+            InfoParser infoParser_;
+            /*Watches the info lines of the current search, see early_stop*/
+            EarlyStop earlyStop_;
             std::vector<Line> linesVector_;
     };
 
@@ -87,10 +161,10 @@ namespace Comm {
             virtual ~LocalUCICommunicator();
 
             /*Communicator implementation*/
-            virtual void run();
-            virtual bool send(const std::string &cmd) const;
+            virtual void run(EventLoop &io);
+            virtual bool send(const std::string &cmds);
             virtual bool ok();
-            virtual void quit() const;
+            virtual void terminate();
 
             /*LocalEngine specific*/
             int getEngineInRead();
@@ -101,15 +175,39 @@ namespace Comm {
             int getEngineErrWrite();
             int in_fds_[2], out_fds_[2], err_fds_[2];
             pid_t childPid_ = 0;
-            OutputStream *engine_input_;
-            InputStream *engine_output_;
-            OutputStream *receiver_input_;
+            EventLoop *io_ = nullptr;
+            uint64_t outSource_ = 0;
+            uint64_t errSource_ = 0;
 
             /*NOTE: maybe common to other implementations (ie: mpi)*/
             const std::string engineFullpath_;
             const std::string engineName_;
     };
 
+    /*
+     * An engine run by engined on another host, reached with TCP at
+     * "host:port". The daemon starts a new engine for each connection and
+     * relays its standard input and output.
+     */
+    class RemoteUCICommunicator : public UCICommunicator {
+        friend class UCICommunicatorPool;
+        private:
+            RemoteUCICommunicator(const std::string address,
+                                  const EngineOptions &options);
+            virtual ~RemoteUCICommunicator();
+
+            /*Communicator implementation*/
+            virtual void run(EventLoop &io);
+            virtual bool send(const std::string &cmds);
+            virtual bool ok();
+            virtual void terminate();
+
+            const std::string address_;
+            int socket_ = -1;
+            EventLoop *io_ = nullptr;
+            uint64_t source_ = 0;
+    };
+
 
     class UCICommunicatorPool {
         /*Singleton, threadsafe*/
@@ -117,21 +215,98 @@ namespace Comm {
             template<class T>
                 int create(const std::string engineFullpath,
                         const EngineOptions &options);
+            /*Send cmd along with the queued commands*/
             bool send(int id, const std::string &cmd);
             bool send(int id, const std::string &&c);
             bool send(int id, const char *c);
+            /*Queue cmd until the next command sent to this engine*/
+            bool queue(int id, const std::string &cmd);
+            /*Round trip to the engine, only when a caller has to wait*/
             bool isReady(int id);
-            bool sendAndWaitBestmove(int id, const std::string &cmd);
+            /*
+             * Return false if the engine crashed or hung (see search_timeout)
+             * during the search. It is then restarted with its options, and
+             * the search has to be submitted again.
+             */
+            bool sendAndWaitBestmove(int id, const std::string &cmd,
+                    EarlyStop::Mode mode = EarlyStop::OPTIONS);
+            /*
+             * Search fen with the given go limits (eg: "movetime 1000")
+             * without waiting for the engine. The future holds a copy of
+             * the result lines once bestmove is received.
+             * Several engines may be driven this way from a single thread.
+             * If the engine is unknown, dead or restarted, or if go can't
+             * be sent, the future is broken : get() throws a future_error
+             * (broken_promise).
+             */
+            std::future<std::vector<Line>> submitSearch(int id,
+                    const std::string &fen, const std::string &limits);
+            /*
+             * Search fen on whichever engine is idle : evaluations are
+             * queued, and each engine takes the next one as soon as it is
+             * done with the previous one. MultiPV is set before the search
+             * if multiPV is not 0, mode is the early stop policy.
+             * An engine failing during a search is restarted, and the
+             * evaluation goes back to the queue for another engine.
+             * Only the engines given to dispatchOn are used. Once the
+             * dispatchers are stopped (see destroyAll), the futures of the
+             * evaluations left are broken.
+             */
+            std::future<std::vector<Line>> evaluate(const std::string &fen,
+                    const std::string &limits, int multiPV = 0,
+                    EarlyStop::Mode mode = EarlyStop::OPTIONS);
+            std::vector<std::future<std::vector<Line>>> evaluate(
+                    const std::vector<std::string> &fens,
+                    const std::string &limits, int multiPV = 0);
+            /*
+             * Give the engines ids to the evaluations. They can't be driven
+             * by id afterwards, the process exits if they are.
+             */
+            void dispatchOn(const std::vector<int> &ids);
+            /*
+             * The option is sent along with the next command, if the engine
+             * does not have this value yet. Call isReady to wait for it.
+             */
             bool sendOption(int id, const std::string &name,
                             const std::string &value);
             const std::vector<Line> &getResultLines(int id);
             bool destroy(int id);
             bool destroyAll();
+            /*Replace an engine with a new one, with the same options*/
+            bool restart(int id);
+            /*Searches done by all the engines, restarted ones excluded*/
+            uint64_t searches() const;
             static UCICommunicatorPool &getInstance();
         private:
+            typedef std::function<UCICommunicator *(const EngineOptions &)>
+                    Factory;
+            struct Evaluation {
+                std::string fen;
+                std::string limits;
+                int multiPV;
+                EarlyStop::Mode mode;
+                std::promise<std::vector<Line>> result;
+            };
             UCICommunicator *get(int id);
-            bool waitForBestmove(int id);
-            bool waitForReadyok(int id);
+            /*get, for the id-based API, refusing the dispatched engines*/
+            UCICommunicator *driven(int id);
+            /*
+             * Start the engine of comm and wait until it's ready.
+             * Returns false if it exited or never got ready, comm is in
+             * the pool anyway, to be restarted.
+             */
+            bool start(int id, UCICommunicator *comm);
+            /*
+             * Search cmd (and the queued commands) on engine id, copying
+             * the result to lines if not null. The engine is restarted if
+             * the search fails.
+             */
+            bool search(int id, UCICommunicator *engine,
+                        const std::string &cmd, EarlyStop::Mode mode,
+                        std::vector<Line> *lines);
+            /*Search the queued evaluations on engine id, until stopped*/
+            void dispatch(int id);
+            void stopDispatchers();
             UCICommunicatorPool &operator=(const UCICommunicatorPool &);
             UCICommunicatorPool(const UCICommunicatorPool &) {};
             UCICommunicatorPool() {};
@@ -139,9 +314,35 @@ namespace Comm {
 
             /*
              * Map of all the UCICommunicator
-             * It maps an id to an UCICommunicator and its managing thread
+             * It maps an id to an UCICommunicator
              */
-            std::map<int, std::pair<UCICommunicator *, std::thread>> pool_;
+            std::map<int, UCICommunicator *> pool_;
+            /*
+             * How to build each engine again, and how many times in a row it
+             * has been restarted. Filled by create, an entry is then only
+             * used by the thread driving this engine.
+             */
+            std::map<int, Factory> factories_;
+            std::map<int, unsigned int> restarts_;
+            /*Shared by all the engines, see result_cache*/
+            ResultCache *cache_ = nullptr;
+            /*Give up on an engine failing this many times in a row*/
+            static const unsigned int MAX_RESTARTS = 3;
+            std::atomic<uint64_t> searches_{0};
+
+            /*Evaluations waiting for an idle engine, see evaluate*/
+            std::deque<Evaluation *> evaluations_;
+            std::mutex evaluationsLock_;
+            std::condition_variable evaluationsCond_;
+            /*One per engine given to dispatchOn*/
+            std::vector<std::thread> dispatchers_;
+            /*Filled by create, set by dispatchOn*/
+            std::map<int, std::atomic<bool>> dispatched_;
+            unsigned int busyDispatchers_ = 0;
+            bool stopDispatch_ = false;
+
+            /*Reads the output of all the engines*/
+            EventLoop io_;
 
             /*
              * This is the current communicator id, should be manipulated
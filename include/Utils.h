@@ -26,6 +26,7 @@
 #include <list>
 #include <vector>
 #include <sys/time.h>
+#include <sys/types.h>
 
 #include "Options.h"
 #include "SimpleChessboard.h"
@@ -40,6 +41,15 @@ namespace Utils {
     bool endsWith(const std::string &thestring, const std::string &end);
     std::vector<std::string> filesFromDir(const std::string &directory,
                                           const std::string &ext);
+    /*pipe(), with both ends closed on exec*/
+    int pipeCloexec(int fds[2]);
+    /*
+     * Start the program at path with in, out and err as its standard
+     * streams, and nothing else inherited but the descriptors not closed
+     * on exec. Return the error of posix_spawn (0 on success).
+     */
+    int spawnProcess(const std::string &path, const std::string &name,
+                     int in, int out, int err, pid_t &pid);
 
     //FIXME: should belong to board ?
     PositionList positionListFromFile(std::string fileName);
@@ -0,0 +1,273 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BloomFilter.h"
+#include "Output.h"
+
+using namespace std;
+
+namespace {
+    const char SAVED_MAGIC[8] = { 'C', 'F', 'B', 'L', 'O', 'O', 'M', '1' };
+
+    struct SavedHeader {
+        char magic[8];
+        uint32_t probes;
+        uint32_t blockBits;
+        /*Version of the table the filter was built for*/
+        uint64_t tableSize;
+        int64_t tableSec;
+        int64_t tableNsec;
+        uint64_t capacity;
+        uint64_t added;
+        double falsePositive;
+    };
+
+    bool tableStamp(const string &table, SavedHeader &header)
+    {
+        memset(&header, 0, sizeof(header));
+        struct stat st;
+        if (stat(table.c_str(), &st))
+            return false;
+        header.tableSize = st.st_size;
+        header.tableSec = st.st_mtim.tv_sec;
+        header.tableNsec = st.st_mtim.tv_nsec;
+        return true;
+    }
+}
+
+BloomFilter::BloomFilter(size_t capacity, double falsePositive) :
+    rejected_(0), passed_(0), falsePositives_(0), capacity_(capacity),
+    falsePositive_(falsePositive), added_(0), next_(nullptr)
+{
+    if (capacity == 0)
+        capacity = capacity_ = 1;
+    if (falsePositive <= 0 || falsePositive >= 1)
+        Err::handle("Invalid bloom filter false positive rate : "
+                    + to_string(falsePositive));
+    /*Optimal number of bits and probes for a classic Bloom filter*/
+    double bits = -(double)capacity * log(falsePositive) / (M_LN2 * M_LN2);
+    int probes = (int)round(bits / capacity * M_LN2);
+    probes_ = (unsigned int)max(1, min(probes, (int)MAX_PROBES));
+
+    uint64_t blocks = 1;
+    while (blocks * WORDS_PER_BLOCK * 64 < bits) {
+        blocks <<= 1;
+        blockBits_++;
+    }
+
+    void *mem = nullptr;
+    if (posix_memalign(&mem, 64, blocksBytes()))
+        Err::handle("Unable to allocate the bloom filter");
+    blocks_ = static_cast<atomic<uint64_t> *>(mem);
+    for (uint64_t i = 0; i < blocks * WORDS_PER_BLOCK; i++)
+        new (&blocks_[i]) atomic<uint64_t>(0);
+}
+
+BloomFilter::BloomFilter() : rejected_(0), passed_(0), falsePositives_(0),
+    added_(0), next_(nullptr)
+{
+}
+
+BloomFilter::~BloomFilter()
+{
+    delete next_.load();
+    if (map_)
+        munmap(map_, mapSize_);
+    else
+        free(blocks_);
+}
+
+/*
+ * Keys of a table may share some bits (eg: a shard of a table), so remix
+ * them before using the high bits of the product, which depend on all the
+ * bits of the key.
+ */
+size_t BloomFilter::blockIndex(uint64_t key) const
+{
+    if (!blockBits_)
+        return 0;
+    return (key * 0x9E3779B97F4A7C15ULL) >> (64 - blockBits_);
+}
+
+uint64_t BloomFilter::probeBits(uint64_t key)
+{
+    return (key ^ (key >> 29)) * 0xBF58476D1CE4E5B9ULL;
+}
+
+void BloomFilter::add(uint64_t key)
+{
+    /*Keys already reported there need no bits, and don't use the capacity*/
+    if (mayContain(key))
+        return;
+    BloomFilter *last = this, *next;
+    while ((next = last->next_.load(memory_order_acquire)))
+        last = next;
+    last->setBits(key);
+    /*A single thread sees the count reach the capacity*/
+    if (last->added_.fetch_add(1, memory_order_relaxed) + 1
+        == last->capacity_) {
+        Out::output("Growing a bloom filter past "
+                    + to_string(last->capacity_) + " keys.\n", 2);
+        last->next_.store(new BloomFilter(2 * last->capacity_,
+                                          last->falsePositive_ / 2),
+                          memory_order_release);
+    }
+}
+
+void BloomFilter::setBits(uint64_t key)
+{
+    atomic<uint64_t> *block = blocks_ + blockIndex(key) * WORDS_PER_BLOCK;
+    uint64_t h = probeBits(key);
+    for (unsigned int i = 0; i < probes_; i++, h <<= 9) {
+        unsigned int bit = h >> 55;
+        uint64_t mask = 1ULL << (bit & 63);
+        /*Avoid dirtying the cache line when the bit is already there*/
+        if (!(block[bit >> 6].load(memory_order_relaxed) & mask))
+            block[bit >> 6].fetch_or(mask, memory_order_release);
+    }
+}
+
+bool BloomFilter::mayContain(uint64_t key) const
+{
+    for (const BloomFilter *f = this; f;
+         f = f->next_.load(memory_order_acquire))
+        if (f->hasBits(key))
+            return true;
+    return false;
+}
+
+bool BloomFilter::hasBits(uint64_t key) const
+{
+    const atomic<uint64_t> *block = blocks_
+                                    + blockIndex(key) * WORDS_PER_BLOCK;
+    uint64_t h = probeBits(key);
+    for (unsigned int i = 0; i < probes_; i++, h <<= 9) {
+        unsigned int bit = h >> 55;
+        if (!(block[bit >> 6].load(memory_order_acquire)
+              & (1ULL << (bit & 63))))
+            return false;
+    }
+    return true;
+}
+
+size_t BloomFilter::blocksBytes() const
+{
+    return ((size_t)1 << blockBits_) * WORDS_PER_BLOCK * sizeof(uint64_t);
+}
+
+size_t BloomFilter::bytes() const
+{
+    size_t retVal = 0;
+    for (const BloomFilter *f = this; f; f = f->next_.load())
+        retVal += f->blocksBytes();
+    return retVal;
+}
+
+unsigned int BloomFilter::probes() const
+{
+    return probes_;
+}
+
+unsigned int BloomFilter::stages() const
+{
+    unsigned int retVal = 0;
+    for (const BloomFilter *f = this; f; f = f->next_.load())
+        retVal++;
+    return retVal;
+}
+
+bool BloomFilter::save(const string &file, const string &table) const
+{
+    static_assert(sizeof(SavedHeader) == HEADER_SIZE, "Bad header size");
+    SavedHeader header;
+    if (next_.load() || !tableStamp(table, header))
+        return false;
+    memcpy(header.magic, SAVED_MAGIC, sizeof(SAVED_MAGIC));
+    header.probes = probes_;
+    header.blockBits = blockBits_;
+    header.capacity = capacity_;
+    header.added = added_.load();
+    header.falsePositive = falsePositive_;
+    /*Replace the file at once : it may be mapped by a loaded table*/
+    string tmp = file + ".tmp";
+    ofstream os(tmp, ios::binary);
+    os.write((const char *)&header, sizeof(header));
+    os.write((const char *)blocks_, blocksBytes());
+    os.close();
+    if (!os.good() || rename(tmp.c_str(), file.c_str())) {
+        unlink(tmp.c_str());
+        Err::output("Unable to save the bloom filter to " + file);
+        return false;
+    }
+    return true;
+}
+
+BloomFilter *BloomFilter::map(const string &file, const string &table)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    SavedHeader header, expected;
+    struct stat st;
+    BloomFilter *retVal = nullptr;
+    ssize_t headerRead = pread(fd, &header, sizeof(header), 0);
+    bool valid = headerRead == (ssize_t)sizeof(header)
+                 && !fstat(fd, &st) && tableStamp(table, expected)
+                 && !memcmp(header.magic, SAVED_MAGIC, sizeof(SAVED_MAGIC))
+                 && header.tableSize == expected.tableSize
+                 && header.tableSec == expected.tableSec
+                 && header.tableNsec == expected.tableNsec
+                 && header.probes >= 1 && header.probes <= MAX_PROBES
+                 && header.blockBits < 48 && header.capacity > 0
+                 && header.falsePositive > 0 && header.falsePositive < 1;
+    if (valid) {
+        uint64_t blocksSize = ((uint64_t)1 << header.blockBits)
+                              * WORDS_PER_BLOCK * sizeof(uint64_t);
+        valid = (uint64_t)st.st_size == HEADER_SIZE + blocksSize;
+    }
+    if (valid) {
+        void *mem = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+        if (mem != MAP_FAILED) {
+            retVal = new BloomFilter();
+            retVal->map_ = mem;
+            retVal->mapSize_ = st.st_size;
+            retVal->blocks_ = reinterpret_cast<atomic<uint64_t> *>(
+                                  static_cast<char *>(mem) + HEADER_SIZE);
+            retVal->blockBits_ = header.blockBits;
+            retVal->probes_ = header.probes;
+            retVal->capacity_ = header.capacity;
+            retVal->falsePositive_ = header.falsePositive;
+            retVal->added_ = header.added;
+        }
+    }
+    close(fd);
+    return retVal;
+}
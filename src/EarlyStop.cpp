@@ -0,0 +1,167 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+
+#include "EarlyStop.h"
+#include "Options.h"
+#include "Output.h"
+
+using namespace std;
+
+namespace Comm {
+
+    atomic<uint64_t> EarlyStop::stops_[DRAW + 1];
+    atomic<uint64_t> EarlyStop::depths_(0);
+    atomic<uint64_t> EarlyStop::times_(0);
+
+    static const char *verdictName[] = {"none", "mate", "threshold", "draw"};
+
+    void EarlyStop::reset(Mode mode)
+    {
+        Options &opt = Options::getInstance();
+        mode_ = mode;
+        enabled_ = (mode == MIXED) || opt.earlyStop();
+        stopped_ = false;
+        verdict_ = NONE;
+        since_ = 0;
+        stopDepth_ = 0;
+        checkpoint_ = opt.getMixedStartDepth();
+        previous_ = PVInfo();
+        start_ = chrono::steady_clock::now();
+    }
+
+    bool EarlyStop::enabled() const
+    {
+        return enabled_;
+    }
+
+    bool EarlyStop::stopped() const
+    {
+        return stopped_;
+    }
+
+    EarlyStop::Verdict EarlyStop::verdict(const PVInfo &best)
+    {
+        if (best.pv.empty())
+            return NONE;
+        if (best.isMat)
+            return MATE;
+        if (abs(best.eval) > Options::getInstance().getCutoffThreshold())
+            return THRESHOLD;
+        if (best.eval == 0)
+            return DRAW;
+        return NONE;
+    }
+
+    bool EarlyStop::contested(const PVInfo &best, const PVInfo &previous)
+    {
+        Options &opt = Options::getInstance();
+        if (best.pv.empty() || best.isMat)
+            return false;
+        int margin = opt.getMixedMargin();
+        if (abs(abs(best.eval) - opt.getCutoffThreshold()) <= margin)
+            return true;
+        return !previous.pv.empty() && (previous.isMat
+                || abs(best.eval - previous.eval) > margin);
+    }
+
+    void EarlyStop::follow(const PVInfo &best)
+    {
+        if (mode_ == MIXED) {
+            followMixed(best);
+            return;
+        }
+        Verdict v = verdict(best);
+        /*Any change starts over, even within a depth*/
+        if (v != verdict_) {
+            verdict_ = v;
+            since_ = best.depth;
+            stopDepth_ = 0;
+        }
+        if (verdict_ == NONE || stopDepth_)
+            return;
+        Options &opt = Options::getInstance();
+        if (best.depth - since_ + 1 < opt.getEarlyStopIterations())
+            return;
+        if (verdict_ != MATE && best.depth < opt.getEarlyStopDepth())
+            return;
+        stopDepth_ = best.depth;
+    }
+
+    void EarlyStop::followMixed(const PVInfo &best)
+    {
+        if (stopDepth_ || best.depth < checkpoint_)
+            return;
+        if (!contested(best, previous_)) {
+            verdict_ = verdict(best);
+            stopDepth_ = best.depth;
+            return;
+        }
+        previous_ = best;
+        checkpoint_ = best.depth + Options::getInstance().getMixedDepthStep();
+    }
+
+    bool EarlyStop::update(unsigned int slot, InfoParser &info)
+    {
+        if (!enabled_ || stopped_)
+            return false;
+        if (slot == 1)
+            follow(info.best());
+        if (!stopDepth_)
+            return false;
+        /*The other lines are still being searched at the previous depth*/
+        for (size_t i = 1; i < info.slots().size(); i++) {
+            int depth = info.depth(i);
+            if (depth && depth < stopDepth_)
+                return false;
+        }
+        stopped_ = true;
+        uint64_t ms = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - start_).count();
+        stops_[verdict_]++;
+        depths_ += stopDepth_;
+        times_ += ms;
+        Out::output("Early stop (" + string(verdictName[verdict_])
+                    + ") at depth " + std::to_string(stopDepth_) + ", after "
+                    + std::to_string(ms) + " ms\n", 3);
+        return true;
+    }
+
+    string EarlyStop::to_string()
+    {
+        uint64_t total = 0;
+        for (const atomic<uint64_t> &stops : stops_)
+            total += stops;
+        string str = "Early stops : " + std::to_string(total);
+        if (!total)
+            return str + "\n";
+        str += " (";
+        /*Only the mixed mode stops without a verdict*/
+        for (int v = (stops_[NONE]) ? NONE : MATE; v <= DRAW; v++)
+            str += string(verdictName[v]) + " " + std::to_string(stops_[v])
+                   + ((v < DRAW) ? ", " : ")");
+        return str + ", at depth " + std::to_string(depths_ / total)
+               + " after " + std::to_string(times_ / total)
+               + " ms on average\n";
+    }
+
+}
@@ -0,0 +1,227 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "EventLoop.h"
+#include "Output.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace Comm {
+
+    EventLoop::Source::Source(int fd, const LineHandler &handler) : fd(fd),
+        reader(fd), handler(handler)
+    {
+    }
+
+    EventLoop::EventLoop()
+    {
+    }
+
+    EventLoop::~EventLoop()
+    {
+        {
+            unique_lock<recursive_mutex> lock(lock_);
+            stop_ = true;
+            if (thread_.joinable())
+                wakeup();
+        }
+        if (thread_.joinable()) {
+            /*Exiting from a handler : the loop can't wait for itself*/
+            if (thread_.get_id() == this_thread::get_id())
+                thread_.detach();
+            else
+                thread_.join();
+        }
+        for (auto &entry : sources_)
+            delete entry.second;
+        if (pollFd_ >= 0)
+            close(pollFd_);
+        if (wakeFds_[0] >= 0) {
+            close(wakeFds_[0]);
+            close(wakeFds_[1]);
+        }
+    }
+
+    uint64_t EventLoop::add(int fd, const LineHandler &handler)
+    {
+        unique_lock<recursive_mutex> lock(lock_);
+        if (!thread_.joinable()) {
+            Err::handle("pipe() : Error creating the wakeup pipe",
+                        Utils::pipeCloexec(wakeFds_));
+            fcntl(wakeFds_[0], F_SETFL, O_NONBLOCK);
+            fcntl(wakeFds_[1], F_SETFL, O_NONBLOCK);
+#ifdef __linux__
+            pollFd_ = epoll_create1(EPOLL_CLOEXEC);
+            if (pollFd_ < 0)
+                Err::handle("epoll_create1", errno);
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = 0;
+            epoll_ctl(pollFd_, EPOLL_CTL_ADD, wakeFds_[0], &ev);
+#endif
+            thread_ = thread(&EventLoop::run, this);
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        uint64_t id = nextId_++;
+        sources_[id] = new Source(fd, handler);
+#ifdef __linux__
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = id;
+        if (epoll_ctl(pollFd_, EPOLL_CTL_ADD, fd, &ev))
+            Err::handle("epoll_ctl", errno);
+#else
+        /*The loop rebuilds its poll set*/
+        wakeup();
+#endif
+        return id;
+    }
+
+    void EventLoop::remove(uint64_t id)
+    {
+        unique_lock<recursive_mutex> lock(lock_);
+        auto found = sources_.find(id);
+        if (found == sources_.end())
+            return;
+        Source *source = found->second;
+        sources_.erase(found);
+        unregister(source);
+        if (source == dispatching_)
+            source->removed = true;
+        else
+            delete source;
+    }
+
+    size_t EventLoop::sources()
+    {
+        unique_lock<recursive_mutex> lock(lock_);
+        return sources_.size();
+    }
+
+    void EventLoop::run()
+    {
+        /*Sources which stopped with complete lines still buffered*/
+        vector<uint64_t> backlog, ready;
+        char drain[64];
+        while (true) {
+            ready.swap(backlog);
+            backlog.clear();
+            int timeout = (ready.empty()) ? -1 : 0;
+#ifdef __linux__
+            epoll_event events[64];
+            int n = epoll_wait(pollFd_, events, 64, timeout);
+            if (n < 0 && errno != EINTR)
+                Err::handle("epoll_wait", errno);
+            for (int i = 0; i < n; i++)
+                ready.push_back(events[i].data.u64);
+#else
+            vector<pollfd> fds;
+            vector<uint64_t> ids;
+            {
+                unique_lock<recursive_mutex> lock(lock_);
+                fds.push_back({wakeFds_[0], POLLIN, 0});
+                ids.push_back(0);
+                for (auto &entry : sources_) {
+                    fds.push_back({entry.second->fd, POLLIN, 0});
+                    ids.push_back(entry.first);
+                }
+            }
+            int n = poll(fds.data(), fds.size(), timeout);
+            if (n < 0 && errno != EINTR)
+                Err::handle("poll", errno);
+            for (size_t i = 0; n > 0 && i < fds.size(); i++)
+                if (fds[i].revents)
+                    ready.push_back(ids[i]);
+#endif
+            unique_lock<recursive_mutex> lock(lock_);
+            if (stop_)
+                return;
+            for (uint64_t id : ready) {
+                if (id == 0) {
+                    while (read(wakeFds_[0], drain, sizeof(drain)) > 0)
+                        ;
+                } else if (dispatch(id)) {
+                    backlog.push_back(id);
+                }
+            }
+            ready.clear();
+        }
+    }
+
+    bool EventLoop::dispatch(uint64_t id)
+    {
+        auto found = sources_.find(id);
+        /*Removed since the wait*/
+        if (found == sources_.end())
+            return false;
+        Source *source = found->second;
+        StringView line;
+        unsigned int lines = 0;
+        dispatching_ = source;
+        while (lines < MAX_LINES_PER_WAKEUP && source->reader.getline(line)) {
+            lines++;
+            if (source->handler(line)) {
+                remove(id);
+                break;
+            }
+            if (source->removed)
+                break;
+        }
+        dispatching_ = nullptr;
+        if (source->removed) {
+            delete source;
+            return false;
+        }
+        if (source->reader.eof()) {
+            remove(id);
+            return false;
+        }
+        return lines == MAX_LINES_PER_WAKEUP;
+    }
+
+    void EventLoop::unregister(Source *source)
+    {
+#ifdef __linux__
+        epoll_ctl(pollFd_, EPOLL_CTL_DEL, source->fd, nullptr);
+#else
+        (void)source;
+        wakeup();
+#endif
+    }
+
+    void EventLoop::wakeup()
+    {
+        char c = 0;
+        if (write(wakeFds_[1], &c, 1) < 0 && errno != EAGAIN)
+            Err::output("Unable to wake up the event loop");
+    }
+
+}
@@ -22,10 +22,13 @@
 
 #include <iostream>
 #include <sstream>
+#include <chrono>
 #include <cmath>
+#include <thread>
 #include <unistd.h>
 
 #include "Finder.h"
+#include "LockStats.h"
 #include "Stream.h"
 #include "Utils.h"
 #include "Output.h"
@@ -35,8 +38,9 @@ using namespace Board;
 
 Options &Finder::opt_ = Options::getInstance();
 Comm::UCICommunicatorPool &Finder::pool_ = Comm::UCICommunicatorPool::getInstance();
-Board::Color Finder::playFor_;
 std::vector<int> Finder::commIds_;
+std::vector<int> Finder::spareIds_;
+std::mutex Finder::spareLock_;
 
 
 Finder::Finder(vector<int> &commIds)
@@ -53,36 +57,120 @@ int Finder::runFinder()
     /*pos.set("rnb1kb1r/ppp1pppp/5n2/3q4/8/2N5/PPPP1PPP/R1BQKBNR w KQkq - 2 4");*/
 
     const PositionList &allPositions = opt_.getPositionList();
+    positions_.assign(allPositions.begin(), allPositions.end());
+    auto start = chrono::steady_clock::now();
+
+    vector<string> summaries(positions_.size());
+    atomic<size_t> next(0);
+    size_t sessions = min((size_t)maxSessions(), positions_.size());
+    spareIds_.assign(commIds_.begin() + max(sessions, (size_t)1),
+                     commIds_.end());
+    if (sessions <= 1) {
+        runSessions(commIds_.front(), next, summaries, false);
+    } else {
+        Out::output("Running " + to_string(positions_.size())
+                    + " positions, " + to_string(sessions) + " at once\n");
+        vector<thread> threads;
+        for (size_t i = 0; i < sessions; i++)
+            threads.push_back(thread(&Finder::runSessions, this, commIds_[i],
+                                     std::ref(next), std::ref(summaries),
+                                     true));
+        for (thread &t : threads)
+            t.join();
+    }
 
-    for (auto startinpos : allPositions) {
-        Position pos;
-        /*Extract infos from pair*/
-        pos.set(startinpos.first);
-        list<string> userMoves = startinpos.second;
+    if (positions_.size() > 1) {
+        Out::output("[Summary]\n");
+        for (size_t i = 0; i < positions_.size(); i++)
+            Out::output("[Summary] " + positions_[i].first + " "
+                        + Utils::listToString(positions_[i].second) + ": "
+                        + summaries[i] + "\n");
+    }
+
+    if (allPositions.empty())
+        Out::output("No position to run the finder on. Please adjust"\
+                    " --startingpos and/or --position_file\n");
 
-        Out::output("Running finder on \"" + pos.fen() + "\", with moves : "
-                    + Utils::listToString(userMoves) + "\n");
+    /*The cost of the finder itself is best seen with mockengine*/
+    double seconds = chrono::duration<double>(chrono::steady_clock::now()
+                                              - start).count();
+    uint64_t searches = pool_.searches();
+    Out::output("[Stats] " + to_string(searches) + " searches in "
+                + to_string(seconds) + " s ("
+                + to_string((uint64_t)(searches / max(seconds, 1e-6)))
+                + " searches/s)\n", 1);
+    Out::output("[Stats] " + LockStats::to_string(), 1);
+    /*The mixed mode stops its searches through the same policy*/
+    if (opt_.earlyStop() || opt_.getSearchMode() == MIXED)
+        Out::output("[Stats] " + Comm::EarlyStop::to_string(), 1);
 
+    return EXIT_SUCCESS;
+}
 
-        /*Fresh finder*/
-        addedMoves_ = 0;
+unsigned int Finder::maxSessions() const
+{
+    return 1;
+}
+
+void Finder::runSessions(int commId, atomic<size_t> &next,
+                         vector<string> &summaries, bool keepApart)
+{
+    size_t i;
+    while ((i = next++) < positions_.size()) {
+        Position pos;
+        /*Extract infos from pair*/
+        pos.set(positions_[i].first);
+        const list<string> &userMoves = positions_[i].second;
+
+        /*Fresh finder, the output is kept apart if several are running*/
+        string buffer;
+        Session session = {commId, keepApart ? &buffer : nullptr,
+                           WHITE, 0, ""};
+        output(session, "Running finder on \"" + pos.fen() + "\", with moves : "
+                        + Utils::listToString(userMoves) + "\n");
         /*Run*/
-        runFinderOnPosition(pos, userMoves);
+        runFinderOnPosition(pos, userMoves, session);
+        summaries[i] = session.summary;
 
+        if (session.output) {
+            lock_guard<mutex> lock(outputLock_);
+            Out::output(buffer);
+        }
     }
+    /*No position left for this engine*/
+    returnEngine(commId);
+}
 
-    if (allPositions.empty())
-        Out::output("No position to run the finder on. Please adjust"\
-                    " --startingpos and/or --position_file\n");
+void Finder::output(Session &session, const string &msg, int level)
+{
+    if (session.output)
+        Out::output(*session.output, msg, level);
+    else
+        Out::output(msg, level);
+}
 
-    return EXIT_SUCCESS;
+int Finder::borrowEngine()
+{
+    lock_guard<mutex> lock(spareLock_);
+    if (spareIds_.empty())
+        return -1;
+    int commId = spareIds_.back();
+    spareIds_.pop_back();
+    return commId;
+}
+
+void Finder::returnEngine(int commId)
+{
+    lock_guard<mutex> lock(spareLock_);
+    spareIds_.push_back(commId);
 }
 
 void Finder::sendPositionToEngine(Board::Position &pos, int commId)
 {
     string position = "position fen ";
     position += pos.fen();
-    pool_.send(commId, position);
+    /*Sent along with the go command*/
+    pool_.queue(commId, position);
 }
 
 
@@ -23,69 +23,118 @@
 #include <fstream>
 #include <sstream>
 #include <queue>
+#include <algorithm>
 #include "Hashing.h"
+#include "TableIO.h"
 #include "SimpleChessboard.h"
 #include "Utils.h"
 #include "Output.h"
+#include "LockStats.h"
 using namespace std;
 
-Node::Node(const Node *prev)
+Node::Node(NodeArena *, uint64_t key) : key_(key), st_(PENDING),
+    prev_(nullptr), moves_(nullptr)
 {
-    prev_.push_back(prev);
 }
 
-Node::Node(const Node *prev, string pos, StatusFlag st) : pos_(pos), st_(st)
+Node::Node(NodeArena *arena, uint64_t key, const string &pos,
+           StatusFlag st) : key_(key), st_(st), prev_(nullptr),
+    moves_(nullptr)
 {
-    prev_.push_back(prev);
+    if (pos.length() > 0)
+        pos_ = arena->copyString(pos);
 }
 
-Node::~Node()
+void Node::safeAddParent(uint64_t parent, NodeArena *arena)
 {
-
+    ParentLink link = { parent, prev_.load(memory_order_relaxed) };
+    ParentLink *cell = arena->createPod(link);
+    while (!prev_.compare_exchange_weak(cell->next, cell,
+                                        memory_order_release,
+                                        memory_order_relaxed))
+        ;
 }
 
-void Node::safeAddParent(const Node *parent)
+void Node::safeAddMove(const string &mv, NodeArena *arena)
 {
-    unique_lock<mutex> lock(lockP_);
-    prev_.push_back(parent);
+    safeAddMove(Board::uciToPolyglot(mv), arena);
 }
 
-void Node::safeAddMove(MoveNode mv)
+void Node::safeAddMove(uint16_t mv, NodeArena *arena)
 {
-    unique_lock<mutex> lock(lockM_);
-    legal_moves_.push_back(mv);
+    MoveLink link = { mv, moves_.load(memory_order_relaxed) };
+    MoveLink *cell = arena->createPod(link);
+    while (!moves_.compare_exchange_weak(cell->next, cell,
+                                         memory_order_release,
+                                         memory_order_relaxed))
+        ;
 }
 
 void Node::updateStatus(StatusFlag st)
 {
-    st_ = st;
+    st_.store(st, memory_order_release);
 }
 
-const vector<const Node *> &Node::getParents() const
+bool Node::transition(StatusFlag from, StatusFlag to)
 {
-    return prev_;
+    uint32_t expected = from;
+    return st_.compare_exchange_strong(expected, to, memory_order_acq_rel);
 }
 
-const LegalNodes &Node::getMoves() const
+uint64_t Node::getKey() const
 {
-    return legal_moves_;
+    return key_;
 }
 
-const string &Node::getPos() const
+bool Node::getLastParent(uint64_t &parent) const
 {
-    return pos_;
+    const ParentLink *head = getParents();
+    if (head)
+        parent = head->parent;
+    return head;
+}
+
+const ParentLink *Node::getParents() const
+{
+    return prev_.load(memory_order_acquire);
+}
+
+const MoveLink *Node::getMoves() const
+{
+    return moves_.load(memory_order_acquire);
+}
+
+unsigned int Node::parentCount() const
+{
+    unsigned int count = 0;
+    for (const ParentLink *l = getParents(); l; l = l->next)
+        count++;
+    return count;
+}
+
+unsigned int Node::moveCount() const
+{
+    unsigned int count = 0;
+    for (const MoveLink *l = getMoves(); l; l = l->next)
+        count++;
+    return count;
+}
+
+string Node::getPos() const
+{
+    return (pos_) ? string(pos_) : string();
 }
 
 Node::StatusFlag Node::getStatus() const
 {
-    return st_;
+    return (StatusFlag)st_.load(memory_order_acquire);
 }
 
 string Node::to_string() const
 {
     string retVal;
-    retVal += "(p:" + std::to_string(prev_.size())
-              + "," + to_string(st_) + "," + pos_ + ")";
+    retVal += "(p:" + std::to_string(parentCount())
+              + "," + to_string(getStatus()) + "," + getPos() + ")";
     return retVal;
 }
 
@@ -113,16 +162,111 @@ string Node::to_string(StatusFlag s)
     return status;
 }
 
-Node *Node::lightCopy()
+Node *Node::lightCopy(NodeArena *arena) const
 {
-    Node *retVal = new Node(nullptr);
-    retVal->st_ = this->st_;
-    retVal->legal_moves_.insert(retVal->legal_moves_.begin(),
-                                this->legal_moves_.begin(),
-                                this->legal_moves_.end());
+    Node *retVal = arena->create(key_);
+    retVal->updateStatus(getStatus());
+    /*Keep the moves order*/
+    vector<const MoveLink *> moves;
+    for (const MoveLink *l = getMoves(); l; l = l->next)
+        moves.push_back(l);
+    for (auto rit = moves.rbegin(); rit != moves.rend(); ++rit)
+        retVal->safeAddMove((*rit)->move, arena);
     return retVal;
 }
 
+std::atomic<size_t> NodeArena::totalReserved_(0);
+std::atomic<size_t> NodeArena::peakReserved_(0);
+std::atomic<size_t> NodeArena::totalChunks_(0);
+
+NodeArena::NodeArena(size_t maxChunkSize) : maxChunkSize_(maxChunkSize),
+    reserved_(0)
+{
+}
+
+NodeArena::~NodeArena()
+{
+    release();
+}
+
+void *NodeArena::allocate(size_t size, size_t align)
+{
+    if (!chunks_.empty()) {
+        size_t offset = (curOffset_ + align - 1) & ~(align - 1);
+        if (offset + size <= chunks_.back().second) {
+            curOffset_ = offset + size;
+            return chunks_.back().first + offset;
+        }
+    }
+    newChunk(size);
+    curOffset_ = size;
+    return chunks_.back().first;
+}
+
+void NodeArena::newChunk(size_t minSize)
+{
+    size_t bytes = MIN_CHUNK_SIZE;
+    if (!chunks_.empty())
+        bytes = std::min(2 * chunks_.back().second, maxChunkSize_);
+    bytes = std::max(bytes, minSize);
+    /*operator new gives memory aligned for any fundamental type*/
+    char *chunk = static_cast<char *>(::operator new(bytes));
+    chunks_.push_back(make_pair(chunk, bytes));
+    curOffset_ = 0;
+    reserved_.fetch_add(bytes, memory_order_relaxed);
+    size_t total = totalReserved_.fetch_add(bytes) + bytes;
+    size_t peak = peakReserved_.load();
+    while (peak < total && !peakReserved_.compare_exchange_weak(peak, total))
+        ;
+    totalChunks_++;
+}
+
+const char *NodeArena::copyString(const string &str)
+{
+    char *dst = static_cast<char *>(allocate(str.length() + 1, 1));
+    str.copy(dst, str.length());
+    dst[str.length()] = '\0';
+    return dst;
+}
+
+void NodeArena::release()
+{
+    for (auto &chunk : chunks_)
+        ::operator delete(chunk.first);
+    totalReserved_ -= reserved_.load();
+    totalChunks_ -= chunks_.size();
+    chunks_.clear();
+    curOffset_ = 0;
+    reserved_ = 0;
+}
+
+size_t NodeArena::bytesUsed() const
+{
+    if (chunks_.empty())
+        return 0;
+    return reserved_.load() - (chunks_.back().second - curOffset_);
+}
+
+size_t NodeArena::bytesReserved() const
+{
+    return reserved_.load(memory_order_relaxed);
+}
+
+size_t NodeArena::totalReserved()
+{
+    return totalReserved_.load();
+}
+
+size_t NodeArena::peakReserved()
+{
+    return peakReserved_.load();
+}
+
+size_t NodeArena::totalChunks()
+{
+    return totalChunks_.load();
+}
+
 HashTable::HashTable(string file) :file_(file)
 {
     cutoffValue_ = Options::getInstance().getCutoffThreshold();
@@ -130,12 +274,170 @@ HashTable::HashTable(string file) :file_(file)
 
 HashTable::~HashTable()
 {
-    Out::output(show_pending());
-    for (HashTable::iterator it = begin(), itEnd = end();
-            it != itEnd; ++it) {
-        delete(it->second);
-    }
+    /*Nodes live in the arenas, dropping the arenas drops the nodes*/
     clear();
+    for (NodeArena *arena : arenas_)
+        delete arena;
+    arenas_.clear();
+    delete bloom_;
+    delete store_;
+}
+
+NodeArena *HashTable::newArena()
+{
+    unique_lock<mutex> lock(lock_);
+    NodeArena *arena = new NodeArena();
+    arenas_.push_back(arena);
+    return arena;
+}
+
+size_t HashTable::arenaBytesUsed()
+{
+    unique_lock<mutex> lock(lock_);
+    size_t used = 0;
+    for (NodeArena *arena : arenas_)
+        used += arena->bytesUsed();
+    return used;
+}
+
+void HashTable::enableBloom()
+{
+    if (bloom_)
+        return;
+    unique_lock<mutex> lock(lock_);
+    if (store_ && Options::getInstance().getBloomFalsePositive() != 0)
+        bloom_ = BloomFilter::map(Table::bloomFile(file_), file_);
+    if (store_ && !bloom_) {
+        if (!(bloom_ = newBloom(size() + storedEntries())))
+            return;
+        /*One pass over the file, so that probes skip most block decodes*/
+        Out::output("Building the bloom filter of " + file_ + ".\n", 2);
+        store_->adviseSequential();
+        vector<Table::Entry> block;
+        for (size_t b = 0; b < store_->blockCount(); b++) {
+            store_->readBlock(b, block);
+            for (const Table::Entry &e : block)
+                bloom_->add(e.key);
+        }
+        blockDecodes_ = store_->blockDecodes_.load();
+        /*Before adding the positions which are only in memory*/
+        bloom_->save(Table::bloomFile(file_), file_);
+    }
+    if (!bloom_ && !(bloom_ = newBloom(size())))
+        return;
+    for (HashTable::iterator it = begin(), itEnd = end(); it != itEnd; ++it)
+        bloom_->add(it->first);
+}
+
+BloomFilter *HashTable::newBloom(size_t entries)
+{
+    Options &opt = Options::getInstance();
+    if (opt.getBloomFalsePositive() == 0)
+        return nullptr;
+    size_t capacity = std::max((size_t)opt.getBloomCapacity(), 2 * entries);
+    return new BloomFilter(capacity, opt.getBloomFalsePositive());
+}
+
+const BloomFilter *HashTable::bloom() const
+{
+    return bloom_;
+}
+
+Node *HashTable::probe(uint64_t key)
+{
+    if (bloom_) {
+        if (!bloom_->mayContain(key)) {
+            bloom_->rejected_.fetch_add(1, memory_order_relaxed);
+            return nullptr;
+        }
+        bloom_->passed_.fetch_add(1, memory_order_relaxed);
+    }
+    Node *retVal = findVal(key);
+    if (!retVal && store_)
+        retVal = materialize(key);
+    if (!retVal && bloom_)
+        bloom_->falsePositives_.fetch_add(1, memory_order_relaxed);
+    return retVal;
+}
+
+Node *HashTable::findOrInsert(uint64_t key, Node *value)
+{
+    /*Add to the filter first : probe() must never reject a key in the map*/
+    if (bloom_)
+        bloom_->add(key);
+    /*An entry of the file must win over the new node*/
+    if (store_ && !findVal(key)) {
+        Node *stored = materialize(key);
+        if (stored)
+            return stored;
+    }
+    return ConcurrentMap<uint64_t, Node *>::findOrInsert(key, value);
+}
+
+Node *HashTable::materialize(uint64_t key)
+{
+    Table::Entry e;
+    if (!store_->find(key, e))
+        return nullptr;
+    unique_lock<mutex> lock = LockStats::acquire(lock_, LockStats::tables);
+    /*Someone may have brought it in while we were decoding*/
+    HashTable::iterator found = find(key);
+    if (found != end())
+        return found->second;
+    Node *n = nodeFromEntry(e, storeArena_);
+    insert(make_pair(key, n));
+    return n;
+}
+
+void HashTable::materializeAll()
+{
+    if (!store_)
+        return;
+    Out::output("Loading all the entries of " + file_ + ".\n", 3);
+    store_->adviseSequential();
+    vector<Table::Entry> block;
+    for (size_t b = 0; b < store_->blockCount(); b++) {
+        store_->readBlock(b, block);
+        for (const Table::Entry &e : block)
+            if (count(e.key) == 0)
+                insert(make_pair(e.key, nodeFromEntry(e, storeArena_)));
+    }
+    blockDecodes_ = store_->blockDecodes_.load();
+    /*Everything is in memory, the file may now be overwritten*/
+    delete store_;
+    store_ = nullptr;
+}
+
+uint64_t HashTable::storedEntries() const
+{
+    return (store_) ? store_->entries() : 0;
+}
+
+uint64_t HashTable::blockDecodes() const
+{
+    return (store_) ? store_->blockDecodes_.load() : blockDecodes_;
+}
+
+size_t HashTable::arenaBytesReserved()
+{
+    unique_lock<mutex> lock(lock_);
+    size_t reserved = 0;
+    for (NodeArena *arena : arenas_)
+        reserved += arena->bytesReserved();
+    return reserved;
+}
+
+size_t HashTable::memoryFootprint()
+{
+    /*Rough cost of a std::map node holding a position*/
+    const size_t mapNodeBytes = 48;
+    unique_lock<mutex> lock(lock_);
+    size_t bytes = std::map<uint64_t, Node *>::size() * mapNodeBytes;
+    for (NodeArena *arena : arenas_)
+        bytes += arena->bytesReserved();
+    if (bloom_)
+        bytes += bloom_->bytes();
+    return bytes;
 }
 
 string HashTable::to_string()
@@ -169,73 +471,94 @@ void HashTable::autosave()
 {
     if (modified_) {
         if (file_.length() > 0)
-            toPolyglot(file_);
+            save(file_);
         else
             Out::output("Unable to autosave table : no filename\n");
     }
 }
 
+void HashTable::save(const string &file)
+{
+    write(file, Table::formatFromFilename(file));
+}
+
 void HashTable::toPolyglot(const string &file)
 {
-    Out::output(show_pending());
-    ofstream os(file, ios::binary);
-    if (!os.good())
-        Out::output("Unable to save table to file "
-                    + file + "\n");
-    outputHeader(os);
+    write(file, Table::POLYGLOT);
+}
+
+void HashTable::toBlockTable(const string &file)
+{
+    write(file, Table::BLOCK);
+}
+
+void HashTable::write(const string &file, Table::Format format)
+{
+    materializeAll();
+    Table::Writer writer(file, cutoffValue_, format);
+    write(writer);
+    writer.close();
+}
+
+void HashTable::write(Table::Writer &writer)
+{
+    materializeAll();
     for (HashTable::iterator it = begin(), itEnd = end();
             it != itEnd; ++it) {
         Node &n = *(it->second);
-        uint64_t hash = it->first;
-        //write hash
-        os.write((char *)&hash, sizeof(uint64_t));
-        uint16_t move = 0x0;
-        uint16_t weight = 0x0;
-        uint32_t learn = 0x0;
-        const LegalNodes &movelist = n.getMoves();
-        if (movelist.size() == 1)
-            move = Board::uciToPolyglot(movelist.front().first);
+        Table::Entry e;
+        e.key = it->first;
+        if (n.moveCount() == 1)
+            e.move = n.getMoves()->move;
         //else multiple move = other side of oracle
-        //write move
-        os.write((char *)&move, sizeof(uint16_t));
-
         Node::StatusFlag st = n.getStatus();
         if (st == Node::STALEMATE || st == Node::DRAW)
-            weight++;
-        //write weight
-        os.write((char *)&weight, sizeof(uint16_t));
-        learn = (uint32_t)n.getStatus();
-        //write learn
-        os.write((char *)&learn, sizeof(uint32_t));
+            e.weight++;
+        e.learn = (uint32_t)st;
+        writer.write(e);
     }
 }
 
+HashTable *HashTable::load(const string &file)
+{
+    ifstream is(file, ios::binary);
+    Table::Format format;
+    Table::readHeader(is, Options::getInstance().getCutoffThreshold(), file,
+                      &format);
+    return (format == Table::BLOCK) ? fromBlockTable(file)
+                                    : fromPolyglot(file);
+}
+
+HashTable *HashTable::fromBlockTable(const string &file)
+{
+    Out::output("Opening block table " + file + ".\n", 3);
+    HashTable *retValue = new HashTable(file);
+    retValue->store_ = new Table::BlockTable(file, retValue->cutoffValue_);
+    retValue->storeArena_ = retValue->newArena();
+    Out::output(std::to_string(retValue->store_->blockCount())
+                + " blocks indexed.\n", 3);
+    return retValue;
+}
+
+Node *HashTable::nodeFromEntry(const Table::Entry &e, NodeArena *arena)
+{
+    Node *n = arena->create(e.key, "", (Node::StatusFlag)e.learn);
+    n->safeAddMove(e.move, arena);
+    return n;
+}
+
 HashTable *HashTable::fromPolyglot(const string &file)
 {
     Out::output("Loading table from " + file + ".\n", 3);
-    ifstream is(file, ios::binary);
-    if (!is.good())
-        Err::handle("Unable to load table from file "
-                    + file);
     HashTable *retValue = new HashTable(file);
-    uint64_t hash = 0x0;
-    uint16_t move = 0x0;
-    uint16_t weight = 0x0;
-    uint32_t learn = 0x0;
+    NodeArena *arena = retValue->newArena();
     Out::output("Import hashtable.\n", 3);
-    retValue->readHeader(is);
-    while (is) {
-        is.read((char *)&hash, sizeof(uint64_t));
-        is.read((char *)&move, sizeof(uint16_t));
-        is.read((char *)&weight, sizeof(uint16_t));
-        is.read((char *)&learn, sizeof(uint32_t));
-        if (!is.good())
-            break;
-        Node *toAdd = new Node(nullptr, "", (Node::StatusFlag)learn);
-        MoveNode mn(Board::polyglotToUci(move), nullptr);
-        toAdd->safeAddMove(mn);
-        pair<uint64_t, Node *> p(hash, toAdd);
-        retValue->insert(p);
+    Table::Reader reader(file, retValue->cutoffValue_);
+    Table::Entry e;
+    /*Entries are sorted : hint the insertion at the end of the map*/
+    while (reader.next(e)) {
+        Node *toAdd = nodeFromEntry(e, arena);
+        retValue->insert(retValue->end(), make_pair(e.key, toAdd));
         Out::output("Inserting pos in hashtable.\n", 3);
     }
     Out::output("Data successfully imported.\n", 3);
@@ -294,42 +617,6 @@ Node *HashTable::unsafeFindPos(uint64_t hash)
 }
 
 
-void HashTable::outputHeader(ostream &os)
-{
-    Out::output("Writting header\n", 3);
-    /*Here we book a spot of 1 entry size to store some meta information*/
-    uint64_t foo = 0;
-    os.write((char *)&foo, sizeof(uint64_t));
-    os.write((char *)&cutoffValue_, sizeof(uint16_t));
-    os.write((char *)&foo, sizeof(uint16_t));
-    os.write((char *)&foo, sizeof(uint32_t));
-}
-
-void HashTable::readHeader(istream &is)
-{
-    Out::output("Reading header\n", 3);
-    if (!is.good())
-        Err::handle("Unable to read header from input file");
-    uint16_t readCutoff = 0;
-    uint64_t readFoo = 0;
-    is.read((char *)&readFoo, sizeof(uint64_t));
-    if (!is.good() || readFoo != 0)
-        Err::handle("Your input table is not compatible with this version of"
-                    " the program !");
-    is.read((char *)&readCutoff, sizeof(uint16_t));
-    if (!is.good() || readCutoff == 0)
-        Err::handle("Invalid cutoff");
-    if (readCutoff < cutoffValue_)
-        Err::handle("Input table has a threshold cutoff value lower than the"
-                    " one used for this session, therefore it's not usable.");
-    /* Note : here do not update cutoffValue, it will just be lower if the table
-     * is written.
-     **/
-    is.read((char *)&readFoo, sizeof(uint16_t) + sizeof(uint32_t));
-    if (!is.good())
-        Err::handle("Unable to fully read header from input file");
-}
-
 int HashTable::pieceOffset(int kind, Board::Rank r, Board::File f)
 {
     return 64 * kind + 8 * r + f;
@@ -0,0 +1,260 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <list>
+#include <string>
+
+#include "InfoParser.h"
+#include "Options.h"
+#include "Output.h"
+#include "SimpleChessboard.h"
+
+using namespace std;
+
+namespace Comm {
+
+    void InfoParser::clear(size_t slots, bool deferred)
+    {
+        deferred_ = deferred;
+        slots_.resize(slots);
+        for (PVInfo &slot : slots_) {
+            slot.depth = 0;
+            slot.eval = 0;
+            slot.isMat = false;
+            slot.pv.clear();
+        }
+        raw_.resize(slots);
+        for (string &raw : raw_)
+            raw.clear();
+    }
+
+    unsigned int InfoParser::add(const StringView &msg, size_t pos)
+    {
+        if (!deferred_)
+            return parse(msg, pos);
+        int slot = lineSlot(msg, pos);
+        if (!slot)
+            return 0;
+        /*Errors are reported by parse*/
+        if (slot < 0 || (size_t)slot > raw_.size())
+            return parse(msg, pos);
+        /*assign keeps the capacity of the string*/
+        StringView line = msg.substr(pos);
+        raw_[slot - 1].assign(line.data(), line.size());
+        return slot;
+    }
+
+    void InfoParser::flush()
+    {
+        for (string &raw : raw_) {
+            if (raw.empty())
+                continue;
+            parse(raw);
+            raw.clear();
+        }
+    }
+
+    int InfoParser::lineSlot(const StringView &msg, size_t pos)
+    {
+        int slot = 0;
+        StringView token;
+        while (!(token = msg.token(pos)).empty()) {
+            if (token == "pv")
+                return (slot > 0) ? slot : -1;
+            else if (token == "multipv")
+                parseInt(msg.token(pos), slot);
+            else if (token == "string")
+                return 0;
+        }
+        return 0;
+    }
+
+    unsigned int InfoParser::parse(const StringView &msg, size_t pos)
+    {
+        bool eval = false;
+        int curDepth = 0;
+        int curEval = 0;
+        bool curIsMat = false;
+        int curLineId = 0;
+        int value = 0;
+        /*Only build the traces if they are going to be displayed*/
+        bool trace = Options::getInstance().getVerboseLevel() >= 4;
+        StringView token;
+        while (!(token = msg.token(pos)).empty()) {
+            if (token == "depth") {
+                parseInt(msg.token(pos), curDepth);
+            } else if (token == "multipv") {
+                parseInt(msg.token(pos), curLineId);
+            } else if (token == "score") {
+                eval = true;
+                token = msg.token(pos);
+                if (token == "mate") {
+                    curIsMat = true;
+                    parseInt(msg.token(pos), curEval);
+                } else if (token == "cp") {
+                    parseInt(msg.token(pos), curEval);
+                } else {
+                    Err::output("********* No score ***********");
+                }
+            } else if (token == "pv") {
+                //NOTE: should be the last token of infoline
+                break;
+            } else if (token == "string") {
+                //The rest of the line is free text
+                return 0;
+            } else if (trace && (token == "time" || token == "nps"
+                                 || token == "hashfull")) {
+                parseInt(msg.token(pos), value);
+                Out::output("Updated " + token.str() + " to "
+                            + to_string(value) + "\n", 4);
+            }
+            /*
+             * Everything else is dropped : seldepth, nodes, currmove,
+             * currmovenumber, tbhits, cpuload, refutation, currline, and
+             * the values we skip.
+             */
+        }
+        if (token != "pv")
+            return 0;
+        if (!eval || curLineId <= 0) {
+            Err::output("**** Line without eval or move... ****");
+            return 0;
+        }
+        if ((size_t)curLineId > slots_.size())
+            Err::handle("Line index out of bound, please adjust MaxMoves"
+                        "above " + to_string(curLineId));
+        scratch_.clear();
+        uint16_t move;
+        while (!(token = msg.token(pos)).empty()) {
+            if (!parseMove(token, move)) {
+                Err::output("**** Invalid move in pv : " + token.str()
+                            + " ****");
+                return 0;
+            }
+            scratch_.push_back(move);
+        }
+        if (scratch_.empty()) {
+            Err::output("**** Line without eval or move... ****");
+            return 0;
+        }
+        PVInfo &slot = slots_[curLineId - 1];
+        slot.depth = curDepth;
+        slot.eval = curEval;
+        slot.isMat = curIsMat;
+        /*A copy rather than a swap : each vector keeps its capacity*/
+        slot.pv.assign(scratch_.begin(), scratch_.end());
+        return curLineId;
+    }
+
+    const vector<PVInfo> &InfoParser::slots() const
+    {
+        return slots_;
+    }
+
+    const PVInfo &InfoParser::best()
+    {
+        if (!raw_.empty() && !raw_[0].empty()) {
+            parse(raw_[0]);
+            raw_[0].clear();
+        }
+        return slots_[0];
+    }
+
+    int InfoParser::depth(size_t slot) const
+    {
+        if (slot < raw_.size() && !raw_[slot].empty()) {
+            StringView line(raw_[slot]);
+            size_t pos = 0;
+            int depth = 0;
+            StringView token;
+            while (!(token = line.token(pos)).empty() && token != "pv")
+                if (token == "depth")
+                    parseInt(line.token(pos), depth);
+            return depth;
+        }
+        return (slot < slots_.size() && !slots_[slot].pv.empty())
+               ? slots_[slot].depth : 0;
+    }
+
+    void InfoParser::toLines(vector<Line> &lines) const
+    {
+        for (size_t i = 0; i < slots_.size() && i < lines.size(); i++) {
+            const PVInfo &slot = slots_[i];
+            if (slot.pv.empty())
+                continue;
+            list<string> moves;
+            for (uint16_t mv : slot.pv)
+                moves.push_back(Board::polyglotToUci(mv));
+            lines[i] = Line(slot.eval, slot.depth, moves, slot.isMat);
+        }
+    }
+
+    bool InfoParser::parseMove(const StringView &mv, uint16_t &move)
+    {
+        if (mv.size() != 4 && mv.size() != 5)
+            return false;
+        unsigned int fromFile = mv[0] - 'a', fromRank = mv[1] - '1';
+        unsigned int toFile = mv[2] - 'a', toRank = mv[3] - '1';
+        if (fromFile > 7 || fromRank > 7 || toFile > 7 || toRank > 7)
+            return false;
+        unsigned int promotion = 0;
+        if (mv.size() == 5) {
+            switch (mv[4]) {
+                case 'n':
+                    promotion = 1;
+                    break;
+                case 'b':
+                    promotion = 2;
+                    break;
+                case 'r':
+                    promotion = 3;
+                    break;
+                case 'q':
+                    promotion = 4;
+                    break;
+                default:
+                    return false;
+            }
+        }
+        move = (uint16_t)(promotion << 12 | fromRank << 9 | fromFile << 6
+                          | toRank << 3 | toFile);
+        return true;
+    }
+
+    bool InfoParser::parseInt(const StringView &token, int &value)
+    {
+        size_t i = 0;
+        bool negative = false;
+        if (i < token.size() && (token[i] == '-' || token[i] == '+'))
+            negative = token[i++] == '-';
+        if (i == token.size())
+            return false;
+        int result = 0;
+        for (; i < token.size(); i++) {
+            if (token[i] < '0' || token[i] > '9')
+                return false;
+            result = result * 10 + (token[i] - '0');
+        }
+        value = (negative) ? -result : result;
+        return true;
+    }
+
+}
@@ -114,6 +114,11 @@ float Line::getEval() const
     return eval_;
 }
 
+int Line::getDepth() const
+{
+    return depth_;
+}
+
 bool Line::empty() const
 {
     return moves_.empty();
@@ -0,0 +1,48 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <sstream>
+
+#include "LockStats.h"
+
+using namespace std;
+
+namespace LockStats {
+
+    Counter tables = {"tables", {0}, {0}};
+    Counter nodeStack = {"node stack", {0}, {0}};
+    Counter tableCache = {"table cache", {0}, {0}};
+    Counter evaluations = {"evaluations", {0}, {0}};
+    Counter splits = {"splits", {0}, {0}};
+
+    string to_string()
+    {
+        ostringstream oss;
+        oss << "Lock contention :";
+        for (const Counter *c : {&tables, &nodeStack, &tableCache,
+                                 &evaluations, &splits})
+            oss << " " << c->name << " " << c->contended.load() << " ("
+                << c->waited.load() / 1000 << " ms)";
+        oss << "\n";
+        return oss.str();
+    }
+
+}
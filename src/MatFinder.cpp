@@ -25,9 +25,11 @@
 #include <cmath>
 #include <unistd.h>
 #include "Finder.h"
+#include "Movegen.h"
 #include "MatFinder.h"
 #include "Utils.h"
 #include "Output.h"
+#include "LockStats.h"
 #include "UCICommunicator.h"
 
 
@@ -36,15 +38,21 @@ using namespace Board;
 
 MatFinder::MatFinder(vector<int> &comm) : Finder(comm)
 {
-    commId_ = comm.front();
 }
 
 MatFinder::~MatFinder()
 {
 }
 
+unsigned int MatFinder::maxSessions() const
+{
+    /*Positions are independent, each engine may close one*/
+    return commIds_.size();
+}
+
 
-int MatFinder::runFinderOnPosition(const Position &p, const list<string> &moves)
+int MatFinder::runFinderOnPosition(const Position &p, const list<string> &moves,
+                                   Session &session)
 {
     Position pos;
     pos.set(p.fen());
@@ -57,52 +65,95 @@ int MatFinder::runFinderOnPosition(const Position &p, const list<string> &moves)
 
     Color sideToMove = pos.side_to_move();
     /*playFor should be the weaker side*/
-    playFor_ = sideToMove;
+    session.playFor = sideToMove;
     Options opt = Options::getInstance();
 
-    Out::output("Starting board is :\n" + pos.pretty() + "\n");
-    Out::output("Doing some basic evaluation on submitted position...\n");
-    pool_.sendOption(commId_, "MultiPV", "8");
+    output(session, "Starting board is :\n" + pos.pretty() + "\n");
+    output(session, "Doing some basic evaluation on submitted position...\n");
+    pool_.sendOption(session.commId, "MultiPV", "8");
 
-    sendPositionToEngine(pos, commId_);
     string init = "go movetime " + to_string(opt.getPlayforMovetime());
-    pool_.sendAndWaitBestmove(commId_, init);
+    /*The position is lost if the engine has to be restarted*/
+    do {
+        sendPositionToEngine(pos, session.commId);
+    } while (!pool_.sendAndWaitBestmove(session.commId, init));
 
-    const vector<Line> &lines = pool_.getResultLines(commId_);
+    /*A copy, a restart of the engine frees its lines*/
+    vector<Line> lines = pool_.getResultLines(session.commId);
 
-    Out::output("Evaluation is :\n");
-    Out::output(Utils::getPrettyLines(pos, lines));
+    output(session, "Evaluation is :\n");
+    output(session, Utils::getPrettyLines(pos, lines));
     if (!lines[0].empty()) {
         if ((lines[0].getEval() < 0 && sideToMove == WHITE)
                 || (lines[0].getEval() > 0 && sideToMove == BLACK))
-            playFor_ = BLACK;
+            session.playFor = BLACK;
         else
-            playFor_ = WHITE;
-        playFor_ = (playFor_ == WHITE)? BLACK : WHITE;
+            session.playFor = WHITE;
+        session.playFor = (session.playFor == WHITE)? BLACK : WHITE;
     }
-    Out::output("Engine will play for : " + color_to_string(playFor_) + "\n");
+    output(session, "Engine will play for : "
+                    + color_to_string(session.playFor) + "\n");
 
 
 
+    Split split;
+    closeLines(pos, session, split);
+    /*The remaining sub-searches are useless now*/
+    split.stop = true;
+    split.cond.notify_all();
+    vector<thread> threads;
+    {
+        unique_lock<mutex> lock =
+                LockStats::acquire(split.lock, LockStats::splits);
+        threads.swap(split.threads);
+    }
+    for (thread &t : threads)
+        t.join();
+
+    //Display info at the end of computation
+    output(session, "[End] Finder is done. Starting board was : \n");
+    output(session, pos.pretty() + "\n");
+
+    lines = pool_.getResultLines(session.commId);
+    if (session.playFor == sideToMove)
+        output(session, "All lines should now be draw or mat :\n");
+    else
+        output(session, "Best line should be mat or draw.\n");
+    output(session, Utils::getPrettyLines(pos, lines));
+    output(session, "[End] Full best line is : \n");
+    output(session, "[End] " + Utils::getPrettyLine(pos, lines[0]) + "\n");
+    output(session, "[End] " + Utils::listToString(lines[0].getMoves())
+                    + "\n");
+    session.summary = "played for " + color_to_string(session.playFor) + ", "
+                      + lines[0].getPrettyEval(pos.side_to_move() == BLACK)
+                      + " " + Utils::listToString(lines[0].getMoves());
+    return 0;
+}
+
+
+void MatFinder::closeLines(Position &pos, Session &session, Split &split)
+{
+    /*Copied after each search, a restart of the engine frees its lines*/
+    vector<Line> lines = pool_.getResultLines(session.commId);
     //Main loop
-    while (true) {
+    while (!split.stop) {
         Color active = pos.side_to_move();
         Line bestLine;
 
-        Out::output("[" + color_to_string(active) + "] Depth "
-                    + to_string(addedMoves_) + "\n");
+        output(session, "[" + color_to_string(active) + "] Depth "
+                        + to_string(session.addedMoves) + "\n");
 
-        sendPositionToEngine(pos, commId_);
+        sendPositionToEngine(pos, session.commId);
 
-        Out::output(pos.pretty(), 2);
+        output(session, pos.pretty(), 2);
 
         //Thinking according to the side the engine play for
-        int moveTime = (active == playFor_ || !addedMoves_) ?
+        int moveTime = (active == session.playFor || !session.addedMoves) ?
                         Options::getInstance().getPlayforMovetime() :
                         Options::getInstance().getPlayagainstMovetime();
 
         //Compute optimal multipv
-        int pv = computeMultiPV(lines);
+        int pv = computeMultiPV(lines, session);
 
 
         //Scaling moveTime
@@ -113,45 +164,65 @@ int MatFinder::runFinderOnPosition(const Position &p, const list<string> &moves)
         if (moveTime <= 600)
             moveTime = 600;
         //Acccording to depth
-        moveTime += 10 * addedMoves_;
+        moveTime += 10 * session.addedMoves;
 
         //Increase movetime with depth
-        pool_.sendAndWaitBestmove(commId_,
-                                  "go movetime " + to_string(moveTime));
-
-        Out::output("[" + color_to_string(active) + "] Thinking... ("
-                    + to_string(moveTime) + ")\n", 1);
-
-        Out::output(Utils::getPrettyLines(pos, lines), 2);
-        bestLine = getBestLine(pos, lines);
-        if (bestLine.empty() || bestLine.isMat() ||
-                fabs(bestLine.getEval()) > Options::getInstance().getMateThreshold()) {
+        string go = "go movetime " + to_string(moveTime);
+        /*All the replies of the defender may be closed by sub-searches*/
+        vector<uint64_t> pending;
+        bool splitClosed = (active == session.playFor
+                            && !restrictReplies(pos, session, split, go,
+                                                pending));
+        bool closed = splitClosed;
+        if (splitClosed) {
+            output(session, "[" + color_to_string(active)
+                            + "] All replies left to sub-searches\n", 1);
+        } else {
+            while (!pool_.sendAndWaitBestmove(session.commId, go))
+                sendPositionToEngine(pos, session.commId);
+            lines = pool_.getResultLines(session.commId);
+
+            output(session, "[" + color_to_string(active) + "] Thinking... ("
+                            + to_string(moveTime) + ")\n", 1);
+
+            output(session, Utils::getPrettyLines(pos, lines), 2);
+            bestLine = getBestLine(pos, lines, session);
+            closed = bestLine.empty() || bestLine.isMat()
+                     || fabs(bestLine.getEval())
+                        > Options::getInstance().getMateThreshold();
+            if (!closed && active == session.playFor)
+                splitReplies(pos, lines, pv, session, split);
+        }
+        if (closed) {
+            /*The replies still searched elsewhere have to be closed too*/
+            waitReplies(split, pending);
             /*Handle the case where we should backtrack*/
-            if (addedMoves_ > 0) {
-                Out::output("\tBacktracking " + pos.getLastMove()
-                            + " (addedMove#" + to_string(addedMoves_) + ")\n");
+            if (session.addedMoves > 0) {
+                output(session, "\tBacktracking " + pos.getLastMove()
+                                + " (addedMove#"
+                                + to_string(session.addedMoves) + ")\n");
 
                 /*
                  * We did a "mistake" : a line previously unbalanced is now a
                  * draw, we should better the backtracking by, for example,
                  * increasing attacking time
                  */
-                if (bestLine.empty())
-                    Out::output("\n\n\n\n DEFENDER SURVIVED \n\n\n\n ", 1);
+                if (bestLine.empty() && !splitClosed)
+                    output(session, "\n\n\n\n DEFENDER SURVIVED \n\n\n\n ", 1);
 
                 //Remove opposite side previous move
-                addedMoves_--;
+                session.addedMoves--;
                 pos.undoLastMove();
 
-                if (active == playFor_) {
+                if (active == session.playFor) {
                     /*
                      *Remove our previous move if we had one, since the
                      *mat is "recorded" by engine
                      *(not the case if starting side is not the side
                      *the engine play for)
                      */
-                    if (addedMoves_ > 0) {
-                        addedMoves_--;
+                    if (session.addedMoves > 0) {
+                        session.addedMoves--;
                         pos.undoLastMove();
                     }
                 }
@@ -163,34 +234,126 @@ int MatFinder::runFinderOnPosition(const Position &p, const list<string> &moves)
         }
 
         /*If we are here, we just need to handle the next move*/
-        Out::output("[" + color_to_string(active)
+        output(session, "[" + color_to_string(active)
                 + "] Chosen line : \n", 1);
-        Out::output("\t" + Utils::getPrettyLine(pos, bestLine) + "\n", 1);
+        output(session, "\t" + Utils::getPrettyLine(pos, bestLine) + "\n", 1);
 
         string next = bestLine.firstMove();
-        Out::output("\tNext move is " + next + "\n", 3);
-        addedMoves_++;
+        output(session, "\tNext move is " + next + "\n", 3);
+        session.addedMoves++;
         if (!pos.tryAndApplyMove(next))
             Err::handle("Invalid Move !");
     }
+}
 
-    //Display info at the end of computation
-    Out::output("[End] Finder is done. Starting board was : \n");
-    Out::output(pos.pretty() + "\n");
+void MatFinder::splitReplies(Position &pos, const vector<Line> &lines, int pv,
+                             Session &session, Split &split)
+{
+    if (!Options::getInstance().splitSubtrees())
+        return;
+    /*The first line is followed by this session*/
+    for (int i = 1; i < pv && i < (int) lines.size(); ++i) {
+        const Line &reply = lines[i];
+        if (reply.empty() || reply.isMat() || fabs(reply.getEval())
+                > Options::getInstance().getMateThreshold())
+            continue;
+        string mv = reply.firstMove();
+        if (!pos.tryAndApplyMove(mv))
+            continue;
+        uint64_t key = pos.hash();
+        string fen = pos.fen();
+        pos.undoLastMove();
+
+        unique_lock<mutex> lock =
+                LockStats::acquire(split.lock, LockStats::splits);
+        if (split.stop || split.closed.count(key) || split.running.count(key))
+            continue;
+        int commId = borrowEngine();
+        if (commId < 0)
+            return;
+        output(session, "\tSplitting " + mv + " to engine "
+                        + to_string(commId) + "\n", 1);
+        split.running[key] = &session;
+        split.threads.push_back(thread(&MatFinder::searchSubtree, this, fen,
+                                       key, session.playFor, commId,
+                                       std::ref(split)));
+    }
+}
 
-    if (playFor_ == sideToMove)
-        Out::output("All lines should now be draw or mat :\n");
-    else
-        Out::output("Best line should be mat or draw.\n");
-    Out::output(Utils::getPrettyLines(pos, lines));
-    Out::output("[End] Full best line is : \n");
-    Out::output("[End] " + Utils::getPrettyLine(pos, lines[0]) + "\n");
-    Out::output("[End] " + Utils::listToString(lines[0].getMoves()) + "\n");
-    return 0;
+void MatFinder::searchSubtree(string fen, uint64_t key, Color playFor,
+                              int commId, Split &split)
+{
+    Position pos;
+    pos.set(fen);
+    string buffer;
+    Session sub = {commId, &buffer, playFor, 0, ""};
+    /*The engine may come from another position*/
+    pool_.sendOption(commId, "MultiPV",
+                     to_string(Options::getInstance().getMaxLines()));
+    closeLines(pos, sub, split);
+    {
+        unique_lock<mutex> lock =
+                LockStats::acquire(split.lock, LockStats::splits);
+        split.running.erase(key);
+        /*Unless stopped, all the lines after this reply are closed*/
+        if (!split.stop)
+            split.closed.insert(key);
+    }
+    split.cond.notify_all();
+    returnEngine(commId);
+    Out::output("[Split] Subtree of \"" + fen + "\" closed by engine "
+                + to_string(commId) + " :\n" + buffer, 1);
+}
+
+bool MatFinder::restrictReplies(Position &pos, const Session &session,
+                                Split &split, string &go,
+                                vector<uint64_t> &pending)
+{
+    if (!Options::getInstance().splitSubtrees())
+        return true;
+    unique_lock<mutex> lock = LockStats::acquire(split.lock, LockStats::splits);
+    if (split.closed.empty() && split.running.empty())
+        return true;
+    vector<Move> all = gen_all(pos);
+    /*Mate or stalemate, let the engine tell*/
+    if (all.empty())
+        return true;
+    vector<string> remaining;
+    for (Move m : all) {
+        if (!pos.tryAndApplyMove(m))
+            continue;
+        uint64_t key = pos.hash();
+        pos.undoLastMove();
+        auto search = split.running.find(key);
+        if (search != split.running.end() && search->second == &session)
+            pending.push_back(key);
+        else if (!split.closed.count(key))
+            remaining.push_back(move_to_string(m));
+    }
+    if (remaining.empty())
+        return false;
+    if (remaining.size() < all.size()) {
+        go += " searchmoves";
+        for (const string &mv : remaining)
+            go += " " + mv;
+    }
+    return true;
 }
 
+void MatFinder::waitReplies(Split &split, const vector<uint64_t> &pending)
+{
+    unique_lock<mutex> lock = LockStats::acquire(split.lock, LockStats::splits);
+    split.cond.wait(lock, [&split, &pending] {
+        if (split.stop)
+            return true;
+        for (uint64_t key : pending)
+            if (split.running.count(key))
+                return false;
+        return true;
+    });
+}
 
-int MatFinder::computeMultiPV(const vector<Line> &lines)
+int MatFinder::computeMultiPV(const vector<Line> &lines, Session &session)
 {
     int diffLimit = 800;
     int multiPV = Options::getInstance().getMaxLines();
@@ -201,14 +364,14 @@ int MatFinder::computeMultiPV(const vector<Line> &lines)
     for (int i = 0; i < (int) lines.size(); ++i)
         if (!lines[i].empty())
             nonEmptyLines++;
-    Out::output("Non empty : " + to_string(nonEmptyLines) + "\n", 3);
+    output(session, "Non empty : " + to_string(nonEmptyLines) + "\n", 3);
     for (int i = 0; i < (int) lines.size(); ++i) {
         if (i > 0) {
             if (lastEvalMat
                 || fabs(lines[i].getEval() - lastEvalValue) > diffLimit) {
-                Out::output("Eval/lastEval : "
-                        + to_string(lines[i].getEval())
-                        + "/" + to_string(lastEvalValue), 3);
+                output(session, "Eval/lastEval : "
+                                + to_string(lines[i].getEval())
+                                + "/" + to_string(lastEvalValue), 3);
                 multiPV = i;
                 allMat &= lastEvalMat;
                 break;
@@ -222,10 +385,10 @@ int MatFinder::computeMultiPV(const vector<Line> &lines)
         multiPV = Options::getInstance().getMaxLines();
 
     if (multiPV != nonEmptyLines) {
-        Out::output("Updating MultiPV to " + to_string(multiPV) + "\n", 2);
-        pool_.sendOption(commId_, "MultiPV", to_string(multiPV));
-        if (!pool_.isReady(commId_))
-            Err::handle("Unable to update MultiPV");
+        output(session, "Updating MultiPV to " + to_string(multiPV) + "\n",
+               2);
+        /*Sent along with the next go command*/
+        pool_.sendOption(session.commId, "MultiPV", to_string(multiPV));
     }
     return multiPV;
 }
@@ -234,7 +397,8 @@ int MatFinder::computeMultiPV(const vector<Line> &lines)
  * This function determine the "best" line to follow
  */
 const Line &MatFinder::getBestLine(const Position &pos,
-                                   const vector<Line> &lines)
+                                   const vector<Line> &lines,
+                                   const Session &session)
 {
     Color active = pos.side_to_move();
     for (int i = 0; i < (int) lines.size(); ++i) {
@@ -248,8 +412,8 @@ const Line &MatFinder::getBestLine(const Position &pos,
             if (fabs(lines[i].getEval()) > limit) {
                 //We should only considered lost positions according to
                 //the side the engine play for
-                if ((lines[i].getEval() < 0 && active == playFor_) ||
-                        (lines[i].getEval() > 0 && active != playFor_))
+                if ((lines[i].getEval() < 0 && active == session.playFor) ||
+                        (lines[i].getEval() > 0 && active != session.playFor))
                     return lines[i];
             } else {
                 //If the line is a draw we don't want it
@@ -82,6 +82,21 @@ int Options::getSearchDepth() const
     return searchDepth_;
 }
 
+int Options::getMixedStartDepth() const
+{
+    return mixedStartDepth_;
+}
+
+int Options::getMixedDepthStep() const
+{
+    return mixedDepthStep_;
+}
+
+int Options::getMixedMargin() const
+{
+    return mixedMargin_;
+}
+
 bool Options::buildOracleForWhite() const
 {
     return buildOracleForWhite_;
@@ -142,11 +157,46 @@ int Options::getEngineThreads() const
     return engineThreads_;
 }
 
+bool Options::getDeferredInfoParsing() const
+{
+    return deferredInfoParsing_;
+}
+
+int Options::getSearchTimeout() const
+{
+    return searchTimeout_;
+}
+
+const string &Options::getResultCache() const
+{
+    return resultCache_;
+}
+
+const vector<string> &Options::getRemoteEngines() const
+{
+    return remoteEngines_;
+}
+
 int Options::getCutoffThreshold() const
 {
     return finderCutoffThreshold_;
 }
 
+bool Options::earlyStop() const
+{
+    return earlyStop_;
+}
+
+int Options::getEarlyStopDepth() const
+{
+    return earlyStopDepth_;
+}
+
+int Options::getEarlyStopIterations() const
+{
+    return earlyStopIterations_;
+}
+
 int Options::getEngineNumber() const
 {
     return finderEngineNumber;
@@ -182,6 +232,11 @@ int Options::getMateThreshold() const
     return mateThreshold_;
 }
 
+bool Options::splitSubtrees() const
+{
+    return splitSubtrees_;
+}
+
 int Options::getMaxLines() const
 {
     return maxLines_;
@@ -203,6 +258,41 @@ bool Options::fullBuild() const
     return fullBuild_;
 }
 
+int Options::getBloomCapacity() const
+{
+    return bloomCapacity_;
+}
+
+double Options::getBloomFalsePositive() const
+{
+    return bloomFalsePositive_;
+}
+
+bool Options::compressedTables() const
+{
+    return compressedTables_;
+}
+
+int Options::getTableMemoryBudget() const
+{
+    return tableMemoryBudget_;
+}
+
+unsigned int Options::getMainTableShardBits() const
+{
+    return mainTableShardBits_;
+}
+
+int Options::getMainTableMemoryBudget() const
+{
+    return mainTableMemoryBudget_;
+}
+
+const string &Options::getSpillFolder() const
+{
+    return spillFolder_;
+}
+
 MoveComparator *Options::getMoveComparator() const
 {
     if (!comp_)
@@ -262,6 +352,15 @@ if (val) {\
     }\
 }
 
+#define PARSE_DOUBLEVAL(option, optionName) \
+if (val) {\
+    try {\
+        option = stod(val);\
+    } catch (...) {\
+        Err::handle("Error parsing " optionName " from configuration file");\
+    }\
+}
+
 #define PARSE_BOOLVAL(option, optionName)\
 if (val) {\
     string sval(val);\
@@ -293,6 +392,28 @@ void Options::addConfig(Config &conf)
     if (val)
         setVariant(val);
 
+    val = conf("engine", "deferred_info_parsing");
+    PARSE_BOOLVAL(deferredInfoParsing_, "deferred_info_parsing");
+
+    val = conf("engine", "search_timeout");
+    PARSE_INTVAL(searchTimeout_, "search_timeout");
+    if (searchTimeout_ < 0)
+        Err::handle("search_timeout must be positive");
+
+    val = conf("engine", "result_cache");
+    if (val)
+        resultCache_ = val;
+
+    val = conf("engine", "remote_engines");
+    if (val) {
+        remoteEngines_.clear();
+        istringstream addresses(val);
+        string address;
+        while (getline(addresses, address, ','))
+            if (!address.empty())
+                remoteEngines_.push_back(address);
+    }
+
     /*Getting Finder configuration*/
     val = conf("finder", "engine_number");
     PARSE_INTVAL(finderEngineNumber, "engine_number");
@@ -300,6 +421,17 @@ void Options::addConfig(Config &conf)
     val = conf("finder", "cutoff_threshold");
     PARSE_INTVAL(finderCutoffThreshold_, "cutoff_threshold");
 
+    val = conf("finder", "early_stop");
+    PARSE_BOOLVAL(earlyStop_, "early_stop");
+
+    val = conf("finder", "early_stop_depth");
+    PARSE_INTVAL(earlyStopDepth_, "early_stop_depth");
+
+    val = conf("finder", "early_stop_iterations");
+    PARSE_INTVAL(earlyStopIterations_, "early_stop_iterations");
+    if (earlyStopIterations_ < 1)
+        Err::handle("early_stop_iterations must be at least 1");
+
     val = conf("finder", "playfor_movetime");
     PARSE_INTVAL(playforMovetime_, "playfor_movetime");
 
@@ -316,6 +448,9 @@ void Options::addConfig(Config &conf)
     val = conf("matfinder", "mate_threshold");
     PARSE_INTVAL(mateThreshold_, "mate_threshold");
 
+    val = conf("matfinder", "split_subtrees");
+    PARSE_BOOLVAL(splitSubtrees_, "split_subtrees");
+
     /*Getting OracleFinder specific configuration*/
     val = conf("oraclefinder", "comparator");
     if (val)
@@ -337,9 +472,49 @@ void Options::addConfig(Config &conf)
     val = conf("oraclefinder", "search_depth");
     PARSE_INTVAL(searchDepth_, "search_depth");
 
+    val = conf("oraclefinder", "mixed_start_depth");
+    PARSE_INTVAL(mixedStartDepth_, "mixed_start_depth");
+    val = conf("oraclefinder", "mixed_depth_step");
+    PARSE_INTVAL(mixedDepthStep_, "mixed_depth_step");
+    if (mixedStartDepth_ < 1 || mixedDepthStep_ < 1)
+        Err::handle("mixed_start_depth and mixed_depth_step must be positive");
+    val = conf("oraclefinder", "mixed_margin");
+    PARSE_INTVAL(mixedMargin_, "mixed_margin");
+
+    val = conf("oraclefinder", "bloom_capacity");
+    PARSE_INTVAL(bloomCapacity_, "bloom_capacity");
+
+    val = conf("oraclefinder", "bloom_false_positive");
+    PARSE_DOUBLEVAL(bloomFalsePositive_, "bloom_false_positive");
+    if (bloomFalsePositive_ < 0 || bloomFalsePositive_ >= 1)
+        Err::handle("bloom_false_positive must be in [0, 1)");
+
+    val = conf("oraclefinder", "compressed_tables");
+    PARSE_BOOLVAL(compressedTables_, "compressed_tables");
+
+    val = conf("oraclefinder", "table_memory_budget");
+    PARSE_INTVAL(tableMemoryBudget_, "table_memory_budget");
+    if (tableMemoryBudget_ < 0)
+        Err::handle("table_memory_budget must be positive");
+
+    val = conf("oraclefinder", "main_table_shard_bits");
+    PARSE_INTVAL(mainTableShardBits_, "main_table_shard_bits");
+    if (mainTableShardBits_ > 16)
+        Err::handle("main_table_shard_bits must be between 0 and 16");
+
+    val = conf("oraclefinder", "main_table_memory_budget");
+    PARSE_INTVAL(mainTableMemoryBudget_, "main_table_memory_budget");
+    if (mainTableMemoryBudget_ < 0)
+        Err::handle("main_table_memory_budget must be positive");
+
+    val = conf("oraclefinder", "spill_folder");
+    if (val)
+        spillFolder_ = val;
+
 }
 
 #undef PARSE_INTVAL
+#undef PARSE_DOUBLEVAL
 #undef PARSE_BOOLVAL
 
 Options::Options()
@@ -38,59 +38,65 @@
 #include "Output.h"
 #include "Hashing.h"
 #include "Movegen.h"
+#include "LockStats.h"
 
 using namespace std;
 using namespace Board;
 
 
 map<string, int> OracleFinder::signStat_;
+TableCache *OracleFinder::signTables_ = nullptr;
+ShardedTable *OracleFinder::mainTable_ = nullptr;
 
 
 NodeStack::NodeStack(unsigned long workers) : maxWorkers_(workers)
 {}
 
-void NodeStack::push(Node *n)
+void NodeStack::push(const PendingNode &n)
 {
-    unique_lock<mutex> lock(lock_);
-    std::stack<Node *>::push(n);
+    unique_lock<mutex> lock = LockStats::acquire(lock_, LockStats::nodeStack);
+    std::stack<PendingNode>::push(n);
     cond_.notify_one();
 }
 
-void NodeStack::push(std::vector<Node *> &nodes)
+void NodeStack::push(std::vector<PendingNode> &nodes)
 {
-    unique_lock<mutex> lock(lock_);
-    for (Node *n : nodes)
-        std::stack<Node *>::push(n);
+    unique_lock<mutex> lock = LockStats::acquire(lock_, LockStats::nodeStack);
+    for (const PendingNode &n : nodes)
+        std::stack<PendingNode>::push(n);
     cond_.notify_one();
 }
 
-Node *NodeStack::poptop()
+bool NodeStack::poptop(PendingNode &n)
 {
-    Node *n = nullptr;
-    unique_lock<mutex> lock(lock_);
+    unique_lock<mutex> lock = LockStats::acquire(lock_, LockStats::nodeStack);
     while (empty()) {
         waitingWorkers_++;
         if (waitingWorkers_ == maxWorkers_) {
             cond_.notify_all();
-            return nullptr;
+            return false;
         } else {
             cond_.wait(lock);
             waitingWorkers_--;
         }
     }
-    n = top();
+    n = std::move(top());
     pop();
-    return n;
+    return true;
 }
 
 unsigned int NodeStack::size()
 {
-    return std::stack<Node *>::size();
+    return std::stack<PendingNode>::size();
 }
 
-void OracleBuilder::displayNodeHistory(const Node *start)
+void OracleBuilder::displayNodeHistory(ShardedTable &oracle,
+                                       const Node *start)
 {
     const Node *cur = start;
+    /*The caller keeps the shard of start pinned*/
+    TableCache::Pin shard;
+    uint64_t parent = 0;
     /*
      * I guess 30 positions are enough to display, since we display this message
      * as soon as we detect an inversion in evaluation.
@@ -102,11 +108,34 @@ void OracleBuilder::displayNodeHistory(const Node *start)
     /*TODO think about what to do if multiple parent*/
     while (cur && i < limit) {
         Out::output(cur->to_string() + "\n");
-        cur = cur->getParents().back();
+        if (!cur->getLastParent(parent))
+            break;
+        shard = oracle.acquire(parent);
+        cur = shard->probe(parent);
         i++;
     }
 }
 
+/*
+ * This worker's arena in a table. By table serial : a dropped table's
+ * address may be reused.
+ */
+static NodeArena *workerArena(map<uint64_t, NodeArena *> &arenas,
+                              const TableCache::Pin &table)
+{
+    NodeArena *&arena = arenas[table.serial()];
+    if (!arena)
+        arena = table->newArena();
+    return arena;
+}
+
+/*A node is settled once, by the worker which popped it from the stack*/
+static void settleNode(Node *n, Node::StatusFlag st)
+{
+    if (!n->transition(Node::PENDING, st))
+        Err::handle("Node status updated twice : " + n->to_string());
+}
+
 bool OracleBuilder::cutNode(const Position &, const Node *)
 {
     /*TODO evaluate if we should process this node or not, according to
@@ -114,8 +143,8 @@ bool OracleBuilder::cutNode(const Position &, const Node *)
     return false;
 }
 
-int OracleBuilder::buildOracle(Board::Color playFor,
-                               ConcurrentMap<string, HashTable *> &oracle,
+int OracleBuilder::buildOracle(Board::Color playFor, ShardedTable &oracle,
+                               TableCache &signTables,
                                const vector<int> &communicators,
                                const Position &p,
                                const list<string> &moves)
@@ -151,16 +180,17 @@ int OracleBuilder::buildOracle(Board::Color playFor,
  *    lines_.clear();
  */
 
+    /*The engines are only driven through evaluate*/
+    Comm::UCICommunicatorPool::getInstance().dispatchOn(communicators);
     NodeStack nodes(communicators.size());
     string initFen = pos.fen();
-    Node *init = new Node(nullptr, initFen, Node::PENDING);
-    Node *rootNode_ = init;
+    PendingNode init = {pos.hash(), initFen, false, 0};
     //depth-first
-    nodes.push(rootNode_);
+    nodes.push(init);
     vector<thread> threads(communicators.size());
     for (unsigned int i = 0; i < threads.size(); i++) {
         threads[i] = thread(OracleBuilder::exploreNode, std::ref(oracle),
-                            std::ref(nodes), playFor, communicators[i]);
+                            std::ref(signTables), std::ref(nodes), playFor);
     }
 
     for (thread &t : threads) {
@@ -180,10 +210,7 @@ int OracleBuilder::buildOracle(Board::Color playFor,
     Out::output(pos.pretty() + "\n");
 
 
-    Out::output("Hashtable size = "
-            + std::to_string(oracle[""]->size()) + ") : \n");
-    Out::output(oracle[""]->to_string() + "\n", 2);
-    Out::output("(size = " + std::to_string(oracle[""]->size()) + ") : \n", 2);
+    Out::output(oracle.to_string(), 1);
 
     return 0;
 }
@@ -191,43 +218,44 @@ int OracleBuilder::buildOracle(Board::Color playFor,
 
 
 
-OracleFinder::OracleFinder(vector<int> &commIds) : Finder(commIds)
+OracleFinder::OracleFinder(vector<int> &commIds) : Finder(commIds),
+    oracle_(opt_.getMainTableShardBits(),
+            (size_t)opt_.getMainTableMemoryBudget() << 20,
+            opt_.getSpillFolder()),
+    tables_((size_t)opt_.getTableMemoryBudget() << 20)
 {
     string inputFilename = opt_.getInputFile();
-    if (inputFilename.size() > 0) {
-        oracleTables_[""] = HashTable::fromPolyglot(inputFilename);
-    } else {
+    if (inputFilename.size() > 0)
+        oracle_.load(inputFilename);
+    else
         Out::output("Creating new main empty table.\n", 2);
-        oracleTables_[""] = new HashTable("");
-    }
+    /*Signature tables are only loaded when the build reaches them*/
+    vector<string> inFiles = Utils::filesFromDir(opt_.getTableFolder(), ".bin");
     for (const string &inFile : Utils::filesFromDir(opt_.getTableFolder(),
-                                                    ".bin")) {
+                                                    Table::BLOCK_EXTENSION))
+        inFiles.push_back(inFile);
+    for (const string &inFile : inFiles) {
         const string &sign = Utils::signatureFromFilename(inFile);
         if (sign.length() == 0)
             Err::handle("Unable to determine table signature (" + inFile + ")");
-        if (oracleTables_.count(sign))
-            Err::handle("Loading twice a table for the same signature ("
-                        + inFile + "/" + sign +")");
         string fileInDir = opt_.getTableFolder() + "/" + inFile;
-        Out::output("Loading table \"" + fileInDir + "\" with signature \""
-                    + sign + "\".\n", 2);
-        oracleTables_[sign] = HashTable::fromPolyglot(fileInDir);
+        Out::output("Found table \"" + fileInDir + "\" with signature \""
+                    + sign + "\".\n", 3);
+        tables_.addFile(sign, fileInDir);
     }
+    signTables_ = &tables_;
+    mainTable_ = &oracle_;
 }
 
 OracleFinder::~OracleFinder()
 {
-    string outputFilename = opt_.getOutputFile();
-    for (auto entry : oracleTables_) {
-        if (entry.first == "") {
-            if (outputFilename.length() > 0)
-                entry.second->toPolyglot(outputFilename);
-        } else {
-            entry.second->autosave();
-        }
-        delete entry.second;
-    }
     dumpStat();
+    signTables_ = nullptr;
+    mainTable_ = nullptr;
+    string outputFilename = opt_.getOutputFile();
+    if (outputFilename.length() > 0)
+        oracle_.save(outputFilename);
+    /*Signature tables are autosaved by tables_*/
 }
 
 void OracleFinder::dumpStat()
@@ -238,60 +266,83 @@ void OracleFinder::dumpStat()
     }
     if (signStat_.size() == 0)
         Out::output("No hit...\n", 2);
+    if (signTables_)
+        Out::output(signTables_->to_string(), 2);
+    if (mainTable_)
+        Out::output(mainTable_->to_string(), 2);
+    Out::output("Node arenas : "
+                + to_string(NodeArena::totalReserved() >> 20) + " MB reserved in "
+                + to_string(NodeArena::totalChunks()) + " chunks (peak "
+                + to_string(NodeArena::peakReserved() >> 20) + " MB).\n", 2);
 }
 
-void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
-                                NodeStack &nodes, Color playFor, int commId)
+vector<Line> OracleBuilder::mixedSearch(const string &fen, string &output)
+{
+    Comm::UCICommunicatorPool &pool = Comm::UCICommunicatorPool::getInstance();
+    Options &opt = Options::getInstance();
+    /*A single search, stopped from its info lines (see EarlyStop)*/
+    string limits = "depth " + to_string(opt.getSearchDepth()) + " movetime "
+                    + to_string(opt.getPlayforMovetime());
+    vector<Line> lines = pool.evaluate(fen, limits, opt.getMaxMoves(),
+                                       Comm::EarlyStop::MIXED).get();
+    Out::output(output, "\t[Mixed] depth " + to_string(lines[0].getDepth())
+                + " : " + lines[0].getPrettyEval(false) + "\n", 2);
+    return lines;
+}
+
+void OracleBuilder::exploreNode(ShardedTable &oracle, TableCache &signTables,
+                                NodeStack &nodes, Color playFor)
 {
     Position pos;
     Comm::UCICommunicatorPool &pool = Comm::UCICommunicatorPool::getInstance();
     Options &opt = Options::getInstance();
-    HashTable *oracle = tables[""];
-    pool.sendOption(commId, "MultiPV", to_string(opt.getMaxMoves()));
+    /*Every table we insert in gets its own arena for this worker*/
+    map<uint64_t, NodeArena *> mainArenas;
+    map<uint64_t, NodeArena *> signArenas;
     //Main loop
-    Node *current = nullptr;
-    while ((current = nodes.poptop())) {
+    PendingNode pending;
+    while (nodes.poptop(pending)) {
         string iterationOutput;
-        const string currentPos = current->getPos();
+        const string &currentPos = pending.pos;
+        uint64_t curHash = pending.key;
 
         Line bestLine;
+        /*Keeps the shard of current in memory until the end of the iteration*/
+        TableCache::Pin shard = oracle.acquire(curHash);
+        NodeArena *arena = workerArena(mainArenas, shard);
+        Node *current = arena->create(curHash, currentPos, Node::PENDING);
+        if (pending.hasParent)
+            current->safeAddParent(pending.parent, arena);
+        /*Keeps the signature table in memory until the end of the iteration*/
+        TableCache::Pin signTable;
         /*Set the chessboard to current pos*/
         pos.set(currentPos);
         Color active = pos.side_to_move();
         string signature = pos.signature();
-        uint64_t curHash = pos.hash();
         bool insertCopyInSignTable = false;
 
         /*Lookup in signature tables*/
         if (signature.length() <= opt.getMaxPiecesEnding()) {
-            HashTable *table = nullptr;
-            if (tables.count(signature) == 0) {
-                string filename = opt.getTableFolder() + "/" + signature
-                                  + ".autosave."
-                                  + opt.getVariantAsString()
-                                  + to_string(opt.getCutoffThreshold())
-                                  + ".bin";
-                table = new HashTable(filename);
-                if (tables.findOrInsert(signature, table) != table) {
-                    delete table;
-                    table = tables[signature];
-                }
-            } else {
-                table = tables[signature];
-            }
+            string filename = opt.getTableFolder() + "/" + signature
+                              + ".autosave."
+                              + opt.getVariantAsString()
+                              + to_string(opt.getCutoffThreshold())
+                              + (opt.compressedTables()
+                                 ? Table::BLOCK_EXTENSION : ".bin");
+            signTable = signTables.acquire(signature, filename);
             Node *s = nullptr;
-            if ((s = table->findVal(curHash))) {
-                current->updateStatus((Node::StatusFlag)
-                                      (s->getStatus() | Node::SIGNATURE_TABLE));
+            if ((s = signTable->probe(curHash))) {
+                settleNode(current, (Node::StatusFlag)
+                                    (s->getStatus() | Node::SIGNATURE_TABLE));
                 if (current->getStatus() & Node::THEM) {
-                    OracleBuilder::displayNodeHistory(current);
+                    OracleBuilder::displayNodeHistory(oracle, current);
                     Out::output("Iteration output for error :\n" + iterationOutput);
                     Err::handle("A node has gone from draw to mate, this is an error"
                                 " until we decide on what to do, and if it's a bug"
                                 " in the engine.");
                 }
-                if (oracle->findOrInsert(curHash, current) != current)
-                    delete current;
+                /*On failure, the node is dropped with the arena*/
+                shard->findOrInsert(curHash, current);
                 continue;
             } else {
                 insertCopyInSignTable = true;
@@ -299,9 +350,8 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
         }
 
         /*Try to find the position and insert it if not found*/
-        if (oracle->findOrInsert(curHash, current) != current) {
+        if (shard->findOrInsert(curHash, current) != current) {
             Out::output(iterationOutput, "Position already in table.\n", 1);
-            delete current;
             continue;
         }
 
@@ -317,7 +367,7 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
 
         /*Clear cut*/
         if (!pos.hasSufficientMaterial()) {
-            current->updateStatus(Node::DRAW);
+            settleNode(current, Node::DRAW);
             Out::output(iterationOutput, "[" + color_to_string(active)
                         + "] Insuficient material.\n", 2);
             //Proceed to next node...
@@ -330,13 +380,9 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
         /*Hit statistic*/
         __atomic_fetch_add(&OracleFinder::signStat_[signature], 1, __ATOMIC_SEQ_CST);
 
-        string position = "position fen ";
-        position += pos.fen();
-        pool.send(commId, position);
-
         if (playFor != active) {
             /*We are on a node where the opponent has to play*/
-            current->updateStatus(Node::AGAINST);
+            settleNode(current, Node::AGAINST);
             /*proceedAgainstNode(pos, current);*/
             vector<Move> all = gen_all(pos);
             /*
@@ -350,12 +396,10 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
                 Out::output(iterationOutput, "+", 2);
                 if (!pos.tryAndApplyMove(m))
                     Err::handle("Illegal move pushed ! (While proceeding against Node)");
-                string fen = pos.fen();
+                PendingNode next = {pos.hash(), pos.fen(), true, curHash};
                 pos.undoLastMove();
-                Node *next = new Node(current, fen, Node::PENDING);
                 nodes.push(next);
-                MoveNode move(uciMv, next);
-                current->safeAddMove(move);
+                current->safeAddMove(uciMv, arena);
             }
             Out::output(iterationOutput, "\n", 2);
             continue;
@@ -365,29 +409,32 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
         /*Here we are on a node with "playfor" to play*/
         /**********************************************/
 
-        const vector<Line> &lines = pool.getResultLines(commId);
-
         /*Thinking according to the side the engine play for*/
         int moveTime = opt.getPlayforMovetime();
 
         Out::output(iterationOutput, "[" + color_to_string(active)
                     + "] Thinking... (" + to_string(moveTime) + ")\n", 1);
 
-        string cmd = "go ";
+        string limits;
         switch (opt.getSearchMode()) {
             case DEPTH:
-                cmd += "depth " + to_string(opt.getSearchDepth());
+                limits = "depth " + to_string(opt.getSearchDepth());
+                break;
+            case MIXED:
+                /*Searched below, with several depths*/
                 break;
-            case MIXED://Intentional no-break
-            /*TODO: implement mixed search ? likely not,
-             * early multipv in stockfish*/
             case TIME:
             default:
-                cmd += "movetime " + to_string(moveTime);
+                limits = "movetime " + to_string(moveTime);
                 break;
         }
-        //Send go and wait for engine to finish thinking
-        pool.sendAndWaitBestmove(commId, cmd);
+        /*
+         * Any idle engine may search the node, a failing engine is restarted
+         * and the node is searched again by the pool.
+         */
+        vector<Line> lines = (limits.empty())
+            ? mixedSearch(pos.fen(), iterationOutput)
+            : pool.evaluate(pos.fen(), limits, opt.getMaxMoves()).get();
 
 
         Out::output(iterationOutput, Utils::getPrettyLines(pos, lines), 2);
@@ -396,7 +443,7 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
         bool skipThisNode = false;
         if (bestLine.empty()) {
             //STALEMATE
-            current->updateStatus(Node::STALEMATE);
+            settleNode(current, Node::STALEMATE);
             Out::output(iterationOutput, "[" + color_to_string(active)
                         + "] Bestline is stalemate (cut)\n", 2);
             //Proceed to next node...
@@ -406,53 +453,52 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
                         + "] Bestline is mate (cut)\n", 2);
             /*Eval is always negative if it's bad for us*/
             if (bestLine.getEval() < 0) {
-                current->updateStatus((Node::StatusFlag)(Node::MATE | Node::THEM));
+                settleNode(current, (Node::StatusFlag)(Node::MATE | Node::THEM));
                 Out::output("Iteration output for error :\n" + iterationOutput);
-                OracleBuilder::displayNodeHistory(current);
+                OracleBuilder::displayNodeHistory(oracle, current);
                 Err::handle("A node has gone from draw to mate, this is an error"
                             " until we decide on what to do, and if it's a bug"
                             " in the engine.");
             } else {
-                current->updateStatus((Node::StatusFlag)(Node::MATE | Node::US));
+                settleNode(current, (Node::StatusFlag)(Node::MATE | Node::US));
             }
             skipThisNode = true;
         } else if (fabs(bestLine.getEval()) > opt.getCutoffThreshold()) {
             Out::output(iterationOutput, "[" + color_to_string(active)
                         + "] Bestline is above threshold (cut)\n", 2);
             if (bestLine.getEval() < 0) {
-                current->updateStatus((Node::StatusFlag)(Node::THRESHOLD | Node::THEM));
+                settleNode(current,
+                           (Node::StatusFlag)(Node::THRESHOLD | Node::THEM));
                 Out::output("Iteration output for error :\n" + iterationOutput);
-                OracleBuilder::displayNodeHistory(current);
+                OracleBuilder::displayNodeHistory(oracle, current);
                 Err::handle("A node has gone from draw to threshold, this is an error"
                             " until we decide on what to do, and if it's a bug"
                             " in the engine.");
             } else {
-                current->updateStatus((Node::StatusFlag)(Node::THRESHOLD | Node::US));
+                settleNode(current,
+                           (Node::StatusFlag)(Node::THRESHOLD | Node::US));
             }
             skipThisNode = true;
         }
 
         /*Trick to avoid code duplicaton for inserting copy in table*/
         if (!skipThisNode) {
-            current->updateStatus(Node::DRAW);
-            /* If we are not in fullBuild mode, just insert a pending node in
-             * table if the signature is low enough
+            /* If we are not in fullBuild mode, just leave a pending node in
+             * table if the signature is low enough (current is already in
+             * the table at this point)
              */
             if (!opt.fullBuild() &&
                 signature.length() <= opt.getMaxPiecesEnding()) {
-                if (oracle->findOrInsert(curHash, current) != current)
-                    delete current;
-                else
-                    current->updateStatus((Node::StatusFlag)
-                                          (current->getStatus() | Node::PENDING));
+                settleNode(current,
+                           (Node::StatusFlag)(Node::DRAW | Node::PENDING));
                 continue;
             }
+            settleNode(current, Node::DRAW);
         }
 
         if (insertCopyInSignTable) {
-            Node *cpy = current->lightCopy();
-            if (tables[signature]->findOrInsert(curHash, cpy) != cpy)
-                delete cpy;
+            Node *cpy = current->lightCopy(workerArena(signArenas, signTable));
+            signTable->findOrInsert(curHash, cpy);
         }
 
         if (skipThisNode)
@@ -484,7 +530,7 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
          * position in the hashtable. If not sort the playable moves
          * according to a user defined comparator
          */
-        Node *next = NULL;
+        bool found = false;
         /*The elected move*/
         string mv;
 
@@ -506,15 +552,18 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
             uint64_t hashpos = pos.hash();
             pos.undoLastMove();
             //Jean Louis' idea to force finding positions in oracle
-            next = oracle->findVal(hashpos);
+            TableCache::Pin nextShard = oracle.acquire(hashpos);
+            Node *next = nextShard->probe(hashpos);
             if (next) {
-                next->safeAddParent(current);
+                next->safeAddParent(curHash,
+                                    workerArena(mainArenas, nextShard));
+                found = true;
                 break;
             }
         }
 
         /*No repetition found, sort the playable lines*/
-        if (!next) {
+        if (!found) {
             std::sort(playableLines.begin(), playableLines.end(),
                          [&pos](const Line &lhs, const Line &rhs)
                          {
@@ -523,19 +572,17 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
             l = playableLines[0];
             mv = l.firstMove();
             pos.tryAndApplyMove(mv);
-            string fenpos = pos.fen();
+            PendingNode next = {pos.hash(), pos.fen(), true, curHash};
             pos.undoLastMove();
 
             //no next position in the table, push the node to stack
-            next = new Node(current, fenpos, Node::PENDING);
             Out::output(iterationOutput, "[" + color_to_string(active)
-                        + "] Pushed first line (" + mv + ") : " + fenpos + "\n", 2);
+                        + "] Pushed first line (" + mv + ") : " + next.pos + "\n", 2);
             nodes.push(next);
         }
 
         /*Whatever the move is, add it to our move list*/
-        MoveNode move(mv, next);
-        current->safeAddMove(move);
+        current->safeAddMove(mv, arena);
         Out::output(iterationOutput, "-----------------------\n", 1);
         /*Send the whole iteration output*/
         Out::output(iterationOutput);
@@ -543,11 +590,13 @@ void OracleBuilder::exploreNode(ConcurrentMap<string, HashTable *> &tables,
 }
 
 int OracleFinder::runFinderOnPosition(const Position &p,
-                                      const list<string> &moves)
+                                      const list<string> &moves,
+                                      Session &session)
 {
     /*Get the side from option*/
-    playFor_ = (opt_.buildOracleForWhite()) ? WHITE : BLACK;
-
+    session.playFor = (opt_.buildOracleForWhite()) ? WHITE : BLACK;
+    session.summary = "oracle built for " + color_to_string(session.playFor);
 
-    return OracleBuilder::buildOracle(playFor_, oracleTables_, commIds_, p, moves);
+    return OracleBuilder::buildOracle(session.playFor, oracle_, tables_,
+                                      commIds_, p, moves);
 }
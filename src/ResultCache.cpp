@@ -0,0 +1,215 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <unistd.h>
+#include "ResultCache.h"
+#include "Output.h"
+#include "SimpleChessboard.h"
+
+using namespace std;
+
+namespace Comm {
+
+    /*
+     * A record is the position key, the settings key, the size of the
+     * encoded lines, and the lines. Each line is its eval (int32), depth
+     * (int16), mate flag and number of moves (uint8), and its polyglot
+     * moves (uint16). Trailing empty lines are not stored.
+     */
+    static const size_t RECORD_HEADER = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+    const uint64_t ResultCache::MAGIC;
+
+    template<class T>
+    static void put(string &out, T value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<class T>
+    static bool get(const string &in, size_t &pos, T &value)
+    {
+        if (pos + sizeof(T) > in.size())
+            return false;
+        memcpy(&value, in.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    ResultCache::ResultCache(const string &file) : file_(file)
+    {
+        ifstream is(file, ios::binary);
+        uint64_t magic = 0;
+        /*Size of the file up to the last complete record*/
+        streamoff valid = 0;
+        if (is.read(reinterpret_cast<char *>(&magic), sizeof(magic))) {
+            if (magic != MAGIC)
+                Err::handle("Result cache " + file + " : bad file format");
+            valid = sizeof(magic);
+            char header[RECORD_HEADER];
+            string payload;
+            while (is.read(header, RECORD_HEADER)) {
+                uint64_t position, settings;
+                uint32_t size;
+                memcpy(&position, header, sizeof(position));
+                memcpy(&settings, header + sizeof(position), sizeof(settings));
+                memcpy(&size, header + 2 * sizeof(uint64_t), sizeof(size));
+                payload.resize(size);
+                if (!is.read(&payload[0], size))
+                    break;
+                results_[make_pair(position, settings)] = payload;
+                valid += RECORD_HEADER + size;
+            }
+        }
+        is.close();
+        if (valid && truncate(file.c_str(), valid))
+            Err::handle("Result cache " + file + " : can't drop the last"
+                        " incomplete record");
+        out_.open(file, ios::binary | ios::app);
+        if (!out_)
+            Err::handle("Result cache " + file + " : can't open the file");
+        if (!valid) {
+            out_.write(reinterpret_cast<const char *>(&MAGIC), sizeof(MAGIC));
+            out_.flush();
+        }
+        Out::output("Result cache : " + to_string(results_.size())
+                    + " results loaded from " + file + "\n", 1);
+    }
+
+    uint64_t ResultCache::settingsKey(const string &engine,
+                                      const string &limits,
+                                      const string &multiPV)
+    {
+        /*FNV-1a, with a separator between the fields*/
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const string *field : {&engine, &limits, &multiPV}) {
+            for (char c : *field) {
+                hash ^= (unsigned char)c;
+                hash *= 0x100000001b3ULL;
+            }
+            hash ^= 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    bool ResultCache::find(uint64_t position, uint64_t settings,
+                           vector<Line> &lines)
+    {
+        unique_lock<mutex> lock(lock_);
+        auto found = results_.find(make_pair(position, settings));
+        if (found == results_.end() || !decode(found->second, lines)) {
+            misses_++;
+            return false;
+        }
+        hits_++;
+        return true;
+    }
+
+    void ResultCache::add(uint64_t position, uint64_t settings,
+                          const vector<Line> &lines)
+    {
+        string payload;
+        /*A hit must give back the lines the engine sent*/
+        if (!encode(lines, payload))
+            return;
+        uint32_t size = payload.size();
+        unique_lock<mutex> lock(lock_);
+        results_[make_pair(position, settings)] = payload;
+        out_.write(reinterpret_cast<const char *>(&position), sizeof(position));
+        out_.write(reinterpret_cast<const char *>(&settings), sizeof(settings));
+        out_.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        out_.write(payload.data(), size);
+        out_.flush();
+        if (!out_)
+            Err::output("Result cache " + file_ + " : write error");
+    }
+
+    size_t ResultCache::size()
+    {
+        unique_lock<mutex> lock(lock_);
+        return results_.size();
+    }
+
+    uint64_t ResultCache::hits()
+    {
+        unique_lock<mutex> lock(lock_);
+        return hits_;
+    }
+
+    uint64_t ResultCache::misses()
+    {
+        unique_lock<mutex> lock(lock_);
+        return misses_;
+    }
+
+    bool ResultCache::encode(const vector<Line> &lines, string &out)
+    {
+        uint16_t count = lines.size();
+        while (count && lines[count - 1].empty())
+            count--;
+        put<uint16_t>(out, count);
+        for (uint16_t i = 0; i < count; i++) {
+            const Line &l = lines[i];
+            const list<string> &moves = l.getMoves();
+            if (moves.size() > UINT8_MAX)
+                return false;
+            uint8_t moveCount = moves.size();
+            put<int32_t>(out, (int32_t)l.getEval());
+            put<int16_t>(out, l.getDepth());
+            put<uint8_t>(out, l.isMat());
+            put<uint8_t>(out, moveCount);
+            auto mv = moves.begin();
+            for (uint8_t m = 0; m < moveCount; m++, ++mv)
+                put<uint16_t>(out, Board::uciToPolyglot(*mv));
+        }
+        return true;
+    }
+
+    bool ResultCache::decode(const string &in, vector<Line> &lines)
+    {
+        size_t pos = 0;
+        uint16_t count;
+        if (!get(in, pos, count) || count > lines.size())
+            return false;
+        for (Line &l : lines)
+            l = Line();
+        for (uint16_t i = 0; i < count; i++) {
+            int32_t eval;
+            int16_t depth;
+            uint8_t isMat, moveCount;
+            if (!get(in, pos, eval) || !get(in, pos, depth)
+                || !get(in, pos, isMat) || !get(in, pos, moveCount))
+                return false;
+            list<string> moves;
+            for (uint8_t m = 0; m < moveCount; m++) {
+                uint16_t mv;
+                if (!get(in, pos, mv))
+                    return false;
+                moves.push_back(Board::polyglotToUci(mv));
+            }
+            lines[i] = Line(eval, depth, moves, isMat);
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,196 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ShardedTable.h"
+#include "Options.h"
+#include "Output.h"
+
+using namespace std;
+
+ShardedTable::ShardedTable(unsigned int shardBits, size_t budget,
+                           const string &spillFolder) :
+    shardBits_(shardBits), spillFolder_(spillFolder),
+    spill_(shardBits > 0 || budget > 0), shards_(budget, false),
+    dirty_(new atomic<bool>[shardCount()])
+{
+    for (unsigned int i = 0; i < shardCount(); i++)
+        dirty_[i] = true;
+    if (spill_ && mkdir(spillFolder_.c_str(), 0755) && errno != EEXIST)
+        Err::handle("Unable to create spill folder " + spillFolder_, errno);
+}
+
+ShardedTable::~ShardedTable()
+{
+    if (!spill_)
+        return;
+    /*Tables still mapping these files keep them alive until dropped*/
+    for (unsigned int i = 0; i < shardCount(); i++) {
+        unlink(shardFile(i).c_str());
+        unlink(Table::bloomFile(shardFile(i)).c_str());
+    }
+}
+
+void ShardedTable::load(const string &file)
+{
+    if (!spill_) {
+        /*Never dropped, so never written back*/
+        shards_.addFile(shardSign(0), file);
+        return;
+    }
+    vector<string> files;
+    struct stat st;
+    if (shardBits_ && stat(file.c_str(), &st)) {
+        /*Shard files are sorted and disjoint, read them in order*/
+        for (unsigned int i = 0; i < shardCount(); i++)
+            if (!stat(savedFile(file, i).c_str(), &st))
+                files.push_back(savedFile(file, i));
+    }
+    if (files.empty())
+        files.push_back(file);
+    Out::output("Splitting " + file + " in " + std::to_string(shardCount())
+                + " shards.\n", 1);
+    split(files);
+}
+
+void ShardedTable::split(const vector<string> &files)
+{
+    Table::Writer *writer = nullptr;
+    unsigned int current = 0;
+    Table::Entry e;
+    for (const string &file : files) {
+        Table::Reader reader(file,
+                             Options::getInstance().getCutoffThreshold());
+        /*Keys are sorted, so each shard is a contiguous run of the input*/
+        while (reader.next(e)) {
+            unsigned int shard = shardOf(e.key);
+            if (!writer || shard != current) {
+                if (writer) {
+                    writer->close();
+                    delete writer;
+                    shards_.addFile(shardSign(current), shardFile(current));
+                }
+                current = shard;
+                writer = new Table::Writer(shardFile(current),
+                                           reader.cutoff(), Table::BLOCK);
+            }
+            writer->write(e);
+        }
+    }
+    if (writer) {
+        writer->close();
+        delete writer;
+        shards_.addFile(shardSign(current), shardFile(current));
+    }
+}
+
+void ShardedTable::save(const string &file)
+{
+    int cutoff = Options::getInstance().getCutoffThreshold();
+    Table::Format format = Table::formatFromFilename(file);
+    if (!shardBits_) {
+        Table::Writer writer(file, cutoff, format);
+        acquireShard(0)->write(writer);
+        writer.close();
+        Out::output("Saved " + std::to_string(writer.entriesWritten())
+                    + " positions to " + file + ".\n", 1);
+        return;
+    }
+    uint64_t positions = 0;
+    unsigned int written = 0, unchanged = 0;
+    /*One shard at a time, the others may be dropped meanwhile*/
+    for (unsigned int i = 0; i < shardCount(); i++) {
+        string out = savedFile(file, i);
+        if (file == savedTo_ && !dirty_[i]) {
+            unchanged++;
+            continue;
+        }
+        dirty_[i] = false;
+        Table::Writer writer(out, cutoff, format);
+        acquireShard(i)->write(writer);
+        writer.close();
+        if (writer.entriesWritten() == 0) {
+            /*Don't leave empty files around, nor stale ones*/
+            unlink(out.c_str());
+            unlink(Table::bloomFile(out).c_str());
+            continue;
+        }
+        positions += writer.entriesWritten();
+        written++;
+    }
+    savedTo_ = file;
+    Out::output("Saved " + std::to_string(positions) + " positions to "
+                + std::to_string(written) + " shard files of " + file + " ("
+                + std::to_string(unchanged) + " unchanged).\n", 1);
+}
+
+string ShardedTable::savedFile(const string &file, unsigned int shard) const
+{
+    if (!shardBits_)
+        return file;
+    /*Keep the extension, it gives the format of the table*/
+    size_t dot = file.find_last_of('.');
+    if (dot == string::npos || file.find('/', dot) != string::npos)
+        dot = file.length();
+    return file.substr(0, dot) + "." + shardSign(shard) + file.substr(dot);
+}
+
+unsigned int ShardedTable::shardOf(uint64_t key) const
+{
+    return (shardBits_) ? (unsigned int)(key >> (64 - shardBits_)) : 0;
+}
+
+unsigned int ShardedTable::shardCount() const
+{
+    return 1U << shardBits_;
+}
+
+TableCache::Pin ShardedTable::acquire(uint64_t key)
+{
+    unsigned int shard = shardOf(key);
+    dirty_[shard] = true;
+    return acquireShard(shard);
+}
+
+string ShardedTable::to_string()
+{
+    return shards_.to_string("Main table shards");
+}
+
+TableCache::Pin ShardedTable::acquireShard(unsigned int shard)
+{
+    return shards_.acquire(shardSign(shard), shardFile(shard));
+}
+
+string ShardedTable::shardSign(unsigned int shard) const
+{
+    return "shard" + std::to_string(shard);
+}
+
+string ShardedTable::shardFile(unsigned int shard) const
+{
+    /*Builds sharing a spill folder must not overwrite each other's shards*/
+    return spillFolder_ + "/oracle." + std::to_string(getpid()) + "."
+           + shardSign(shard) + Table::BLOCK_EXTENSION;
+}
@@ -19,6 +19,8 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <cerrno>
+#include <cstring>
 #include <ext/stdio_filebuf.h>
 #include "Stream.h"
 
@@ -55,56 +57,80 @@ void Stream::open(int file_descriptor, ios_base::openmode openmode)
 
 Stream::~Stream()
 {
-    if (file_descriptor_)
-        close(file_descriptor_);
+    /*The filebuf closes the descriptor*/
     if (filebuf_)
         delete filebuf_;
+    else if (file_descriptor_ >= 0)
+        close(file_descriptor_);
 }
 
 
-InputStream::InputStream(int file_descriptor) :
-    Stream(file_descriptor, ios_base::in)
+LineReader::LineReader(int file_descriptor, size_t readSize) :
+    file_descriptor_(file_descriptor), readSize_(readSize),
+    buffer_(2 * readSize)
 {
-    stdistream_ = new istream(filebuf_);
 }
 
-void InputStream::open(int file_descriptor)
+bool LineReader::getline(StringView &line)
 {
-    if (!stdistream_)
-    {
-        Stream::open(file_descriptor, ios_base::in);
-        stdistream_ = new istream(filebuf_);
+    while (true) {
+        const char *data = buffer_.data();
+        const char *eol = (const char *)memchr(data + scan_, '\n',
+                                               end_ - scan_);
+        if (eol || (eof_ && begin_ < end_)) {
+            size_t lineEnd = (eol) ? eol - data : end_;
+            size_t length = lineEnd - begin_;
+            if (length > 0 && data[lineEnd - 1] == '\r')
+                length--;
+            line = StringView(data + begin_, length);
+            begin_ = scan_ = (eol) ? lineEnd + 1 : end_;
+            return true;
+        }
+        if (eof_)
+            return false;
+        scan_ = end_;
+        reserve();
+        ssize_t got = read(file_descriptor_, buffer_.data() + end_,
+                           buffer_.size() - end_);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+        if (got <= 0)
+            eof_ = true;
+        else
+            end_ += got;
     }
 }
 
-InputStream& InputStream::operator>> (string& str)
+size_t LineReader::buffered() const
 {
-    (*stdistream_) >> str;
-
-    return *this;
+    return end_ - begin_;
 }
 
-size_t InputStream::getline(char* s, streamsize n)
+bool LineReader::eof() const
 {
-    return (getline(s, n, '\n'));
+    return eof_ && begin_ == end_;
 }
 
-size_t InputStream::getline(char* s, streamsize n, char delim)
+void LineReader::reserve()
 {
-    int i = 0;
-    do{
-        s[i] = stdistream_->get();
-        i++;
-    } while(i < n-1 && s[i-1] != delim && s[i-1] != '\0');
-
-    s[i-1] = '\0'; // overwrite the delimiter given with string end
-
-    return i-1;
-}
-
-InputStream::~InputStream()
-{
-    delete stdistream_;
+    if (begin_ == end_) {
+        /*Everything was consumed, the common case between two reads*/
+        begin_ = scan_ = end_ = 0;
+        return;
+    }
+    if (buffer_.size() - end_ >= readSize_)
+        return;
+    /*Move the partial line at the front, growing if it is too long*/
+    size_t pending = end_ - begin_;
+    if (begin_ > 0)
+        memmove(buffer_.data(), buffer_.data() + begin_, pending);
+    scan_ -= begin_;
+    begin_ = 0;
+    end_ = pending;
+    if (buffer_.size() - end_ < readSize_)
+        buffer_.resize(2 * buffer_.size());
 }
 
 OutputStream::OutputStream(int file_descriptor) :
@@ -137,10 +163,3 @@ OutputStream::~OutputStream()
     delete stdostream_;
 }
 
-size_t getline(InputStream& is, string &str)
-{
-    char tmp[BUFFER_SIZE];
-    size_t ret = is.getline(tmp, BUFFER_SIZE);
-    str = tmp;
-    return ret;
-}
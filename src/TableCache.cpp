@@ -0,0 +1,248 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TableCache.h"
+#include "Output.h"
+#include "LockStats.h"
+
+using namespace std;
+
+TableCache::Pin::Pin()
+{
+}
+
+TableCache::Pin::Pin(TableCache *cache, Slot *slot) : cache_(cache),
+    slot_(slot)
+{
+}
+
+TableCache::Pin::Pin(Pin &&other) : cache_(other.cache_), slot_(other.slot_)
+{
+    other.cache_ = nullptr;
+    other.slot_ = nullptr;
+}
+
+TableCache::Pin &TableCache::Pin::operator=(Pin &&other)
+{
+    if (this != &other) {
+        release();
+        cache_ = other.cache_;
+        slot_ = other.slot_;
+        other.cache_ = nullptr;
+        other.slot_ = nullptr;
+    }
+    return *this;
+}
+
+TableCache::Pin::~Pin()
+{
+    release();
+}
+
+HashTable *TableCache::Pin::get() const
+{
+    return (slot_) ? slot_->table : nullptr;
+}
+
+HashTable *TableCache::Pin::operator->() const
+{
+    return get();
+}
+
+uint64_t TableCache::Pin::serial() const
+{
+    return (slot_) ? slot_->serial : 0;
+}
+
+void TableCache::Pin::release()
+{
+    if (cache_)
+        cache_->unpin(slot_);
+    cache_ = nullptr;
+    slot_ = nullptr;
+}
+
+TableCache::TableCache(size_t budget, bool saveOnExit) : budget_(budget),
+    saveOnExit_(saveOnExit)
+{
+}
+
+TableCache::~TableCache()
+{
+    for (auto &entry : slots_) {
+        Slot &slot = entry.second;
+        if (slot.state != LOADED)
+            continue;
+        if (slot.pins)
+            Err::handle("Table " + slot.sign + " is still in use");
+        if (saveOnExit_)
+            slot.table->autosave();
+        delete slot.table;
+    }
+}
+
+void TableCache::addFile(const string &sign, const string &file)
+{
+    unique_lock<mutex> lock(lock_);
+    if (slots_.count(sign))
+        Err::handle("Loading twice a table for the same signature ("
+                    + file + "/" + sign +")");
+    Slot &slot = slots_[sign];
+    slot.sign = sign;
+    slot.file = file;
+    slot.onDisk = true;
+}
+
+TableCache::Pin TableCache::acquire(const string &sign, const string &newFile)
+{
+    unique_lock<mutex> lock = LockStats::acquire(lock_, LockStats::tableCache);
+    Slot &slot = slots_[sign];
+    if (slot.sign.empty()) {
+        slot.sign = sign;
+        slot.file = newFile;
+    }
+    while (slot.state == BUSY)
+        ready_.wait(lock);
+    if (slot.state == LOADED) {
+        hits_++;
+        if (slot.pins++ == 0)
+            lru_.erase(slot.lruPos);
+        return Pin(this, &slot);
+    }
+    /*Other tables stay available while this one is read*/
+    slot.state = BUSY;
+    lock.unlock();
+    HashTable *table = open(slot);
+    size_t footprint = (budget_) ? table->memoryFootprint() : 0;
+    lock.lock();
+    resize(slot, footprint);
+    slot.table = table;
+    slot.state = LOADED;
+    slot.pins = 1;
+    slot.serial = nextSerial_++;
+    if (slot.onDisk)
+        loads_++;
+    else
+        creations_++;
+    ready_.notify_all();
+    enforceBudget(lock);
+    return Pin(this, &slot);
+}
+
+void TableCache::unpin(Slot *slot)
+{
+    /*
+     * The table may have grown while it was pinned. It can't be dropped
+     * before the pin is released, so it is measured without the cache lock.
+     */
+    size_t footprint = (budget_) ? slot->table->memoryFootprint() : 0;
+    unique_lock<mutex> lock = LockStats::acquire(lock_, LockStats::tableCache);
+    resize(*slot, footprint);
+    if (--slot->pins > 0)
+        return;
+    lru_.push_front(slot);
+    slot->lruPos = lru_.begin();
+    enforceBudget(lock);
+}
+
+void TableCache::resize(Slot &slot, size_t footprint)
+{
+    used_ = used_ - slot.footprint + footprint;
+    slot.footprint = footprint;
+}
+
+void TableCache::enforceBudget(unique_lock<mutex> &lock)
+{
+    if (budget_ == 0)
+        return;
+    while (!lru_.empty() && used_ > budget_) {
+        Slot *victim = lru_.back();
+        lru_.pop_back();
+        HashTable *table = victim->table;
+        victim->table = nullptr;
+        victim->state = BUSY;
+        resize(*victim, 0);
+        lock.unlock();
+        Out::output("Dropping table " + victim->file + " ("
+                    + std::to_string(table->memoryFootprint() >> 10) + " KB).\n", 2);
+        bool saved = table->modified();
+        table->autosave();
+        delete table;
+        lock.lock();
+        if (saved)
+            victim->onDisk = true;
+        victim->state = UNLOADED;
+        evictions_++;
+        ready_.notify_all();
+    }
+}
+
+HashTable *TableCache::open(const Slot &slot)
+{
+    HashTable *table = nullptr;
+    if (slot.onDisk) {
+        Out::output("Loading table \"" + slot.file + "\" with signature \""
+                    + slot.sign + "\".\n", 2);
+        table = HashTable::load(slot.file);
+    } else {
+        table = new HashTable(slot.file);
+    }
+    table->enableBloom();
+    return table;
+}
+
+string TableCache::to_string(const string &title)
+{
+    unique_lock<mutex> lock(lock_);
+    string retVal;
+    size_t loaded = 0, used = 0;
+    for (auto &entry : slots_) {
+        const Slot &slot = entry.second;
+        if (slot.state != LOADED)
+            continue;
+        HashTable *table = slot.table;
+        loaded++;
+        used += table->memoryFootprint();
+        const BloomFilter *bloom = table->bloom();
+        retVal += slot.sign + " : " + std::to_string(table->size())
+                  + " positions";
+        if (bloom)
+            retVal += ", filter (rejected/passed/false positive) "
+                      + std::to_string(bloom->rejected_.load()) + "/"
+                      + std::to_string(bloom->passed_.load()) + "/"
+                      + std::to_string(bloom->falsePositives_.load()) + " ("
+                      + std::to_string(bloom->bytes() >> 10) + " KB, "
+                      + std::to_string(bloom->probes()) + " probes)";
+        if (table->storedEntries())
+            retVal += ", " + std::to_string(table->blockDecodes())
+                      + " block decodes for "
+                      + std::to_string(table->storedEntries())
+                      + " stored positions";
+        retVal += "\n";
+    }
+    return title + " : " + std::to_string(loaded) + "/"
+           + std::to_string(slots_.size()) + " loaded ("
+           + std::to_string(used >> 10) + " KB), "
+           + std::to_string(loads_) + " loads, "
+           + std::to_string(creations_) + " created, "
+           + std::to_string(evictions_) + " dropped, "
+           + std::to_string(hits_) + " hits\n" + retVal;
+}
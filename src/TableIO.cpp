@@ -0,0 +1,797 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "TableIO.h"
+#include "Hashing.h"
+#include "Output.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace Table {
+
+    /*Flag byte, count and first key*/
+    static const size_t BLOCK_HEADER_SIZE = 11;
+    static const uint8_t BLOCK_PACKED = 1;
+    /*Deltas with a quotient this big are stored as is*/
+    static const unsigned int RICE_ESCAPE = 32;
+    static const size_t MAX_PALETTE = 255;
+
+    /*LSB first bit stream, appended to a byte vector*/
+    class BitWriter {
+        public:
+            BitWriter(vector<char> &out) : out_(out) {}
+            /*Append the "bits" low bits of v, bits <= 32*/
+            void put(uint64_t v, unsigned int bits)
+            {
+                acc_ |= (v & ((U64(1) << bits) - 1)) << used_;
+                used_ += bits;
+                while (used_ >= 8) {
+                    out_.push_back((char)(acc_ & 0xFF));
+                    acc_ >>= 8;
+                    used_ -= 8;
+                }
+            }
+            void flush()
+            {
+                if (used_)
+                    out_.push_back((char)(acc_ & 0xFF));
+                acc_ = 0;
+                used_ = 0;
+            }
+        private:
+            vector<char> &out_;
+            uint64_t acc_ = 0;
+            unsigned int used_ = 0;
+    };
+
+    class BitReader {
+        public:
+            /*Start reading at bit "offset" of buf*/
+            BitReader(const char *buf, const char *end, size_t offset = 0) :
+                cur_((const unsigned char *)buf + offset / 8),
+                end_((const unsigned char *)end)
+            {
+                if (cur_ > end_)
+                    Err::handle("Corrupted table block");
+                get(offset % 8);
+            }
+            /*Read "bits" bits, bits <= MAX_GET*/
+            uint64_t get(unsigned int bits)
+            {
+                if (used_ < bits) {
+                    refill();
+                    if (used_ < bits)
+                        Err::handle("Corrupted table block");
+                }
+                uint64_t v = acc_ & ((U64(1) << bits) - 1);
+                acc_ >>= bits;
+                used_ -= bits;
+                return v;
+            }
+            /*Count the 1 bits up to the next 0 (consumed), at most max*/
+            unsigned int unary(unsigned int max)
+            {
+                if (used_ <= max)
+                    refill();
+                unsigned int ones = (~acc_) ? __builtin_ctzll(~acc_) : 64;
+                if (ones >= max) {
+                    ones = max;
+                } else if (ones >= used_) {
+                    Err::handle("Corrupted table block");
+                } else {
+                    acc_ >>= 1;
+                    used_--;
+                }
+                acc_ >>= ones;
+                used_ -= ones;
+                return ones;
+            }
+            /*A refill leaves at least that many bits, unless at the end*/
+            static const unsigned int MAX_GET = 57;
+        private:
+            void refill()
+            {
+                while (used_ < MAX_GET && cur_ != end_) {
+                    acc_ |= (uint64_t)*cur_++ << used_;
+                    used_ += 8;
+                }
+            }
+
+            const unsigned char *cur_;
+            const unsigned char *end_;
+            uint64_t acc_ = 0;
+            unsigned int used_ = 0;
+    };
+
+    /*Same rule as HashTable::toPolyglot*/
+    static uint16_t weightFromStatus(uint32_t learn)
+    {
+        return (learn == Node::STALEMATE || learn == Node::DRAW) ? 1 : 0;
+    }
+
+    static unsigned int bitsFor(uint64_t maxValue)
+    {
+        unsigned int bits = 0;
+        while (bits < 64 && (maxValue >> bits))
+            bits++;
+        return bits;
+    }
+
+    static void putRice(BitWriter &bw, uint64_t v, unsigned int k)
+    {
+        uint64_t q = v >> k;
+        if (q >= RICE_ESCAPE) {
+            bw.put(0xFFFFFFFF, RICE_ESCAPE);
+            bw.put(v, 32);
+            bw.put(v >> 32, 32);
+            return;
+        }
+        bw.put((U64(1) << q) - 1, q + 1);
+        bw.put(v, min(k, 32u));
+        if (k > 32)
+            bw.put(v >> 32, k - 32);
+    }
+
+    static uint64_t getRice(BitReader &br, unsigned int k)
+    {
+        uint64_t q = br.unary(RICE_ESCAPE);
+        if (q == RICE_ESCAPE) {
+            uint64_t v = br.get(32);
+            return v | (br.get(32) << 32);
+        }
+        if (k <= BitReader::MAX_GET)
+            return (q << k) | br.get(k);
+        uint64_t v = br.get(32);
+        return (q << k) | v | (br.get(k - 32) << 32);
+    }
+
+    static bool packBlock(const Entry *entries, size_t count,
+                          vector<char> &out)
+    {
+        vector<uint32_t> palette;
+        for (size_t i = 0; i < count; i++) {
+            const Entry &e = entries[i];
+            if (e.move >= 0x8000 || e.weight != weightFromStatus(e.learn))
+                return false;
+            if (find(palette.begin(), palette.end(), e.learn) == palette.end())
+                palette.push_back(e.learn);
+            if (palette.size() > MAX_PALETTE)
+                return false;
+        }
+        /*Rice parameter : roughly the log of the average delta*/
+        uint64_t span = entries[count - 1].key - entries[0].key;
+        unsigned int k = (count > 1) ? bitsFor(span / (count - 1)) : 0;
+        k = (k > 0) ? k - 1 : 0;
+        out.push_back((char)k);
+        out.push_back((char)palette.size());
+        for (uint32_t learn : palette)
+            out.insert(out.end(), (const char *)&learn,
+                       (const char *)&learn + sizeof(uint32_t));
+        unsigned int statusBits = bitsFor(palette.size() - 1);
+        /*
+         * Fixed size columns first, so that a lookup can reach the status
+         * and the move of an entry without decoding the others.
+         */
+        BitWriter bw(out);
+        for (size_t i = 0; i < count; i++)
+            bw.put(entries[i].move != 0, 1);
+        for (size_t i = 0; i < count; i++)
+            bw.put(find(palette.begin(), palette.end(), entries[i].learn)
+                   - palette.begin(), statusBits);
+        for (size_t i = 0; i < count; i++)
+            if (entries[i].move)
+                bw.put(entries[i].move, 15);
+        for (size_t i = 1; i < count; i++)
+            putRice(bw, entries[i].key - entries[i - 1].key - 1, k);
+        bw.flush();
+        return true;
+    }
+
+    void encodeBlock(const Entry *entries, size_t count, vector<char> &out)
+    {
+        if (count == 0 || count > BLOCK_ENTRIES)
+            Err::handle("Invalid number of entries for a table block");
+        out.resize(BLOCK_HEADER_SIZE);
+        uint16_t count16 = (uint16_t)count;
+        memcpy(out.data() + 1, &count16, sizeof(uint16_t));
+        memcpy(out.data() + 3, &entries[0].key, sizeof(uint64_t));
+        size_t rawSize = BLOCK_HEADER_SIZE + count * ENTRY_SIZE;
+        if (packBlock(entries, count, out) && out.size() < rawSize) {
+            out[0] = BLOCK_PACKED;
+            return;
+        }
+        out.resize(rawSize);
+        out[0] = 0;
+        for (size_t i = 0; i < count; i++)
+            encode(entries[i], out.data() + BLOCK_HEADER_SIZE
+                               + i * ENTRY_SIZE);
+    }
+
+    /*What is needed to go through a packed block*/
+    struct PackedBlock {
+        const char *bits = nullptr;
+        const char *end = nullptr;
+        size_t count = 0;
+        uint64_t firstKey = 0;
+        unsigned int k = 0;
+        unsigned int statusBits = 0;
+        uint32_t palette[MAX_PALETTE];
+        size_t paletteSize = 0;
+        /*Bit offsets of the columns*/
+        size_t statusOffset = 0;
+        size_t moveOffset = 0;
+        size_t keyOffset = 0;
+    };
+
+    /*Number of 1 among the "count" bits starting at offset*/
+    static size_t countOnes(const char *buf, const char *end, size_t offset,
+                            size_t count)
+    {
+        BitReader br(buf, end, offset);
+        size_t ones = 0;
+        for (; count >= 32; count -= 32)
+            ones += __builtin_popcountll(br.get(32));
+        return ones + __builtin_popcountll(br.get(count));
+    }
+
+    static size_t blockCount(const char *buf, const char *end)
+    {
+        if (end - buf < (ptrdiff_t)BLOCK_HEADER_SIZE)
+            Err::handle("Corrupted table block");
+        uint16_t count;
+        memcpy(&count, buf + 1, sizeof(uint16_t));
+        return count;
+    }
+
+    static void parsePacked(const char *buf, const char *end, PackedBlock &pb)
+    {
+        pb.count = blockCount(buf, end);
+        memcpy(&pb.firstKey, buf + 3, sizeof(uint64_t));
+        const char *cur = buf + BLOCK_HEADER_SIZE;
+        if (end - cur < 2)
+            Err::handle("Corrupted table block");
+        pb.k = (uint8_t)cur[0];
+        pb.paletteSize = (uint8_t)cur[1];
+        cur += 2;
+        if (pb.count == 0 || pb.k >= 64 || pb.paletteSize == 0
+            || (size_t)(end - cur) < pb.paletteSize * sizeof(uint32_t))
+            Err::handle("Corrupted table block");
+        memcpy(pb.palette, cur, pb.paletteSize * sizeof(uint32_t));
+        cur += pb.paletteSize * sizeof(uint32_t);
+        pb.bits = cur;
+        pb.end = end;
+        pb.statusBits = bitsFor(pb.paletteSize - 1);
+        pb.statusOffset = pb.count;
+        pb.moveOffset = pb.statusOffset + pb.count * pb.statusBits;
+        pb.keyOffset = pb.moveOffset
+                       + 15 * countOnes(pb.bits, end, 0, pb.count);
+    }
+
+    static uint32_t packedStatus(BitReader &br, const PackedBlock &pb)
+    {
+        size_t status = br.get(pb.statusBits);
+        if (status >= pb.paletteSize)
+            Err::handle("Corrupted table block");
+        return pb.palette[status];
+    }
+
+    void decodeBlock(const char *buf, const char *end, vector<Entry> &out)
+    {
+        out.resize(blockCount(buf, end));
+        if (out.empty())
+            return;
+        if (!isPackedBlock(buf)) {
+            const char *cur = buf + BLOCK_HEADER_SIZE;
+            if ((size_t)(end - cur) != out.size() * ENTRY_SIZE)
+                Err::handle("Corrupted table block");
+            for (size_t i = 0; i < out.size(); i++)
+                decode(cur + i * ENTRY_SIZE, out[i]);
+            return;
+        }
+        PackedBlock pb;
+        parsePacked(buf, end, pb);
+        BitReader flags(pb.bits, end);
+        BitReader statuses(pb.bits, end, pb.statusOffset);
+        BitReader moves(pb.bits, end, pb.moveOffset);
+        BitReader keys(pb.bits, end, pb.keyOffset);
+        for (size_t i = 0; i < pb.count; i++) {
+            Entry &e = out[i];
+            e.key = (i) ? out[i - 1].key + getRice(keys, pb.k) + 1
+                        : pb.firstKey;
+            e.learn = packedStatus(statuses, pb);
+            e.weight = weightFromStatus(e.learn);
+            e.move = (flags.get(1)) ? (uint16_t)moves.get(15) : 0;
+        }
+    }
+
+    /*Lookup in a block, only the keys up to the searched one are decoded*/
+    static bool findInBlock(const char *buf, const char *end, uint64_t key,
+                            Entry &e)
+    {
+        if (!isPackedBlock(buf)) {
+            size_t count = blockCount(buf, end);
+            const char *cur = buf + BLOCK_HEADER_SIZE;
+            if ((size_t)(end - cur) != count * ENTRY_SIZE)
+                Err::handle("Corrupted table block");
+            size_t lo = 0, hi = count;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                uint64_t midKey;
+                memcpy(&midKey, cur + mid * ENTRY_SIZE, sizeof(uint64_t));
+                if (midKey < key)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo == count)
+                return false;
+            decode(cur + lo * ENTRY_SIZE, e);
+            return e.key == key;
+        }
+        PackedBlock pb;
+        parsePacked(buf, end, pb);
+        BitReader keys(pb.bits, end, pb.keyOffset);
+        uint64_t cur = pb.firstKey;
+        size_t i = 0;
+        while (cur < key && ++i < pb.count)
+            cur += getRice(keys, pb.k) + 1;
+        if (cur != key)
+            return false;
+        BitReader statuses(pb.bits, end, pb.statusOffset + i * pb.statusBits);
+        e.key = key;
+        e.learn = packedStatus(statuses, pb);
+        e.weight = weightFromStatus(e.learn);
+        e.move = 0;
+        if (BitReader(pb.bits, end, i).get(1)) {
+            size_t before = countOnes(pb.bits, end, 0, i);
+            e.move = BitReader(pb.bits, end, pb.moveOffset + 15 * before)
+                     .get(15);
+        }
+        return true;
+    }
+
+    bool isPackedBlock(const char *buf)
+    {
+        return buf[0] & BLOCK_PACKED;
+    }
+
+    Format formatFromFilename(const string &file)
+    {
+        return (Utils::endsWith(file, BLOCK_EXTENSION)) ? BLOCK : POLYGLOT;
+    }
+
+    string bloomFile(const string &table)
+    {
+        return table + ".bloom";
+    }
+
+    void decode(const char *buf, Entry &e)
+    {
+        memcpy(&e.key, buf, sizeof(uint64_t));
+        memcpy(&e.move, buf + 8, sizeof(uint16_t));
+        memcpy(&e.weight, buf + 10, sizeof(uint16_t));
+        memcpy(&e.learn, buf + 12, sizeof(uint32_t));
+    }
+
+    void encode(const Entry &e, char *buf)
+    {
+        memcpy(buf, &e.key, sizeof(uint64_t));
+        memcpy(buf + 8, &e.move, sizeof(uint16_t));
+        memcpy(buf + 10, &e.weight, sizeof(uint16_t));
+        memcpy(buf + 12, &e.learn, sizeof(uint32_t));
+    }
+
+    void writeHeader(ostream &os, uint16_t cutoff, Format format)
+    {
+        Out::output("Writting header\n", 3);
+        /*Here we book a spot of 1 entry size to store some meta information*/
+        Entry header;
+        header.move = cutoff;
+        if (format == BLOCK) {
+            header.key = BLOCK_MAGIC;
+            header.weight = BLOCK_VERSION;
+            header.learn = BLOCK_ENTRIES;
+        }
+        char buf[ENTRY_SIZE];
+        encode(header, buf);
+        os.write(buf, ENTRY_SIZE);
+    }
+
+    static uint16_t checkHeader(const Entry &header, uint16_t minCutoff,
+                                const string &file, Format *format)
+    {
+        Format found = POLYGLOT;
+        if (header.key == BLOCK_MAGIC && header.weight == BLOCK_VERSION)
+            found = BLOCK;
+        else if (header.key != 0)
+            Err::handle("Your input table (" + file + ") is not compatible"
+                        " with this version of the program !");
+        if (format)
+            *format = found;
+        else if (found != POLYGLOT)
+            Err::handle("Table " + file + " is not a polyglot table");
+        if (header.move == 0)
+            Err::handle("Invalid cutoff in " + file);
+        if (header.move < minCutoff)
+            Err::handle("Input table " + file + " has a threshold cutoff value"
+                        " lower than the one used for this session, therefore"
+                        " it's not usable.");
+        return header.move;
+    }
+
+    uint16_t readHeader(istream &is, uint16_t minCutoff, const string &file,
+                        Format *format)
+    {
+        Out::output("Reading header\n", 3);
+        if (!is.good())
+            Err::handle("Unable to read header from input file " + file);
+        char buf[ENTRY_SIZE];
+        Entry header;
+        is.read(buf, ENTRY_SIZE);
+        if (!is.good())
+            Err::handle("Unable to fully read header from input file " + file);
+        decode(buf, header);
+        return checkHeader(header, minCutoff, file, format);
+    }
+
+    int statusPriority(uint32_t learn)
+    {
+        if (learn & Node::MATE)
+            return 4;
+        if (learn & Node::THRESHOLD)
+            return 3;
+        if (learn & Node::PENDING)
+            return 1;
+        if (learn & (Node::DRAW | Node::STALEMATE | Node::AGAINST))
+            return 2;
+        return 0;
+    }
+
+    BlockTable::BlockTable(const string &file, uint16_t minCutoff) :
+        blockDecodes_(0), file_(file)
+    {
+        fd_ = open(file.c_str(), O_RDONLY);
+        if (fd_ < 0)
+            Err::handle("Unable to load table from file " + file);
+        struct stat st;
+        if (fstat(fd_, &st))
+            Err::handle("Unable to stat " + file);
+        size_ = st.st_size;
+        if (size_ < 2 * ENTRY_SIZE)
+            Err::handle("Table " + file + " is truncated");
+        void *map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (map == MAP_FAILED)
+            Err::handle("Unable to map " + file);
+        data_ = static_cast<const char *>(map);
+
+        Entry header;
+        decode(data_, header);
+        Format format;
+        cutoff_ = checkHeader(header, minCutoff, file, &format);
+        if (format != BLOCK)
+            Err::handle("Table " + file + " is not a block table");
+        const char *trailer = data_ + size_ - ENTRY_SIZE;
+        memcpy(&indexOffset_, trailer, sizeof(uint64_t));
+        memcpy(&entries_, trailer + 8, sizeof(uint64_t));
+        if (indexOffset_ < ENTRY_SIZE || indexOffset_ > size_ - ENTRY_SIZE
+            || (size_ - ENTRY_SIZE - indexOffset_) % ENTRY_SIZE)
+            Err::handle("Corrupted block index in " + file);
+        size_t blocks = (size_ - ENTRY_SIZE - indexOffset_) / ENTRY_SIZE;
+        firstKeys_.resize(blocks);
+        offsets_.resize(blocks);
+        for (size_t b = 0; b < blocks; b++) {
+            const char *idx = data_ + indexOffset_ + b * ENTRY_SIZE;
+            memcpy(&firstKeys_[b], idx, sizeof(uint64_t));
+            memcpy(&offsets_[b], idx + 8, sizeof(uint64_t));
+            if (offsets_[b] < ENTRY_SIZE || offsets_[b] >= indexOffset_
+                || (b > 0 && (offsets_[b] <= offsets_[b - 1]
+                              || firstKeys_[b] <= firstKeys_[b - 1])))
+                Err::handle("Corrupted block index in " + file);
+        }
+    }
+
+    BlockTable::~BlockTable()
+    {
+        if (data_)
+            munmap(const_cast<char *>(data_), size_);
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    bool BlockTable::find(uint64_t key, Entry &e) const
+    {
+        if (firstKeys_.empty() || key < firstKeys_[0])
+            return false;
+        size_t b = upper_bound(firstKeys_.begin(), firstKeys_.end(), key)
+                   - firstKeys_.begin() - 1;
+        blockDecodes_.fetch_add(1, memory_order_relaxed);
+        return findInBlock(blockData(b), blockData(b) + blockSize(b), key, e);
+    }
+
+    size_t BlockTable::blockCount() const
+    {
+        return offsets_.size();
+    }
+
+    void BlockTable::readBlock(size_t b, vector<Entry> &out) const
+    {
+        blockDecodes_.fetch_add(1, memory_order_relaxed);
+        decodeBlock(blockData(b), blockData(b) + blockSize(b), out);
+    }
+
+    size_t BlockTable::blockSize(size_t b) const
+    {
+        uint64_t end = (b + 1 < offsets_.size()) ? offsets_[b + 1]
+                                                 : indexOffset_;
+        return end - offsets_[b];
+    }
+
+    const char *BlockTable::blockData(size_t b) const
+    {
+        return data_ + offsets_[b];
+    }
+
+    uint64_t BlockTable::entries() const
+    {
+        return entries_;
+    }
+
+    uint16_t BlockTable::cutoff() const
+    {
+        return cutoff_;
+    }
+
+    void BlockTable::adviseSequential() const
+    {
+        madvise(const_cast<char *>(data_), size_, MADV_SEQUENTIAL);
+    }
+
+    Reader::Reader(const string &file, uint16_t minCutoff) : file_(file),
+        is_(file, ios::binary)
+    {
+        if (!is_.good())
+            Err::handle("Unable to load table from file " + file);
+        Format format;
+        cutoff_ = readHeader(is_, minCutoff, file, &format);
+        if (format == BLOCK) {
+            is_.close();
+            blocks_ = new BlockTable(file, minCutoff);
+            blocks_->adviseSequential();
+        } else {
+            buffer_.resize(BUFFER_ENTRIES * ENTRY_SIZE);
+        }
+    }
+
+    Reader::~Reader()
+    {
+        delete blocks_;
+    }
+
+    bool Reader::fill()
+    {
+        if (blocks_) {
+            if (nextBlock_ == blocks_->blockCount())
+                return false;
+            blocks_->readBlock(nextBlock_++, blockEntries_);
+            bufEntries_ = blockEntries_.size();
+            bufPos_ = 0;
+            return bufEntries_ > 0;
+        }
+        is_.read(buffer_.data(), buffer_.size());
+        size_t got = is_.gcount();
+        if (got % ENTRY_SIZE)
+            Err::handle("Truncated entry at the end of " + file_);
+        bufEntries_ = got / ENTRY_SIZE;
+        bufPos_ = 0;
+        return bufEntries_ > 0;
+    }
+
+    bool Reader::next(Entry &e)
+    {
+        if (bufPos_ == bufEntries_ && !fill())
+            return false;
+        if (blocks_)
+            e = blockEntries_[bufPos_++];
+        else
+            decode(buffer_.data() + bufPos_++ * ENTRY_SIZE, e);
+        if (read_++ > 0 && e.key <= lastKey_)
+            Err::handle("Table " + file_ + " is not sorted (entry #"
+                        + to_string(read_) + ")");
+        lastKey_ = e.key;
+        return true;
+    }
+
+    uint16_t Reader::cutoff() const
+    {
+        return cutoff_;
+    }
+
+    const string &Reader::file() const
+    {
+        return file_;
+    }
+
+    uint64_t Reader::entriesRead() const
+    {
+        return read_;
+    }
+
+    Writer::Writer(const string &file, uint16_t cutoff, Format format) :
+        file_(file), cutoff_(cutoff), format_(format), os_(file, ios::binary)
+    {
+        if (!os_.good())
+            Err::handle("Unable to save table to file " + file);
+        writeHeader(os_, cutoff, format);
+        offset_ = ENTRY_SIZE;
+        if (format == BLOCK)
+            block_.reserve(BLOCK_ENTRIES);
+        else
+            buffer_.resize(BUFFER_ENTRIES * ENTRY_SIZE);
+    }
+
+    Writer::~Writer()
+    {
+        close();
+    }
+
+    void Writer::write(const Entry &e)
+    {
+        if (written_ > 0 && e.key <= lastKey_)
+            Err::handle("Entries written out of order in " + file_);
+        lastKey_ = e.key;
+        written_++;
+        if (format_ == BLOCK) {
+            block_.push_back(e);
+            if (block_.size() == BLOCK_ENTRIES)
+                flushBlock();
+            return;
+        }
+        encode(e, buffer_.data() + bufEntries_++ * ENTRY_SIZE);
+        if (bufEntries_ == BUFFER_ENTRIES)
+            flush();
+    }
+
+    void Writer::flushBlock()
+    {
+        if (block_.empty())
+            return;
+        encodeBlock(block_.data(), block_.size(), encoded_);
+        firstKeys_.push_back(block_[0].key);
+        offsets_.push_back(offset_);
+        os_.write(encoded_.data(), encoded_.size());
+        offset_ += encoded_.size();
+        block_.clear();
+        if (!os_.good())
+            Err::handle("Error while writing table " + file_);
+    }
+
+    void Writer::flush()
+    {
+        os_.write(buffer_.data(), bufEntries_ * ENTRY_SIZE);
+        bufEntries_ = 0;
+        if (!os_.good())
+            Err::handle("Error while writing table " + file_);
+    }
+
+    void Writer::close()
+    {
+        if (!os_.is_open())
+            return;
+        if (format_ == BLOCK) {
+            flushBlock();
+            /*Block index, then the trailer pointing to it*/
+            for (size_t b = 0; b < offsets_.size(); b++) {
+                os_.write((const char *)&firstKeys_[b], sizeof(uint64_t));
+                os_.write((const char *)&offsets_[b], sizeof(uint64_t));
+            }
+            os_.write((const char *)&offset_, sizeof(uint64_t));
+            os_.write((const char *)&written_, sizeof(uint64_t));
+        }
+        flush();
+        os_.close();
+        if (format_ == BLOCK)
+            saveBloom();
+    }
+
+    /*
+     * Built once from the blocks just written, which are still in the page
+     * cache, rather than at each load of the table.
+     */
+    void Writer::saveBloom()
+    {
+        string file = bloomFile(file_);
+        BloomFilter *bloom = HashTable::newBloom(written_);
+        if (!bloom || !written_) {
+            unlink(file.c_str());
+            delete bloom;
+            return;
+        }
+        BlockTable table(file_, cutoff_);
+        table.adviseSequential();
+        vector<Entry> block;
+        for (size_t b = 0; b < table.blockCount(); b++) {
+            table.readBlock(b, block);
+            for (const Entry &e : block)
+                bloom->add(e.key);
+        }
+        bloom->save(file, file_);
+        delete bloom;
+    }
+
+    uint64_t Writer::entriesWritten() const
+    {
+        return written_;
+    }
+
+    MergeStat merge(const vector<string> &inputs, const string &output,
+                    uint16_t cutoff)
+    {
+        MergeStat stat;
+        vector<Reader *> readers;
+        vector<Entry> heads(inputs.size());
+        /*Min-heap on (key, input index) : earlier inputs win the ties*/
+        typedef pair<uint64_t, size_t> HeapItem;
+        priority_queue<HeapItem, vector<HeapItem>, greater<HeapItem>> heap;
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            Out::output("Opening " + inputs[i] + "\n", 2);
+            readers.push_back(new Reader(inputs[i], cutoff));
+            if (readers[i]->next(heads[i]))
+                heap.push(make_pair(heads[i].key, i));
+        }
+
+        Writer writer(output, cutoff, formatFromFilename(output));
+        while (!heap.empty()) {
+            size_t i = heap.top().second;
+            heap.pop();
+            Entry best = heads[i];
+            if (readers[i]->next(heads[i]))
+                heap.push(make_pair(heads[i].key, i));
+            /*Consume all the entries with the same key*/
+            while (!heap.empty() && heap.top().first == best.key) {
+                size_t j = heap.top().second;
+                heap.pop();
+                stat.conflicts++;
+                if (heads[j].learn != best.learn)
+                    stat.statusConflicts++;
+                if (statusPriority(heads[j].learn) > statusPriority(best.learn))
+                    best = heads[j];
+                if (readers[j]->next(heads[j]))
+                    heap.push(make_pair(heads[j].key, j));
+            }
+            writer.write(best);
+            stat.entries++;
+        }
+        writer.close();
+
+        for (Reader *r : readers)
+            delete r;
+        return stat;
+    }
+}
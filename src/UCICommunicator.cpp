@@ -1,15 +1,23 @@
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <unistd.h>
 #include <signal.h>
+#include <cerrno>
 #include <chrono>
 #include <iostream>
-#include <sstream>
 #include <set>
 #include "UCICommunicator.h"
 #include "Output.h"
 #include "Utils.h"
 #include "Options.h"
+#include "Hashing.h"
+#include "LockStats.h"
 
 using namespace std;
 
@@ -32,15 +40,54 @@ namespace Comm {
     {
     }
 
-    void UCICommunicator::sendOption(const string &name, const string &value) const
+    void UCICommunicator::queue(const string &cmd)
     {
-        send("setoption name " + name + " value " + value);
+        Out::output("Sending \"" + cmd + "\" to engine !\n", 3);
+        if (cmd.compare(0, 9, "position ") == 0) {
+            position_ = cmd;
+            positionOffset_ = commands_.size();
+        }
+        commands_ += cmd;
+        commands_ += '\n';
     }
 
-    void UCICommunicator::sendOptions() const
+    bool UCICommunicator::flush()
+    {
+        if (commands_.empty())
+            return true;
+        bool sent;
+        {
+            std::unique_lock<std::mutex> lock(send_mutex_);
+            sent = send(commands_);
+        }
+        /*clear keeps the capacity for the next batch*/
+        commands_.clear();
+        positionOffset_ = string::npos;
+        return sent;
+    }
+
+    void UCICommunicator::stop()
+    {
+        std::unique_lock<std::mutex> lock(send_mutex_);
+        send("stop\n");
+    }
+
+    void UCICommunicator::sendOption(const string &name, const string &value)
+    {
+        /*The engine already has this value*/
+        auto current = optionsMap_.find(name);
+        if (current != optionsMap_.end() && current->second == value)
+            return;
+        /*Kept for restarts*/
+        optionsMap_[name] = value;
+        queue("setoption name " + name + " value " + value);
+    }
+
+    void UCICommunicator::sendOptions()
     {
         for (auto option : optionsMap_)
-            sendOption(option.first, option.second);
+            queue("setoption name " + option.first + " value "
+                  + option.second);
     }
 
 
@@ -49,156 +96,175 @@ namespace Comm {
         return linesVector_;
     }
 
-    void UCICommunicator::quit() const
+    void UCICommunicator::quit()
     {
-        send("quit");
+        queue("quit");
+        flush();
     }
 
-    int UCICommunicator::parseUCIMsg(const string &msg)
+    int UCICommunicator::parseUCIMsg(const StringView &msg)
     {
-        string token;
-        istringstream is(msg);
-        is >> skipws >> token;
+        size_t pos = 0;
+        StringView token = msg.token(pos);
         /*Some of the tokens are just drop, because we don't care about them*/
-        if (token == "id") ;
+        if (token == "id") {
+            if (msg.token(pos) == "name")
+                engineId_ = msg.substr(pos + 1).str();
+        }
         else if (token == "uciok") ;
         else if (token == "quit") return 1;
-        else if (token == "bestmove") bestmove(is);
-        else if (token == "readyok") readyok(is);
-        else if (token == "info") info(is);
-        else if (token == "option") Out::output(msg + "\n", 6);
+        else if (token == "bestmove") bestmove();
+        else if (token == "readyok") readyok();
+        else if (token == "info") {
+            unsigned int slot = infoParser_.add(msg, pos);
+            if (slot && earlyStop_.enabled()
+                && earlyStop_.update(slot, infoParser_))
+                stop();
+        }
+        else if (token == "option") Out::output(msg.str() + "\n", 6);
         else {
             Out::output("Warning : Unrecognise command from engine :", 3);
-            Out::output("\"" + msg + "\"", 3);
+            Out::output("\"" + msg.str() + "\"", 3);
         }
         return 0;
     }
 
-    void UCICommunicator::bestmove(istringstream &is)
-    {
-        string bm;
-        //consume bestmove
-        is >> bm;
-        signalBestmove();
-    }
-
-    void UCICommunicator::readyok(istringstream &)
-    {
-        signalReadyok();
-    }
-
-    void UCICommunicator::info(istringstream &is)
-    {
-        string token;
-        bool readLine = false;
-        bool eval = false;
-        int curDepth = 0;
-        int curNps = 0;
-        int curThinktime = 0;
-        float curEval = 0;
-        bool curIsMat = false;
-        string curMv;
-        list<string> curMoves;
-        unsigned int curLineId = 0;
-        while (is >> token) {
-            if (token == "depth") {
-                is >> curDepth;
-            } else if (token == "seldepth") {
-                //Drop
-            } else if (token == "time") {
-                is >> curThinktime;
-                Out::output("Updated current thinktime to "
-                            + to_string(curThinktime) + "\n", 4);
-            } else if (token == "nodes") {
-                //Drop
-            } else if (token == "pv") {
-                readLine = true;
-                //NOTE: should be the last token of infoline
-                while (is >> token)
-                    curMoves.push_back(token);
-            } else if (token == "multipv") {
-                is >> curLineId;
-            } else if (token == "score") {
-                eval = true;
-                is >> token;
-                if (token == "mate") {
-                    curIsMat = true;
-                    is >> curEval;
-                } else if (token == "cp") {
-                    is >> curEval;
-                } else {
-                    Err::output("********* No score ***********");
-                }
-            } else if (token == "currmove") {
-                //Drop
-            } else if (token == "currmovenumber") {
-                //Drop
-            } else if (token == "hashfull") {
-                //NOTE: not supported by stockfish
-                is >> token;
-                Err::output("********** Hashfull : " + token + " *******");
-            } else if (token == "nps") {
-                is >> curNps;
-                Out::output("Updated NPS to " + to_string(curNps) + "\n", 4);
-            } else if (token == "tbhits") {
-                //Drop
-            } else if (token == "cpuload") {
-                //Drop
-            } else if (token == "string") {
-                //Drop
-            } else if (token == "refutation") {
-                //Drop
-            } else if (token == "currline") {
-                //Drop
-            }
+    future<vector<Line>> UCICommunicator::startSearch(const string &go,
+            bool snapshot, EarlyStop::Mode mode)
+    {
+        clearLines();
+        future<vector<Line>> result;
+        bool cached = fromCache(go);
+        {
+            std::unique_lock<std::mutex> lock(bestmove_mutex_);
+            searching_ = !cached;
+            failed_ = false;
+            snapshot_ = snapshot;
+            result_ = promise<vector<Line>>();
+            result = result_.get_future();
+            if (cached)
+                result_.set_value((snapshot) ? linesVector_ : vector<Line>());
         }
-        if (readLine) {
-            if (!eval || curMoves.empty() || !curLineId) {
-                Err::output("**** Line without eval or move... ****");
-                return;
-            }
-            Line curLine(curEval, curDepth, curMoves, curIsMat);
-            //Update the line
-            if (curLineId > linesVector_.size())
-                Err::handle("Line index out of bound, please adjust MaxMoves"
-                            "above " + to_string(curLineId));
-            linesVector_[curLineId - 1] = curLine;
+        if (cached)
+            return result;
+        earlyStop_.reset(mode);
+        queue(go);
+        if (!flush()) {
+            /*No bestmove will ever come, the search failed*/
+            std::unique_lock<std::mutex> lock(bestmove_mutex_);
+            searching_ = false;
+            failed_ = true;
+            /*Breaks the future*/
+            result_ = promise<vector<Line>>();
         }
+        return result;
+    }
+
+    bool UCICommunicator::fromCache(const string &go)
+    {
+        /*Only searches of a plain fen, sent along with go, are cached*/
+        const string prefix = "position fen ";
+        cacheable_ = cache_ && positionOffset_ != string::npos
+                     && position_.compare(0, prefix.size(), prefix) == 0
+                     && position_.find(" moves") == string::npos;
+        if (!cacheable_)
+            return false;
+        cachePosition_ = HashTable::hashFEN(position_.substr(prefix.size()));
+        /*Not inserted in the options, it would be sent on restart*/
+        auto multiPV = optionsMap_.find("MultiPV");
+        cacheSettings_ = ResultCache::settingsKey(engineId_, go,
+                (multiPV != optionsMap_.end()) ? multiPV->second : "1");
+        if (!cache_->find(cachePosition_, cacheSettings_, linesVector_))
+            return false;
+        Out::output("Result from cache for \"" + position_ + "\"\n", 3);
+        /*This position won't be searched*/
+        commands_.erase(positionOffset_, position_.size() + 1);
+        positionOffset_ = string::npos;
+        cacheable_ = false;
+        return true;
     }
 
-    bool UCICommunicator::waitBestmove()
+    bool UCICommunicator::ready()
     {
+        {
+            std::unique_lock<std::mutex> lock(readyok_mutex_);
+            pendingReadyok_++;
+        }
+        queue("isready");
+        if (!flush()) {
+            std::unique_lock<std::mutex> lock(readyok_mutex_);
+            pendingReadyok_--;
+            return false;
+        }
+        return waitReadyok();
+    }
+
+    void UCICommunicator::bestmove()
+    {
+        infoParser_.flush();
+        infoParser_.toLines(linesVector_);
         std::unique_lock<std::mutex> lock(bestmove_mutex_);
-        bestmove_cond_.wait(lock);
-        return true;
+        if (!searching_) {
+            Out::output("Warning : bestmove without search\n", 3);
+            return;
+        }
+        searching_ = false;
+        /*The cache only holds complete searches*/
+        if (cacheable_ && !earlyStop_.stopped())
+            cache_->add(cachePosition_, cacheSettings_, linesVector_);
+        Out::output("Signaling bestmove_cond\n", 5);
+        result_.set_value((snapshot_) ? linesVector_ : vector<Line>());
+        bestmove_cond_.notify_all();
     }
 
-    bool UCICommunicator::waitReadyok()
+    void UCICommunicator::readyok()
     {
         std::unique_lock<std::mutex> lock(readyok_mutex_);
-        if (readyok_cond_.wait_for(lock, chrono::seconds(5))
-                == cv_status::timeout)
-            Err::handle("Engine not ready in 5 sec.");
-        return true;
+        if (pendingReadyok_)
+            pendingReadyok_--;
+        Out::output("Signaling readyok_cond\n", 5);
+        readyok_cond_.notify_all();
     }
 
-    void UCICommunicator::signalBestmove()
+    bool UCICommunicator::waitBestmove(chrono::milliseconds timeout)
     {
+        /*How often the engine is checked while waiting*/
+        const chrono::milliseconds period(500);
+        chrono::steady_clock::time_point deadline =
+            chrono::steady_clock::now() + timeout;
         std::unique_lock<std::mutex> lock(bestmove_mutex_);
-        Out::output("Signaling bestmove_cond\n", 5);
-        bestmove_cond_.notify_one();
+        while (!bestmove_cond_.wait_for(lock, period,
+                                        [this]() { return !searching_; })) {
+            if (!ok()) {
+                Err::output("Engine died during a search");
+                return false;
+            }
+            if (timeout.count() && chrono::steady_clock::now() > deadline) {
+                Err::output("Engine did not answer in "
+                            + to_string(timeout.count()) + " ms");
+                return false;
+            }
+        }
+        return !failed_;
     }
 
-    void UCICommunicator::signalReadyok()
+    bool UCICommunicator::waitReadyok()
     {
         std::unique_lock<std::mutex> lock(readyok_mutex_);
-        Out::output("Signaling bestmove_cond\n", 5);
-        readyok_cond_.notify_one();
+        if (!readyok_cond_.wait_for(lock, chrono::seconds(5),
+                                    [this]() { return !pendingReadyok_; })) {
+            Err::output("Engine not ready in 5 sec.");
+            return false;
+        }
+        return true;
     }
 
     void UCICommunicator::clearLines()
     {
-        linesVector_.assign(Options::getInstance().getMaxMoves(), Line());
+        Options &opt = Options::getInstance();
+        size_t slots = opt.getMaxMoves();
+        infoParser_.clear(slots, opt.getDeferredInfoParsing());
+        linesVector_.assign(slots, Line());
     }
 
     LocalUCICommunicator::LocalUCICommunicator(const string engineFullpath,
@@ -209,76 +275,92 @@ namespace Comm {
         int pipe_status;
 
         // Create the pipes
-        // We do this before the fork so both processes will know about
-        // the same pipe and they can communicate.
+        // They are closed on exec : the engine only gets its own ends,
+        // mapped to its standard streams, and no other engine inherits them.
 
-        pipe_status = pipe(in_fds_);
+        pipe_status = Utils::pipeCloexec(in_fds_);
         Err::handle("pipe() : Error creating the pipe", pipe_status);
 
 
-        pipe_status = pipe(out_fds_);
+        pipe_status = Utils::pipeCloexec(out_fds_);
         Err::handle("pipe() : Error creating the pipe", pipe_status);
 
-        pipe_status = pipe(err_fds_);
+        pipe_status = Utils::pipeCloexec(err_fds_);
         Err::handle("pipe() : Error creating the pipe", pipe_status);
-
-        engine_input_ = new OutputStream(getEngineInWrite());
-        engine_output_ = new InputStream(getEngineOutRead());
-        receiver_input_ = new OutputStream(getEngineOutWrite());
     }
 
     LocalUCICommunicator::~LocalUCICommunicator()
     {
+        /*No handler may run on this communicator after this*/
+        if (io_) {
+            io_->remove(outSource_);
+            io_->remove(errSource_);
+        }
         if (ok())
             kill(childPid_, SIGUSR1);
         else
             Err::output("engine was not running");
-        close(getEngineInRead());
-        close(getEngineOutWrite());
-        close(getEngineErrWrite());
-        close(getEngineInWrite());
-        close(getEngineOutRead());
-        close(getEngineErrRead());
-        delete engine_input_;
-        delete engine_output_;
-        delete receiver_input_;
-    }
-
-    void LocalUCICommunicator::run()
-    {
-        pid_t pid = fork();
-        if (pid == 0) {
-            dup2(getEngineInRead(), 0);
-            dup2(getEngineOutWrite(), 1);
-            dup2(getEngineErrWrite(), 2);
-            execl(engineFullpath_.c_str(), engineName_.c_str(), (char *)'\0');
-
-            // We should never reach this point
-            // Tell the parent the exec failed
-            kill(getppid(), SIGUSR1);
-            Err::handle("Engine execution failed");
-
-        } else if (pid > 0) {
+        for (int fd : {getEngineInRead(), getEngineOutWrite(),
+                       getEngineErrWrite(), getEngineOutRead(),
+                       getEngineErrRead(), getEngineInWrite()})
+            if (fd >= 0)
+                close(fd);
+    }
+
+    void LocalUCICommunicator::run(EventLoop &io)
+    {
+        pid_t pid;
+        int rc = Utils::spawnProcess(engineFullpath_, engineName_,
+                                     getEngineInRead(), getEngineOutWrite(),
+                                     getEngineErrWrite(), pid);
+        if (rc == 0) {
             childPid_ = pid;
-            //Should get each engine message, then parse it
+            /*
+             * These ends belong to the engine : once closed here, its output
+             * pipes see the end of file when it exits.
+             */
+            close(getEngineInRead());
+            close(getEngineOutWrite());
+            close(getEngineErrWrite());
+            in_fds_[0] = out_fds_[1] = err_fds_[1] = -1;
+            //Each engine message is parsed from the io thread,
             //then eventually update and notify matFinder
-            string strBuf;
-            while (true) {
-                getline((*engine_output_), strBuf);
-                if (parseUCIMsg(strBuf))
-                    break;
-                /*if (strBuf == "quit\n")*/
-                    /*break;*/
-            }
+            io_ = &io;
+            outSource_ = io.add(getEngineOutRead(),
+                                [this](const StringView &line)
+                                {
+                                    return parseUCIMsg(line);
+                                });
+            /*Drained, so that the engine never blocks on a full pipe*/
+            errSource_ = io.add(getEngineErrRead(),
+                                [this](const StringView &line)
+                                {
+                                    Out::output(engineName_ + " (stderr) : "
+                                                + line.str() + "\n", 2);
+                                    return 0;
+                                });
         } else {
-            Err::handle("couldn't fork");
+            Err::handle("Engine execution failed : " + engineFullpath_
+                        + " (" + to_string(rc) + ")");
         }
     }
 
-    bool LocalUCICommunicator::send(const string &cmd) const
+    bool LocalUCICommunicator::send(const string &cmds)
     {
-        Out::output("Sending \"" + cmd + "\" to engine !\n", 3);
-        (*engine_input_) << cmd << "\n";
+        /*A single write, unless the pipe is full*/
+        size_t done = 0;
+        while (done < cmds.size()) {
+            ssize_t written = write(getEngineInWrite(), cmds.data() + done,
+                                    cmds.size() - done);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                Err::output("write() : Error sending commands to "
+                            + engineName_);
+                return false;
+            }
+            done += written;
+        }
         return true;
     }
 
@@ -288,10 +370,12 @@ namespace Comm {
         return (waitpid(childPid_, &status, WNOHANG) == 0);
     }
 
-    void LocalUCICommunicator::quit() const
+    void LocalUCICommunicator::terminate()
     {
-        UCICommunicator::quit();
-        (*receiver_input_) << "quit\n";
+        if (ok()) {
+            kill(childPid_, SIGKILL);
+            waitpid(childPid_, nullptr, 0);
+        }
     }
 
     int LocalUCICommunicator::getEngineInRead()
@@ -324,35 +408,131 @@ namespace Comm {
         return err_fds_[1];
     }
 
+    RemoteUCICommunicator::RemoteUCICommunicator(const string address,
+            const EngineOptions &options) :
+        UCICommunicator(options), address_(address)
+    {
+    }
+
+    RemoteUCICommunicator::~RemoteUCICommunicator()
+    {
+        /*No handler may run on this communicator after this*/
+        if (io_)
+            io_->remove(source_);
+        if (socket_ >= 0)
+            close(socket_);
+    }
+
+    void RemoteUCICommunicator::run(EventLoop &io)
+    {
+        size_t colon = address_.find_last_of(':');
+        if (colon == string::npos)
+            Err::handle("Remote engine address must be host:port, not "
+                        + address_);
+        string host = address_.substr(0, colon);
+        string port = address_.substr(colon + 1);
+        struct addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *addresses;
+        int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+        if (rc)
+            Err::handle("Remote engine " + address_ + " : "
+                        + gai_strerror(rc));
+        for (struct addrinfo *a = addresses; a; a = a->ai_next) {
+            socket_ = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (socket_ < 0)
+                continue;
+            fcntl(socket_, F_SETFD, FD_CLOEXEC);
+            if (!connect(socket_, a->ai_addr, a->ai_addrlen))
+                break;
+            close(socket_);
+            socket_ = -1;
+        }
+        freeaddrinfo(addresses);
+        if (socket_ < 0)
+            Err::handle("Unable to connect to the remote engine " + address_);
+        /*Commands are small and latency matters*/
+        int one = 1;
+        setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        io_ = &io;
+        source_ = io.add(socket_, [this](const StringView &line)
+                                  {
+                                      return parseUCIMsg(line);
+                                  });
+    }
+
+    bool RemoteUCICommunicator::send(const string &cmds)
+    {
+        /*The socket is non blocking, as it is also read by the event loop*/
+        size_t done = 0;
+        while (done < cmds.size()) {
+            ssize_t written = ::send(socket_, cmds.data() + done,
+                                     cmds.size() - done, MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    struct pollfd pfd = {socket_, POLLOUT, 0};
+                    poll(&pfd, 1, -1);
+                    continue;
+                }
+                if (errno == EINTR)
+                    continue;
+                Err::output("send() : Error sending commands to " + address_);
+                return false;
+            }
+            done += written;
+        }
+        return true;
+    }
+
+    bool RemoteUCICommunicator::ok()
+    {
+        if (socket_ < 0)
+            return false;
+        /*Whatever is pending is left to the event loop*/
+        char c;
+        ssize_t rc = recv(socket_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return rc > 0 || (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+                                     || errno == EINTR));
+    }
+
+    void RemoteUCICommunicator::terminate()
+    {
+        /*The daemon kills the engine when the connection is closed*/
+        if (socket_ >= 0)
+            shutdown(socket_, SHUT_RDWR);
+    }
+
     template<class T>
         int UCICommunicatorPool::create(const string engineFullpath,
                 const EngineOptions &options)
         {
             int id = __atomic_fetch_add(&currentId_, 1, __ATOMIC_SEQ_CST);
-            T *engineComm = new T(engineFullpath, options);
-
-            pool_.emplace(id, make_pair(engineComm,
-                                        std::thread(&T::run, engineComm)));
-
-            /*Ping the engine until it's ready*/
-            unsigned int pollTime = 20000;
-            while (!isReady(id))
-                usleep(pollTime);
-
-            engineComm->send("uci");
-            engineComm->sendOptions();
-
+            factories_[id] = [engineFullpath](const EngineOptions &opts)
+                             {
+                                 return new T(engineFullpath, opts);
+                             };
+            restarts_[id] = 0;
+            dispatched_[id] = false;
+            if (!start(id, factories_[id](options)))
+                restart(id);
             return id;
         }
 
     template int UCICommunicatorPool::create<LocalUCICommunicator>(
             const string engineFullpath,
             const EngineOptions &options);
+    template int UCICommunicatorPool::create<RemoteUCICommunicator>(
+            const string engineFullpath,
+            const EngineOptions &options);
 
     bool UCICommunicatorPool::send(int id, const string &cmd)
     {
         UCICommunicator *engine;
-        return ((engine = get(id)) && engine->send(cmd));
+        if (!(engine = driven(id)))
+            return false;
+        engine->queue(cmd);
+        return engine->flush();
     }
 
     bool UCICommunicatorPool::send(int id, const std::string &&c)
@@ -367,33 +547,106 @@ namespace Comm {
         return send(id, cmd);
     }
 
+    bool UCICommunicatorPool::queue(int id, const string &cmd)
+    {
+        UCICommunicator *engine;
+        if (!(engine = driven(id)))
+            return false;
+        engine->queue(cmd);
+        return true;
+    }
+
     bool UCICommunicatorPool::isReady(int id)
     {
-        return (send(id, "isready")) ? waitForReadyok(id) : false;
+        UCICommunicator *engine;
+        return ((engine = driven(id)) && engine->ready());
+    }
+
+    bool UCICommunicatorPool::sendAndWaitBestmove(int id, const std::string &cmd,
+                                                  EarlyStop::Mode mode)
+    {
+        UCICommunicator *engine;
+        if (!(engine = driven(id))) {
+            restart(id);
+            return false;
+        }
+        /*The lines are read from getResultLines, no need for a copy*/
+        return search(id, engine, cmd, mode, nullptr);
     }
 
-    bool UCICommunicatorPool::sendAndWaitBestmove(int id, const std::string &cmd)
+    future<vector<Line>> UCICommunicatorPool::submitSearch(int id,
+            const string &fen, const string &limits)
     {
         UCICommunicator *engine;
-        if ((engine = get(id)))
-            engine->clearLines();
-        return (send(id, cmd)) ? waitForBestmove(id) : false;
+        /*Empty lines would be taken for a mate or a stalemate*/
+        if (!(engine = driven(id)))
+            return promise<vector<Line>>().get_future();
+        engine->queue("position fen " + fen);
+        return engine->startSearch("go " + limits, true);
+    }
+
+    future<vector<Line>> UCICommunicatorPool::evaluate(const string &fen,
+            const string &limits, int multiPV, EarlyStop::Mode mode)
+    {
+        Evaluation *eval = new Evaluation{fen, limits, multiPV, mode,
+                                          promise<vector<Line>>()};
+        future<vector<Line>> result = eval->result.get_future();
+        {
+            unique_lock<mutex> lock =
+                    LockStats::acquire(evaluationsLock_,
+                                       LockStats::evaluations);
+            if (stopDispatch_) {
+                /*No dispatcher will take it, this breaks the future*/
+                delete eval;
+                return result;
+            }
+            if (dispatchers_.empty())
+                Err::handle("No engine to evaluate " + fen
+                            + ", see dispatchOn");
+            evaluations_.push_back(eval);
+        }
+        evaluationsCond_.notify_one();
+        return result;
+    }
+
+    vector<future<vector<Line>>> UCICommunicatorPool::evaluate(
+            const vector<string> &fens, const string &limits, int multiPV)
+    {
+        vector<future<vector<Line>>> results;
+        for (const string &fen : fens)
+            results.push_back(evaluate(fen, limits, multiPV));
+        return results;
+    }
+
+    void UCICommunicatorPool::dispatchOn(const vector<int> &ids)
+    {
+        unique_lock<mutex> lock =
+                LockStats::acquire(evaluationsLock_, LockStats::evaluations);
+        if (stopDispatch_)
+            return;
+        for (int id : ids) {
+            if (!dispatched_.count(id) || dispatched_[id])
+                continue;
+            dispatched_[id] = true;
+            dispatchers_.push_back(thread(&UCICommunicatorPool::dispatch,
+                                          this, id));
+        }
     }
 
     bool UCICommunicatorPool::sendOption(int id, const string &name,
                                          const string &value)
     {
         UCICommunicator *engine;
-        if ((engine = get(id))) {
-            engine->sendOption(name, value);
-        }
-        return isReady(id);
+        if (!(engine = driven(id)))
+            return false;
+        engine->sendOption(name, value);
+        return true;
     }
 
     const vector<Line> &UCICommunicatorPool::getResultLines(int id)
     {
         UCICommunicator *engine;
-        if (!(engine = get(id)))
+        if (!(engine = driven(id)))
             Err::handle("Error : no engine \"" + to_string(id)
                         + "\" to get the results from !");
         return engine->getResultLines();
@@ -403,10 +656,9 @@ namespace Comm {
     {
         if (pool_.count(id) > 0) {
             /*Properly exit engine*/
-            pool_[id].first->quit();
-            pool_[id].second.join();
+            pool_[id]->quit();
             /*Remove Communicator from the pool*/
-            delete pool_[id].first;
+            delete pool_[id];
             pool_.erase(id);
             return true;
         }
@@ -419,6 +671,7 @@ namespace Comm {
         int doit = __atomic_add_fetch(&destroyed_, 1, __ATOMIC_SEQ_CST);
         if (doit > 1)
             return true;
+        stopDispatchers();
         /*Necessary to prevent iterator from being invalidated*/
         vector<int> toDestroy;
         for (auto &entry : pool_) {
@@ -430,6 +683,30 @@ namespace Comm {
         return done;
     }
 
+    bool UCICommunicatorPool::restart(int id)
+    {
+        if (pool_.count(id) == 0)
+            return false;
+        EngineOptions options;
+        /*An engine which is not ready after a restart is one more failure*/
+        do {
+            if (++restarts_[id] > MAX_RESTARTS)
+                Err::handle("Engine " + to_string(id) + " failed "
+                            + to_string(MAX_RESTARTS) + " times in a row");
+            Err::output("Restarting engine " + to_string(id));
+            UCICommunicator *old = pool_[id];
+            options = old->optionsMap_;
+            old->terminate();
+            delete old;
+        } while (!start(id, factories_[id](options)));
+        return true;
+    }
+
+    uint64_t UCICommunicatorPool::searches() const
+    {
+        return searches_;
+    }
+
     UCICommunicatorPool &UCICommunicatorPool::getInstance()
     {
         return instance_;
@@ -437,27 +714,149 @@ namespace Comm {
 
     /*Private methods*/
 
-    UCICommunicator *UCICommunicatorPool::get(int id)
+    bool UCICommunicatorPool::start(int id, UCICommunicator *comm)
+    {
+        const string &cacheFile = Options::getInstance().getResultCache();
+        if (!cache_ && !cacheFile.empty())
+            cache_ = new ResultCache(cacheFile);
+        comm->cache_ = cache_;
+        pool_[id] = comm;
+        comm->run(io_);
+
+        comm->queue("uci");
+        comm->sendOptions();
+
+        /*Sent with the commands above, ping until the engine is ready*/
+        unsigned int pollTime = 20000;
+        chrono::steady_clock::time_point deadline =
+            chrono::steady_clock::now() + chrono::seconds(5);
+        /*Not isReady, which refuses the dispatched engines*/
+        while (!comm->ready()) {
+            if (!comm->ok()) {
+                Err::output("Engine " + to_string(id) + " exited at startup");
+                return false;
+            }
+            if (chrono::steady_clock::now() > deadline)
+                return false;
+            usleep(pollTime);
+        }
+        return true;
+    }
+
+    bool UCICommunicatorPool::search(int id, UCICommunicator *engine,
+            const string &cmd, EarlyStop::Mode mode, vector<Line> *lines)
     {
-        if (pool_.count(id) > 0 && pool_[id].first->ok())
-            return pool_[id].first;
-        else {
-            Out::output("Warning : Unknown UCICommunicator id : "
-                        + to_string(id) + "\n", 2);
-            return nullptr;
+        future<vector<Line>> result = engine->startSearch(cmd,
+                                                          lines != nullptr,
+                                                          mode);
+        chrono::milliseconds timeout(
+                1000 * Options::getInstance().getSearchTimeout());
+        if (!engine->waitBestmove(timeout)) {
+            restart(id);
+            return false;
+        }
+        restarts_[id] = 0;
+        searches_++;
+        /*Copied on bestmove, the engine may be gone by now*/
+        if (lines)
+            *lines = result.get();
+        return true;
+    }
+
+    void UCICommunicatorPool::dispatch(int id)
+    {
+        while (true) {
+            Evaluation *eval;
+            {
+                unique_lock<mutex> lock =
+                        LockStats::acquire(evaluationsLock_,
+                                           LockStats::evaluations);
+                evaluationsCond_.wait(lock, [this] {
+                    return stopDispatch_ || !evaluations_.empty();
+                });
+                if (stopDispatch_)
+                    return;
+                eval = evaluations_.front();
+                evaluations_.pop_front();
+                busyDispatchers_++;
+            }
+            UCICommunicator *engine = get(id);
+            vector<Line> lines;
+            bool done = false;
+            if (engine) {
+                /*Options, position and go are written at once*/
+                if (eval->multiPV > 0)
+                    engine->sendOption("MultiPV", to_string(eval->multiPV));
+                engine->queue("position fen " + eval->fen);
+                done = search(id, engine, "go " + eval->limits, eval->mode,
+                              &lines);
+            } else {
+                restart(id);
+            }
+            if (done)
+                eval->result.set_value(lines);
+            {
+                unique_lock<mutex> lock =
+                        LockStats::acquire(evaluationsLock_,
+                                           LockStats::evaluations);
+                busyDispatchers_--;
+                if (!done) {
+                    /*The engine has been restarted, any engine may take it*/
+                    evaluations_.push_front(eval);
+                    evaluationsCond_.notify_one();
+                    continue;
+                }
+            }
+            delete eval;
         }
     }
 
-    bool UCICommunicatorPool::waitForBestmove(int id)
+    void UCICommunicatorPool::stopDispatchers()
     {
-        UCICommunicator *engine;
-        return ((engine = get(id)) && engine->waitBestmove());
+        bool idle;
+        {
+            unique_lock<mutex> lock =
+                    LockStats::acquire(evaluationsLock_,
+                                       LockStats::evaluations);
+            stopDispatch_ = true;
+            idle = (busyDispatchers_ == 0);
+            /*Their futures are broken*/
+            for (Evaluation *eval : evaluations_)
+                delete eval;
+            evaluations_.clear();
+        }
+        evaluationsCond_.notify_all();
+        /*
+         * Dispatchers are only busy when giving up on an error (see
+         * Err::handle), the process exits without waiting for them.
+         */
+        for (thread &t : dispatchers_) {
+            if (idle)
+                t.join();
+            else
+                t.detach();
+        }
+        dispatchers_.clear();
     }
 
-    bool UCICommunicatorPool::waitForReadyok(int id)
+    UCICommunicator *UCICommunicatorPool::driven(int id)
     {
-        UCICommunicator *engine;
-        return ((engine = get(id)) && engine->waitReadyok());
+        auto entry = dispatched_.find(id);
+        if (entry != dispatched_.end() && entry->second)
+            Err::handle("Engine " + to_string(id) + " is used by the"
+                        " evaluations, it can't be driven by id");
+        return get(id);
+    }
+
+    UCICommunicator *UCICommunicatorPool::get(int id)
+    {
+        if (pool_.count(id) > 0 && pool_[id]->ok())
+            return pool_[id];
+        else {
+            Out::output("Warning : Unknown UCICommunicator id : "
+                        + to_string(id) + "\n", 2);
+            return nullptr;
+        }
     }
 
     UCICommunicatorPool &UCICommunicatorPool::operator=(const UCICommunicatorPool &)
@@ -468,6 +867,7 @@ namespace Comm {
     UCICommunicatorPool::~UCICommunicatorPool()
     {
         destroyAll();
+        delete cache_;
     }
 
     UCICommunicatorPool UCICommunicatorPool::instance_ = UCICommunicatorPool();
@@ -24,6 +24,9 @@
 #include <sstream>
 #include <fstream>
 #include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include "Utils.h"
@@ -32,6 +35,8 @@
 
 using namespace std;
 
+extern char **environ;
+
 namespace Utils {
     string helpMessage()
     {
@@ -62,7 +67,9 @@ namespace Utils {
             << "        " << "There must be one position per line, following this "\
             "format : \n"
             << "        \"position fen theFenString "\
-            "[moves additionnalmoves]\"\n";
+            "[moves additionnalmoves]\"\n"
+            << "        " << "Matfinder runs as many positions at once as "\
+            "there are engines (see engine_number).\n";
         oss << "\n";
         oss << "    " << "--verbose=level, -v level\n";
         oss << "        " << "Defines the verbose level. 1 displays lines followed,\n"
@@ -100,11 +107,32 @@ namespace Utils {
         oss << "                  Other possible values are : gardner, losalamos\n";
         oss << "        hashmap_size : size of engine's hashtable, in MB (default is 2048)\n";
         oss << "        threads : number of threads the engine should use\n";
+        oss << "        deferred_info_parsing : only keep the last info line of each\n";
+        oss << "                                pv, and parse it when the search ends\n";
+        oss << "                                (default is false)\n";
+        oss << "        search_timeout : seconds after which a search is considered\n";
+        oss << "                         hung, and the engine restarted. Crashed\n";
+        oss << "                         engines are always restarted\n";
+        oss << "                         (default is 0, no limit)\n";
+        oss << "        result_cache : file where the engine results are kept, to\n";
+        oss << "                       reuse them for the same position, engine,\n";
+        oss << "                       search limits and MultiPV (default is none)\n";
+        oss << "        remote_engines : comma separated host:port of engined daemons.\n";
+        oss << "                         If set, the engines are started there\n";
+        oss << "                         (in turn) instead of locally\n";
         oss << "    - Finder\n";
         oss << "        verbose_level : the verbose level (default is 0)\n";
         oss << "        cutoff_threshold : define the value for the draw in centipawn\n";
         oss << "                          (Default is 100, which means lines between\n";
         oss << "                          -1.0 and 1.0 will be considered as draw)\n";
+        oss << "        early_stop : send stop as soon as the verdict of a search\n";
+        oss << "                     is known : mate, beyond cutoff_threshold or\n";
+        oss << "                     0.00 for early_stop_iterations depths in a\n";
+        oss << "                     row (default is false)\n";
+        oss << "        early_stop_depth : minimal depth before stopping, unless a\n";
+        oss << "                           mate is found (default is 10)\n";
+        oss << "        early_stop_iterations : number of depths the verdict must\n";
+        oss << "                                hold (default is 3)\n";
         oss << "        playfor_movetime : the time given to the side the finder plays for (ms)\n";
         oss << "                           (default is 1500)\n";
         oss << "        playagaint_movetime : the time given to the side the finder plays"\
@@ -115,6 +143,9 @@ namespace Utils {
         oss << "        mate_threshold : minimal value for an evaluation to be considered"\
                "as mate.\n";
         oss << "                        (default is 10000 centipawn)\n";
+        oss << "        split_subtrees : search the other replies of the defender on"\
+               " the engines\n";
+        oss << "                         not used by a position (default is false)\n";
         oss << "    - Oraclefinder\n";
         oss << "        comparator : the move comparator to use (default is \"map\")\n";
         oss << "                     Other values are \"default\".\n";
@@ -124,6 +155,35 @@ namespace Utils {
         oss << "                      Other values are \"depth\" or \"mixed\"\n";
         oss << "        search_depth : the search depth when the engine is in depth mode\n";
         oss << "                       (default is 10)\n";
+        oss << "        mixed_start_depth : first depth checked in mixed mode, the\n";
+        oss << "                            search goes on for mixed_depth_step\n";
+        oss << "                            more depths while the best line is\n";
+        oss << "                            contested, up to search_depth or\n";
+        oss << "                            playfor_movetime (default is 8 and 4)\n";
+        oss << "        mixed_margin : a line is contested if its eval is within\n";
+        oss << "                       this margin of cutoff_threshold, or moved by\n";
+        oss << "                       more than it since the previous depth\n";
+        oss << "                       (default is 50 centipawn)\n";
+        oss << "        bloom_capacity : minimal number of positions the bloom filter of\n";
+        oss << "                         a signature table is sized for (default is 65536).\n";
+        oss << "                         Full filters chain a twice larger one\n";
+        oss << "        bloom_false_positive : target false positive rate of these filters\n";
+        oss << "                               (default is 0.01, 0 disables them)\n";
+        oss << "        compressed_tables : save new signature tables in the compressed\n";
+        oss << "                            block format (.cbt, default is false)\n";
+        oss << "        table_memory_budget : memory for the signature tables, in MB.\n";
+        oss << "                              Tables are loaded when first needed, the\n";
+        oss << "                              least recently used are saved and dropped\n";
+        oss << "                              above this budget (default is 0, no limit)\n";
+        oss << "        main_table_shard_bits : split the main table in 2^bits shards,\n";
+        oss << "                                by key prefix (default is 0, max 16).\n";
+        oss << "                                Each shard is saved to its own file\n";
+        oss << "                                (output.shard<n>.bin for output.bin)\n";
+        oss << "        main_table_memory_budget : memory for the main table, in MB. The\n";
+        oss << "                                   least recently used shards are\n";
+        oss << "                                   spilled to disk above this budget\n";
+        oss << "                                   (default is 0, no limit)\n";
+        oss << "        spill_folder : where spilled shards are written (default is spill)\n";
         oss << "\n";
         oss << "Contact\n";
         oss << "    Philippe Virouleau <philippe.viroulea@imag.fr>\n";
@@ -264,6 +324,40 @@ namespace Utils {
         return retVal;
     }
 
+    int pipeCloexec(int fds[2])
+    {
+#ifdef __linux__
+        return pipe2(fds, O_CLOEXEC);
+#else
+        int status = pipe(fds);
+        if (!status) {
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        }
+        return status;
+#endif
+    }
+
+    int spawnProcess(const string &path, const string &name,
+                     int in, int out, int err, pid_t &pid)
+    {
+        /*
+         * posix_spawn does not copy the page tables of the caller, which may
+         * hold gigabytes of tables : the cost of starting a program does
+         * not depend on it. dup2 clears the close on exec flag.
+         */
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, in, 0);
+        posix_spawn_file_actions_adddup2(&actions, out, 1);
+        posix_spawn_file_actions_adddup2(&actions, err, 2);
+        char *argv[] = {const_cast<char *>(name.c_str()), nullptr};
+        int rc = posix_spawn(&pid, path.c_str(), &actions, nullptr, argv,
+                             environ);
+        posix_spawn_file_actions_destroy(&actions);
+        return rc;
+    }
+
     string getPrettyLines(const Board::Position &pos, const vector<Line> &lines)
     {
         string retVal;
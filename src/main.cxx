@@ -156,6 +156,11 @@ int main(int argc, char **argv)
     if (sigaction(SIGUSR1, &action, NULL) < 0) {
         Err::handle("SIGUSR1 install error");
     }
+    /*Writing to a dead engine fails, its restart is up to the pool*/
+    action.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &action, NULL) < 0) {
+        Err::handle("SIGPIPE install error");
+    }
 
 
     /*Setup some engine options*/
@@ -166,11 +171,18 @@ int main(int argc, char **argv)
     Comm::UCICommunicatorPool &pool = Comm::UCICommunicatorPool::getInstance();
 
     vector<int> commIds;
+    const vector<string> &remotes = options.getRemoteEngines();
     for (int i = 0; i < options.getEngineNumber(); i++) {
         /*Create the engine and its communicator*/
-        int commId = pool.create<Comm::LocalUCICommunicator>(
+        int commId;
+        if (remotes.empty())
+            commId = pool.create<Comm::LocalUCICommunicator>(
                                        options.getEngineFullpath(),
                                        engine_options);
+        else
+            commId = pool.create<Comm::RemoteUCICommunicator>(
+                                       remotes[i % remotes.size()],
+                                       engine_options);
         commIds.push_back(commId);
     }
 
@@ -0,0 +1,211 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * Microbenchmark of the info line parsing, on a transcript of engine output.
+ * Only the info lines of the transcript are used, a recorded Stockfish
+ * session is the most meaningful input :
+ *   (echo "setoption name MultiPV value 64"; echo "go depth 25"; sleep 60) \
+ *       | stockfish > transcript
+ * Without transcript, a synthetic one is generated : its results only give
+ * an idea of the relative costs.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <list>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "InfoParser.h"
+#include "Line.h"
+#include "Output.h"
+
+using namespace std;
+
+atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+/*The istringstream based parser used before InfoParser, for reference*/
+void legacyInfo(istringstream &is, vector<Line> &linesVector)
+{
+    string token;
+    bool readLine = false;
+    bool eval = false;
+    int curDepth = 0;
+    float curEval = 0;
+    bool curIsMat = false;
+    list<string> curMoves;
+    unsigned int curLineId = 0;
+    while (is >> token) {
+        if (token == "depth") {
+            is >> curDepth;
+        } else if (token == "pv") {
+            readLine = true;
+            while (is >> token)
+                curMoves.push_back(token);
+        } else if (token == "multipv") {
+            is >> curLineId;
+        } else if (token == "score") {
+            eval = true;
+            is >> token;
+            if (token == "mate") {
+                curIsMat = true;
+                is >> curEval;
+            } else if (token == "cp") {
+                is >> curEval;
+            }
+        }
+    }
+    if (readLine && eval && !curMoves.empty() && curLineId
+        && curLineId <= linesVector.size()) {
+        Line curLine(curEval, curDepth, curMoves, curIsMat);
+        linesVector[curLineId - 1] = curLine;
+    }
+}
+
+vector<string> syntheticTranscript(unsigned int multipv, unsigned int depth)
+{
+    const char *moves[] = {"e2e4", "e7e5", "g1f3", "b8c6", "f1b5", "a7a6",
+                           "b5a4", "g8f6", "e1g1", "f8e7", "f1e1", "b7b5",
+                           "a4b3", "d7d6", "c2c3", "e8g8", "h2h3", "c6a5",
+                           "b3c2", "c7c5", "d2d4", "d8c7", "b1d2", "a7a8q"};
+    const size_t moveCount = sizeof(moves) / sizeof(moves[0]);
+    vector<string> lines;
+    unsigned int seed = 12345;
+    for (unsigned int d = 1; d <= depth; d++) {
+        for (unsigned int slot = 1; slot <= multipv; slot++) {
+            seed = seed * 1103515245 + 12345;
+            string line = "info depth " + to_string(d) + " seldepth "
+                          + to_string(d + 8) + " multipv " + to_string(slot)
+                          + " score cp " + to_string((int)(seed % 200) - 100)
+                          + " nodes " + to_string(d * 123457 + slot)
+                          + " nps 1534212 hashfull " + to_string(d * 10)
+                          + " tbhits 0 time " + to_string(d * 97) + " pv";
+            for (unsigned int m = 0; m < d + seed % 8; m++)
+                line += string(" ") + moves[((seed >> 8) + m) % moveCount];
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+int main(int argc, char **argv)
+{
+    vector<string> transcript;
+    unsigned int slots = 256;
+    if (argc > 1) {
+        ifstream in(argv[1]);
+        if (!in)
+            Err::handle("Unable to open " + string(argv[1]));
+        string line;
+        while (getline(in, line))
+            if (line.compare(0, 5, "info ") == 0)
+                transcript.push_back(line);
+        Out::output("Transcript " + string(argv[1]) + " : "
+                    + to_string(transcript.size()) + " info lines\n");
+    } else {
+        transcript = syntheticTranscript(64, 30);
+        Out::output("Synthetic transcript (MultiPV 64, depth 30) : "
+                    + to_string(transcript.size()) + " info lines, "
+                    "results are indicative only\n");
+    }
+    size_t bytes = 0;
+    for (const string &line : transcript)
+        bytes += line.size();
+    const int rounds = 20;
+    double lines = (double)transcript.size() * rounds;
+
+    vector<Line> linesVector(slots);
+    size_t allocBefore = allocations;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (const string &line : transcript) {
+            istringstream is(line.substr(5));
+            legacyInfo(is, linesVector);
+        }
+    double legacy = chrono::duration<double>(chrono::steady_clock::now()
+                                             - start).count();
+    size_t legacyAllocs = allocations - allocBefore;
+
+    Comm::InfoParser parser;
+    parser.clear(slots);
+    /*One pass to size the storage*/
+    for (const string &line : transcript)
+        parser.parse(line, 5);
+    allocBefore = allocations;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (const string &line : transcript)
+            parser.parse(line, 5);
+    double current = chrono::duration<double>(chrono::steady_clock::now()
+                                              - start).count();
+    size_t currentAllocs = allocations - allocBefore;
+
+    /*Each round is one search, flushed when its bestmove would arrive*/
+    parser.clear(slots, true);
+    for (const string &line : transcript)
+        parser.add(line, 5);
+    parser.flush();
+    allocBefore = allocations;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (const string &line : transcript)
+            parser.add(line, 5);
+        parser.flush();
+    }
+    double deferred = chrono::duration<double>(chrono::steady_clock::now()
+                                               - start).count();
+    size_t deferredAllocs = allocations - allocBefore;
+
+    ostringstream oss;
+    oss.precision(1);
+    oss << fixed;
+    oss << "istringstream parser : " << legacy * 1e9 / lines << " ns/line, "
+        << bytes * rounds / legacy / (1 << 20) << " MB/s, "
+        << legacyAllocs / lines << " allocations/line\n";
+    oss << "InfoParser           : " << current * 1e9 / lines << " ns/line, "
+        << bytes * rounds / current / (1 << 20) << " MB/s, "
+        << currentAllocs / lines << " allocations/line\n";
+    oss << "InfoParser, deferred : " << deferred * 1e9 / lines << " ns/line, "
+        << bytes * rounds / deferred / (1 << 20) << " MB/s, "
+        << deferredAllocs / lines << " allocations/line\n";
+    oss << "Speedup              : " << legacy / current << "x, "
+        << legacy / deferred << "x deferred\n";
+    Out::output(oss.str());
+    return 0;
+}
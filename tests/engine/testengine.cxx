@@ -0,0 +1,604 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "ConfigParser.h"
+#include "EarlyStop.h"
+#include "EventLoop.h"
+#include "InfoParser.h"
+#include "Options.h"
+#include "Output.h"
+#include "ResultCache.h"
+#include "SimpleChessboard.h"
+#include "Stream.h"
+#include "StringView.h"
+#include "UCICommunicator.h"
+
+using namespace std;
+
+int failures = 0;
+int tests = 0;
+
+/*Every allocation of the tester goes through here*/
+atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void check(bool cond, const string &what)
+{
+    tests++;
+    if (!cond) {
+        failures++;
+        Out::output("Failed : " + what + "\n");
+    }
+}
+
+/*Write data to a pipe from another thread, in small chunks*/
+vector<string> readThroughPipe(const string &data, size_t readSize,
+                               size_t chunk)
+{
+    int fds[2];
+    if (pipe(fds))
+        Err::handle("pipe");
+    thread writer([&data, fds, chunk]() {
+        for (size_t pos = 0; pos < data.size(); pos += chunk) {
+            size_t len = min(chunk, data.size() - pos);
+            if (write(fds[1], data.data() + pos, len) != (ssize_t)len)
+                Err::handle("write");
+        }
+        close(fds[1]);
+    });
+    vector<string> lines;
+    LineReader reader(fds[0], readSize);
+    StringView line;
+    while (reader.getline(line))
+        lines.push_back(line.str());
+    writer.join();
+    close(fds[0]);
+    return lines;
+}
+
+void testLineReader()
+{
+    Out::output("Testing line reader\n");
+    string longPv = "info depth 30 multipv 1 score cp 12 pv";
+    while (longPv.size() < 100000)
+        longPv += " e2e4 e7e5";
+    string data = "uciok\nreadyok\r\n\n" + longPv + "\nbestmove e2e4";
+    for (size_t readSize : {4, 16, 4096}) {
+        for (size_t chunk : {1, 7, 65536}) {
+            vector<string> lines = readThroughPipe(data, readSize, chunk);
+            string what = " (read " + to_string(readSize) + ", chunk "
+                          + to_string(chunk) + ")";
+            check(lines.size() == 5, "line count" + what);
+            if (lines.size() != 5)
+                continue;
+            check(lines[0] == "uciok", "first line" + what);
+            check(lines[1] == "readyok", "carriage return stripped" + what);
+            check(lines[2].empty(), "empty line" + what);
+            check(lines[3] == longPv, "long line not truncated" + what);
+            check(lines[4] == "bestmove e2e4", "unterminated last line" + what);
+        }
+    }
+}
+
+void testStringView()
+{
+    Out::output("Testing string view\n");
+    StringView msg("  info   depth 12\tpv e2e4 ");
+    size_t pos = 0;
+    vector<string> tokens;
+    for (StringView t = msg.token(pos); !t.empty(); t = msg.token(pos))
+        tokens.push_back(t.str());
+    check(tokens == vector<string>({"info", "depth", "12", "pv", "e2e4"}),
+          "tokens");
+    check(msg.substr(2, 4) == "info", "substr");
+    check(msg.substr(100).empty(), "substr out of range");
+    check(StringView("pv") != StringView("pvx"), "different sizes");
+}
+
+/*Wait up to a few seconds for cond to become true*/
+template<class Cond>
+bool waitFor(Cond cond)
+{
+    for (int i = 0; i < 500 && !cond(); i++)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    return cond();
+}
+
+void testEventLoop()
+{
+    Out::output("Testing event loop\n");
+    Comm::EventLoop io;
+    const int engines = 8;
+    const int lines = 2000;
+    int fds[engines][2];
+    atomic<int> received[engines];
+    atomic<int> outOfOrder(0);
+    vector<uint64_t> ids;
+    for (int i = 0; i < engines; i++) {
+        if (pipe(fds[i]))
+            Err::handle("pipe");
+        received[i] = 0;
+        atomic<int> *count = &received[i];
+        ids.push_back(io.add(fds[i][0], [count, &outOfOrder]
+                                        (const StringView &line)
+                                        {
+                                            if (line.str() != to_string(*count))
+                                                outOfOrder++;
+                                            (*count)++;
+                                            return 0;
+                                        }));
+    }
+    /*All the engines write at once, more than a pipe can hold*/
+    vector<thread> writers;
+    for (int i = 0; i < engines; i++)
+        writers.push_back(thread([&fds, i, lines]() {
+            for (int l = 0; l < lines; l++) {
+                string line = to_string(l) + "\n";
+                if (write(fds[i][1], line.data(), line.size()) < 0)
+                    Err::handle("write");
+            }
+        }));
+    for (thread &t : writers)
+        t.join();
+    bool all = waitFor([&]() {
+        for (int i = 0; i < engines; i++)
+            if (received[i] != lines)
+                return false;
+        return true;
+    });
+    check(all, "all lines dispatched");
+    check(outOfOrder == 0, "lines in order");
+
+    /*End of file removes the source*/
+    close(fds[0][1]);
+    check(waitFor([&]() { return io.sources() == engines - 1; }),
+          "source removed on end of file");
+    /*No more call once removed*/
+    io.remove(ids[1]);
+    check(write(fds[1][1], "x\n", 2) == 2, "write after remove");
+    this_thread::sleep_for(chrono::milliseconds(50));
+    check(received[1] == lines, "no handler call after remove");
+
+    /*A handler asking to stop*/
+    int stopFds[2];
+    if (pipe(stopFds))
+        Err::handle("pipe");
+    atomic<int> stopCalls(0);
+    io.add(stopFds[0], [&stopCalls](const StringView &line)
+                       {
+                           stopCalls++;
+                           return (line == "quit") ? 1 : 0;
+                       });
+    check(write(stopFds[1], "a\nquit\nb\n", 9) == 9, "write stop");
+    check(waitFor([&]() { return io.sources() == engines - 2; }),
+          "source removed by its handler");
+    check(stopCalls == 2, "no line after stop");
+    for (int i = 0; i < engines; i++) {
+        close(fds[i][0]);
+        if (i != 0)
+            close(fds[i][1]);
+    }
+    close(stopFds[0]);
+    close(stopFds[1]);
+}
+
+void testInfoParser()
+{
+    Out::output("Testing info parser\n");
+    bool sameEncoding = true;
+    string promotions[] = {"", "n", "b", "r", "q"};
+    for (char ff = 'a'; ff <= 'h'; ff++)
+        for (char fr = '1'; fr <= '8'; fr++)
+            for (char tf = 'a'; tf <= 'h'; tf += 3)
+                for (char tr = '1'; tr <= '8'; tr += 7)
+                    for (const string &p : promotions) {
+                        string mv = {ff, fr, tf, tr};
+                        mv += p;
+                        uint16_t move = 0;
+                        sameEncoding &= Comm::InfoParser::parseMove(mv, move)
+                                        && move == Board::uciToPolyglot(mv);
+                    }
+    check(sameEncoding, "moves encoded like uciToPolyglot");
+    uint16_t move;
+    check(!Comm::InfoParser::parseMove("e2e9", move)
+          && !Comm::InfoParser::parseMove("e7e8k", move)
+          && !Comm::InfoParser::parseMove("0000", move), "invalid moves");
+
+    Comm::InfoParser parser;
+    parser.clear(3);
+    StringView line2("info depth 12 seldepth 20 multipv 2 score cp -35 "
+                     "lowerbound nodes 123456 nps 654321 hashfull 12 tbhits 0 "
+                     "time 188 pv d2d4 d7d5 c2c4");
+    StringView line1("info depth 13 multipv 1 score mate 4 pv e7e8q f7f6");
+    check(parser.parse(line2, 4) == 2, "cp line slot");
+    check(parser.parse(line1, 4) == 1, "mate line slot");
+    check(parser.parse("info depth 14 currmove e2e4 currmovenumber 1", 4) == 0,
+          "line without pv");
+    check(parser.parse("info string multipv 1 score cp 3 pv a2a3", 4) == 0,
+          "string is free text");
+    const vector<Comm::PVInfo> &slots = parser.slots();
+    check(slots[1].depth == 12 && slots[1].eval == -35 && !slots[1].isMat
+          && slots[1].pv.size() == 3, "cp line parsed");
+    check(slots[0].isMat && slots[0].eval == 4 && slots[0].pv.size() == 2
+          && slots[0].pv[0] == Board::uciToPolyglot("e7e8q"),
+          "mate line parsed");
+    check(slots[2].pv.empty(), "untouched slot");
+    vector<Line> lines(3);
+    parser.toLines(lines);
+    check(lines[1].getMoves() == list<string>({"d2d4", "d7d5", "c2c4"})
+          && lines[1].getEval() == -35, "lines from slots");
+    check(lines[2].empty(), "empty line for untouched slot");
+
+    /*Once the storage has grown, parsing does not allocate*/
+    size_t before = allocations;
+    for (int i = 0; i < 100; i++) {
+        parser.parse(line2, 4);
+        parser.parse(line1, 4);
+    }
+    size_t allocated = allocations - before;
+    check(allocated == 0, "no allocation (" + to_string(allocated) + ")");
+    parser.clear(3);
+    check(parser.slots()[1].pv.empty(), "cleared");
+
+    /*Deferred mode : only the last line with a pv of each slot is parsed*/
+    parser.clear(3, true);
+    parser.add("info depth 12 multipv 1 score cp 10 pv e2e4 e7e5", 4);
+    parser.add("info depth 13 multipv 1 score cp 15 pv d2d4", 4);
+    parser.add(line2, 4);
+    parser.add("info depth 14 currmove e2e4 currmovenumber 1", 4);
+    parser.add("info string multipv 1 score cp 3 pv a2a3", 4);
+    check(slots[0].pv.empty() && slots[1].pv.empty(), "nothing parsed yet");
+    parser.flush();
+    check(slots[0].depth == 13 && slots[0].eval == 15
+          && slots[0].pv.size() == 1, "last line kept");
+    check(slots[1].depth == 12 && slots[1].pv.size() == 3,
+          "deferred cp line parsed");
+    check(slots[2].pv.empty(), "deferred untouched slot");
+    parser.add(line1, 4);
+    parser.flush();
+    check(slots[0].isMat && slots[1].depth == 12, "flushed lines not reparsed");
+
+    before = allocations;
+    for (int i = 0; i < 100; i++) {
+        parser.add(line2, 4);
+        parser.add(line1, 4);
+        parser.flush();
+    }
+    allocated = allocations - before;
+    check(allocated == 0, "no deferred allocation (" + to_string(allocated)
+          + ")");
+}
+
+void testEarlyStop(const string &dir)
+{
+    string rc = dir + "/earlystop.rc";
+    {
+        ofstream out(rc);
+        out << "[finder]\n"
+            << "    cutoff_threshold = 100\n"
+            << "    early_stop = true\n"
+            << "    early_stop_depth = 6\n"
+            << "    early_stop_iterations = 3\n";
+    }
+    Config conf(rc.c_str());
+    Options::getInstance().addConfig(conf);
+
+    Comm::InfoParser parser;
+    Comm::EarlyStop policy;
+    /*Whether stop would be sent after this line*/
+    auto info = [&parser, &policy](const string &line) {
+        unsigned int slot = parser.add(line, 4);
+        return slot && policy.update(slot, parser);
+    };
+
+    parser.clear(2);
+    policy.reset();
+    check(!info("info depth 4 multipv 1 score cp 150 pv e2e4")
+          && !info("info depth 5 multipv 1 score cp 150 pv e2e4")
+          && !info("info depth 6 multipv 2 score cp 150 pv d2d4"),
+          "no stop before enough depths");
+    check(info("info depth 6 multipv 1 score cp -120 pv e2e4")
+          && policy.stopped(), "stop beyond threshold");
+    check(!info("info depth 7 multipv 1 score cp 150 pv e2e4"),
+          "stop sent once");
+
+    parser.clear(2);
+    policy.reset();
+    check(!policy.stopped(), "reset");
+    check(!info("info depth 6 multipv 1 score cp 150 pv e2e4")
+          && !info("info depth 7 multipv 1 score cp 50 pv e2e4")
+          && !info("info depth 8 multipv 1 score cp 150 pv e2e4")
+          && !info("info depth 9 multipv 1 score cp 150 pv e2e4"),
+          "unstable verdict");
+    check(info("info depth 10 multipv 1 score cp 150 pv e2e4"),
+          "stop once stable");
+
+    parser.clear(2);
+    policy.reset();
+    check(!info("info depth 1 multipv 1 score mate 2 pv e2e4")
+          && !info("info depth 2 multipv 1 score mate 2 pv e2e4"),
+          "mate not stable yet");
+    check(info("info depth 3 multipv 1 score mate 2 pv e2e4"),
+          "mate stops before early_stop_depth");
+
+    parser.clear(2, true);
+    policy.reset();
+    check(!info("info depth 6 multipv 1 score cp 0 pv e2e4")
+          && !info("info depth 7 multipv 1 score cp 0 pv e2e4")
+          && info("info depth 8 multipv 1 score cp 0 pv e2e4"),
+          "draw, deferred parsing");
+    check(Comm::EarlyStop::verdict(parser.slots()[1]) == Comm::EarlyStop::NONE
+          && Comm::EarlyStop::verdict(parser.best())
+             == Comm::EarlyStop::DRAW, "verdicts");
+
+    parser.clear(3, true);
+    policy.reset();
+    check(!info("info depth 6 multipv 1 score cp 0 pv e2e4")
+          && !info("info depth 6 multipv 2 score cp -20 pv d2d4")
+          && !info("info depth 7 multipv 1 score cp 0 pv e2e4")
+          && !info("info depth 7 multipv 2 score cp -20 pv d2d4")
+          && !info("info depth 8 multipv 1 score cp 0 pv e2e4"),
+          "other lines not at the stop depth yet");
+    check(info("info depth 8 multipv 2 score cp -30 pv d2d4")
+          && policy.stopped() && parser.depth(1) == 8 && !parser.depth(2),
+          "stop once all the lines reached it");
+
+    /*Checked at depths 8, 12, 16... (mixed_start_depth and step)*/
+    parser.clear(1);
+    policy.reset(Comm::EarlyStop::MIXED);
+    check(info("info depth 8 multipv 1 score cp 300 pv e2e4"),
+          "mixed : not contested");
+    parser.clear(1);
+    policy.reset(Comm::EarlyStop::MIXED);
+    check(!info("info depth 8 multipv 1 score cp 120 pv e2e4")
+          && !info("info depth 11 multipv 1 score cp 300 pv e2e4")
+          && !info("info depth 12 multipv 1 score cp 300 pv e2e4"),
+          "mixed : close to the cutoff, then moved");
+    check(info("info depth 16 multipv 1 score cp 290 pv e2e4"),
+          "mixed : stable");
+}
+
+void testResultCache(const string &dir)
+{
+    Out::output("Testing result cache\n");
+    string file = dir + "/results.cache";
+    unlink(file.c_str());
+    uint64_t depth20 = Comm::ResultCache::settingsKey("Stockfish", "go depth 20",
+                                                      "8");
+    uint64_t depth21 = Comm::ResultCache::settingsKey("Stockfish", "go depth 21",
+                                                      "8");
+    check(depth20 != depth21, "settings keys differ");
+    check(Comm::ResultCache::settingsKey("ab", "c", "8")
+          != Comm::ResultCache::settingsKey("a", "bc", "8"),
+          "settings fields are separated");
+
+    vector<Line> result(4);
+    result[0] = Line(35, 20, {"e2e4", "e7e5", "g1f3"});
+    result[1] = Line(3, 19, {"e7e8q"}, true);
+    {
+        Comm::ResultCache cache(file);
+        check(cache.size() == 0, "new cache is empty");
+        cache.add(42, depth20, result);
+        cache.add(43, depth20, vector<Line>(4));
+        vector<Line> lines(4);
+        check(!cache.find(42, depth21, lines), "miss on other settings");
+        check(cache.find(42, depth20, lines)
+              && lines[0].getMoves() == result[0].getMoves()
+              && lines[0].getEval() == 35 && lines[0].getDepth() == 20
+              && lines[1].isMat() && lines[2].empty(), "hit");
+        check(cache.hits() == 1 && cache.misses() == 1, "hit statistics");
+        vector<Line> longLine(4);
+        longLine[0] = Line(0, 30, list<string>(300, "g1f3"));
+        cache.add(45, depth20, longLine);
+        check(!cache.find(45, depth20, lines), "too long lines not cached");
+    }
+    /*A record cut by a crash*/
+    {
+        ofstream os(file, ios::binary | ios::app);
+        os.write("\x2c\0\0\0\0\0", 6);
+    }
+    Comm::ResultCache cache(file);
+    vector<Line> lines(4, Line(1, 1, {"a2a3"}));
+    check(cache.size() == 2, "cache reloaded without the partial record");
+    check(cache.find(43, depth20, lines) && lines[0].empty(),
+          "stalemate result cleared the lines");
+    cache.add(44, depth21, result);
+    Comm::ResultCache reopened(file);
+    check(reopened.size() == 3 && reopened.find(44, depth21, lines)
+          && lines[1].firstMove() == "e7e8q", "appended after truncation");
+}
+
+/*An engine path can't take arguments, the mock is started by a script*/
+string mockScript(const string &dir, const string &name,
+                  const string &mockengine, const string &args)
+{
+    string file = dir + "/" + name + ".sh";
+    {
+        ofstream out(file);
+        out << "#!/bin/sh\nexec " << mockengine << " " << args << "\n";
+    }
+    chmod(file.c_str(), 0755);
+    return file;
+}
+
+const string startFen =
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+/*Search the starting position on engine id*/
+bool search(int id)
+{
+    Comm::UCICommunicatorPool &pool = Comm::UCICommunicatorPool::getInstance();
+    pool.queue(id, "position fen " + startFen);
+    return pool.sendAndWaitBestmove(id, "go depth 1");
+}
+
+bool hasLines(const vector<Line> &lines)
+{
+    return !lines.empty() && !lines[0].empty();
+}
+
+bool brokenFuture(future<vector<Line>> result)
+{
+    try {
+        result.get();
+    } catch (const future_error &e) {
+        return e.code() == future_errc::broken_promise;
+    }
+    return false;
+}
+
+void testPool(const string &dir, const string &mockengine)
+{
+    Out::output("Testing engine pool\n");
+    string rc = dir + "/pool.rc";
+    {
+        ofstream out(rc);
+        out << "[engine]\n"
+            << "    search_timeout = 1\n";
+    }
+    Config conf(rc.c_str());
+    Options::getInstance().addConfig(conf);
+    /*Writes to a dead engine fail instead*/
+    signal(SIGPIPE, SIG_IGN);
+    Comm::UCICommunicatorPool &pool = Comm::UCICommunicatorPool::getInstance();
+    Comm::EngineOptions options;
+    options["MultiPV"] = "2";
+
+    /*Before any engine is started here, the pool has no thread yet*/
+    string crashing = mockScript(dir, "crashing", mockengine, "-f crash");
+    pid_t child = fork();
+    if (child == 0) {
+        int id = pool.create<Comm::LocalUCICommunicator>(crashing, options);
+        for (int i = 0; i < 10; i++)
+            search(id);
+        _exit(EXIT_SUCCESS);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS,
+          "give up after MAX_RESTARTS");
+
+    string log = dir + "/options.log";
+    unlink(log.c_str());
+    int id = pool.create<Comm::LocalUCICommunicator>(
+            mockScript(dir, "logged", mockengine, "-L " + log), options);
+    pool.sendOption(id, "MultiPV", "2");
+    pool.sendOption(id, "MultiPV", "3");
+    pool.sendOption(id, "MultiPV", "3");
+    check(search(id) && pool.getResultLines(id)[1].firstMove() != "",
+          "search");
+    int multiPV = 0, three = 0;
+    {
+        ifstream in(log);
+        string line;
+        while (getline(in, line)) {
+            multiPV += line.find("setoption name MultiPV") == 0;
+            three += line == "setoption name MultiPV value 3";
+        }
+    }
+    check(multiPV == 2 && three == 1, "options only sent when changed");
+    check(hasLines(pool.submitSearch(id, startFen, "depth 1").get()),
+          "submitted search");
+    check(brokenFuture(pool.submitSearch(1000, "", "depth 1")),
+          "submitted to an unknown engine");
+
+    id = pool.create<Comm::LocalUCICommunicator>(
+            mockScript(dir, "crash2", mockengine, "-f crash -n 2"), options);
+    check(search(id) && !search(id) && search(id)
+          && hasLines(pool.getResultLines(id)), "restart on crash");
+
+    id = pool.create<Comm::LocalUCICommunicator>(
+            mockScript(dir, "hang", mockengine, "-f hang -n 2"), options);
+    check(search(id) && !search(id) && search(id)
+          && hasLines(pool.getResultLines(id)), "restart on timeout");
+
+    id = pool.create<Comm::LocalUCICommunicator>(
+            mockScript(dir, "deaf", mockengine, "-f deaf"), options);
+    check(search(id) && !search(id) && search(id)
+          && hasLines(pool.getResultLines(id)), "restart on a failed write");
+
+    /*Every other search of the first engine crashes*/
+    vector<int> ids;
+    ids.push_back(pool.create<Comm::LocalUCICommunicator>(
+            mockScript(dir, "crash2", mockengine, "-f crash -n 2"), options));
+    ids.push_back(pool.create<Comm::LocalUCICommunicator>(
+            mockScript(dir, "fine", mockengine, ""), options));
+    pool.dispatchOn(ids);
+    vector<string> fens(8, startFen);
+    vector<future<vector<Line>>> results = pool.evaluate(fens, "depth 1", 2);
+    bool allDone = true;
+    for (future<vector<Line>> &result : results)
+        allDone &= hasLines(result.get());
+    check(allDone, "failed evaluations searched again");
+
+    pool.destroyAll();
+    check(brokenFuture(pool.evaluate(fens[0], "depth 1")),
+          "evaluation after destroyAll");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3)
+        Err::handle("You must provide a directory for the test files,"
+                    " and optionally the mock engine");
+    string dir(argv[1]);
+
+    testStringView();
+    testLineReader();
+    testEventLoop();
+    testInfoParser();
+    testEarlyStop(dir);
+    testResultCache(dir);
+    if (argc == 3)
+        testPool(dir, argv[2]);
+
+    Out::output("End of tests\n");
+    Out::output("Test passed : " + to_string(tests - failures) + "/"
+                + to_string(tests) + "\n");
+    return (failures) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+#
+# Matfinder, a program to help chess engines to find mat
+#
+# Copyright© 2013 Philippe Virouleau
+#
+# You can contact me at firstname.lastname@imag.fr
+# (Replace "firstname" and "lastname" with my actual names)
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+ALL_TARGETS += testengine infobench
+CLEAN_TARGETS += clean-testengine
+CHECK_TARGETS += check-testengine
+
+
+testengine_SOURCES           := $(wildcard src/*.cpp)
+testengine_SOURCES_CXX       := $(wildcard tests/engine/*.cxx)
+testengine_HEADERS_DEP       := $(wildcard include/*.h)
+
+testengine_OBJECTS := $(testengine_SOURCES:.cpp=.o)
+testengine_OBJECTS += $(testengine_SOURCES_CXX:.cxx=.o)
+
+infobench_OBJECTS := $(testengine_SOURCES:.cpp=.o)
+infobench_OBJECTS += tests/engine/bench/infobench.o
+
+
+canonical_path := ../$(shell basename $(shell pwd -P))
+
+tests/engine/%.o: tests/engine/%.cxx $(testengine_HEADERS_DEP)
+	echo "[Engine Tester] CXX $<"
+	$(CXX) $(CPPFLAGS) $(CFLAGS) -c -o $@ ${canonical_path}/$<
+
+tests/engine/bench/%.o: tests/engine/bench/%.cxx $(testengine_HEADERS_DEP)
+	echo "[Engine Bench] CXX $<"
+	$(CXX) $(CPPFLAGS) $(CFLAGS) -c -o $@ ${canonical_path}/$<
+
+testengine: $(testengine_OBJECTS)
+	echo "[Engine Tester] Link tester"
+	$(CXX) -o $@ $^ $(LIBS) $(LDFLAGS)
+
+check-testengine: testengine mockengine
+	echo "[Engine Tester] Check 1"
+	mkdir -p tests/engine/output
+	./testengine tests/engine/output ./mockengine
+
+infobench: $(infobench_OBJECTS)
+	echo "[Engine Bench] Link infobench"
+	$(CXX) -o $@ $^ $(LIBS) $(LDFLAGS)
+
+bench-infobench: infobench
+	./infobench $(TRANSCRIPT)
+
+clean-testengine:
+	echo "[Engine Tester] Clean"
+	rm -f $(testengine_OBJECTS) testengine
+	rm -f tests/engine/bench/infobench.o infobench
+	rm -rf tests/engine/output
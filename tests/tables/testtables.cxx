@@ -0,0 +1,506 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Output.h"
+#include "Hashing.h"
+#include "TableIO.h"
+#include "BloomFilter.h"
+#include "TableCache.h"
+#include "ShardedTable.h"
+#include "Utils.h"
+
+using namespace std;
+
+int failures = 0;
+int tests = 0;
+
+void check(bool cond, const string &what)
+{
+    tests++;
+    if (!cond) {
+        failures++;
+        Out::output("Failed : " + what + "\n");
+    }
+}
+
+void writeTable(const string &file, uint16_t cutoff,
+                const map<uint64_t, uint32_t> &content)
+{
+    Table::Writer w(file, cutoff);
+    for (auto entry : content) {
+        Table::Entry e;
+        e.key = entry.first;
+        e.move = (uint16_t)entry.first;
+        e.learn = entry.second;
+        w.write(e);
+    }
+}
+
+map<uint64_t, Table::Entry> readTable(const string &file, uint16_t cutoff)
+{
+    map<uint64_t, Table::Entry> content;
+    Table::Reader r(file, cutoff);
+    Table::Entry e;
+    while (r.next(e))
+        content[e.key] = e;
+    return content;
+}
+
+void testMerge(const string &dir)
+{
+    Out::output("Testing merge\n");
+    map<uint64_t, uint32_t> t1, t2, t3;
+    /*Disjoint keys*/
+    for (uint64_t k = 1; k < 20000; k += 3)
+        t1[k] = Node::DRAW;
+    for (uint64_t k = 2; k < 20000; k += 3)
+        t2[k] = Node::AGAINST;
+    /*Conflicts*/
+    t1[30000] = Node::DRAW | Node::PENDING;
+    t2[30000] = Node::DRAW;
+    t3[30000] = Node::MATE | Node::US;
+    t1[30001] = Node::THRESHOLD | Node::US;
+    t3[30001] = Node::DRAW;
+    t2[30002] = Node::DRAW;
+    t3[30002] = Node::DRAW | Node::PENDING;
+    t3[UINT64_MAX] = Node::STALEMATE;
+
+    writeTable(dir + "/t1.bin", 150, t1);
+    writeTable(dir + "/t2.bin", 200, t2);
+    writeTable(dir + "/t3.bin", 150, t3);
+    vector<string> inputs = { dir + "/t1.bin", dir + "/t2.bin",
+                              dir + "/t3.bin" };
+    Table::MergeStat stat = Table::merge(inputs, dir + "/merged.bin", 150);
+    map<uint64_t, Table::Entry> merged = readTable(dir + "/merged.bin", 150);
+
+    check(stat.entries == merged.size(), "merge entry count");
+    check(merged.size() == t1.size() + t2.size() + t3.size() - 4,
+          "merged size");
+    check(stat.conflicts == 4, "conflict count");
+    check(merged[30000].learn == (Node::MATE | Node::US), "mate wins");
+    check(merged[30001].learn == (Node::THRESHOLD | Node::US),
+          "threshold wins over draw");
+    check(merged[30002].learn == Node::DRAW, "draw wins over pending");
+    check(merged[UINT64_MAX].learn == Node::STALEMATE, "last key kept");
+    check(merged[4].learn == Node::DRAW && merged[5].learn == Node::AGAINST,
+          "disjoint entries kept");
+    check(merged[5].move == 5, "move kept");
+}
+
+void testHashTable(const string &dir)
+{
+    Out::output("Testing HashTable round trip\n");
+    uint16_t cutoff = Options::getInstance().getCutoffThreshold();
+    HashTable *table = new HashTable(dir + "/hash.bin");
+    NodeArena *arena = table->newArena();
+    for (uint64_t k = 1; k <= 1000; k++) {
+        Node *n = arena->create(k * 7919, "", Node::DRAW);
+        n->safeAddMove("e2e4", arena);
+        table->findOrInsert(k * 7919, n);
+    }
+    table->toPolyglot(dir + "/hash.bin");
+    delete table;
+    map<uint64_t, Table::Entry> content = readTable(dir + "/hash.bin", cutoff);
+    check(content.size() == 1000, "exported size");
+    check(content[7919].move == Board::uciToPolyglot("e2e4"), "exported move");
+    check(content[7919].weight == 1, "exported draw weight");
+    table = HashTable::fromPolyglot(dir + "/hash.bin");
+    check(table->size() == 1000, "imported size");
+    Node *n = table->findVal(7919 * 2);
+    check(n && n->getStatus() == Node::DRAW, "imported status");
+    delete table;
+}
+
+size_t fileSize(const string &file)
+{
+    ifstream is(file, ios::binary | ios::ate);
+    return is.tellg();
+}
+
+bool sameEntries(const map<uint64_t, Table::Entry> &lhs,
+                 const map<uint64_t, Table::Entry> &rhs)
+{
+    if (lhs.size() != rhs.size())
+        return false;
+    for (auto a = lhs.begin(), b = rhs.begin(); a != lhs.end(); ++a, ++b)
+        if (a->first != b->first || a->second.move != b->second.move
+            || a->second.weight != b->second.weight
+            || a->second.learn != b->second.learn)
+            return false;
+    return true;
+}
+
+void testBlockTable(const string &dir)
+{
+    Out::output("Testing block tables\n");
+    uint16_t cutoff = Options::getInstance().getCutoffThreshold();
+    const uint32_t statuses[] = { Node::DRAW, Node::AGAINST, Node::DRAW,
+                                  Node::MATE | Node::US, Node::STALEMATE,
+                                  Node::THRESHOLD | Node::US };
+    vector<Table::Entry> entries;
+    uint64_t key = 0xFEDCBA987654321ULL;
+    for (int i = 0; i < 50000; i++) {
+        key ^= key << 13;
+        key ^= key >> 7;
+        key ^= key << 17;
+        Table::Entry e;
+        e.key = key;
+        e.learn = statuses[i % 6];
+        e.weight = (e.learn == Node::DRAW || e.learn == Node::STALEMATE);
+        if (e.learn != Node::AGAINST)
+            e.move = Board::uciToPolyglot((i % 2) ? "e2e4" : "g1f3");
+        entries.push_back(e);
+    }
+    sort(entries.begin(), entries.end(),
+         [](const Table::Entry &a, const Table::Entry &b) {
+             return a.key < b.key;
+         });
+    /*Extreme keys, and a block which can't be packed (weight)*/
+    entries.front().key = 1;
+    entries.back().key = UINT64_MAX;
+    entries[300].weight = 42;
+    {
+        Table::Writer bin(dir + "/block.bin", cutoff);
+        Table::Writer cbt(dir + "/block.cbt", cutoff,
+                          Table::formatFromFilename(dir + "/block.cbt"));
+        for (const Table::Entry &e : entries) {
+            bin.write(e);
+            cbt.write(e);
+        }
+    }
+    map<uint64_t, Table::Entry> fromBin = readTable(dir + "/block.bin", cutoff);
+    map<uint64_t, Table::Entry> fromCbt = readTable(dir + "/block.cbt", cutoff);
+    check(fromBin.size() == entries.size(), "polyglot size");
+    check(sameEntries(fromBin, fromCbt), "block round trip");
+    double ratio = (double)fileSize(dir + "/block.bin")
+                   / fileSize(dir + "/block.cbt");
+    Out::output("Compression ratio : " + to_string(ratio) + "\n", 1);
+    check(ratio > 1.8, "block compression (" + to_string(ratio) + ")");
+
+    Table::BlockTable blocks(dir + "/block.cbt", cutoff);
+    check(blocks.entries() == entries.size(), "block entry count");
+    bool allFound = true;
+    for (size_t i = 0; i < entries.size(); i += 7) {
+        Table::Entry e;
+        allFound &= blocks.find(entries[i].key, e)
+                    && e.learn == entries[i].learn
+                    && e.move == entries[i].move
+                    && e.weight == entries[i].weight;
+    }
+    check(allFound, "block lookup");
+    Table::Entry e;
+    check(!blocks.find(0, e) && !blocks.find(entries[10].key + 1, e),
+          "block lookup misses");
+
+    /*Deltas far from the block average, and a tiny block*/
+    vector<uint64_t> odd;
+    for (uint64_t k = 1; k < 256; k++)
+        odd.push_back(k);
+    odd.push_back(U64(1) << 63);
+    odd.push_back((U64(1) << 63) + 1);
+    odd.push_back(UINT64_MAX);
+    {
+        Table::Writer w(dir + "/odd.cbt", cutoff, Table::BLOCK);
+        for (uint64_t k : odd) {
+            Table::Entry oddEntry;
+            oddEntry.key = k;
+            oddEntry.learn = Node::AGAINST;
+            w.write(oddEntry);
+        }
+    }
+    map<uint64_t, Table::Entry> oddContent = readTable(dir + "/odd.cbt",
+                                                       cutoff);
+    bool oddSame = oddContent.size() == odd.size();
+    for (uint64_t k : odd)
+        oddSame &= oddContent.count(k) == 1;
+    check(oddSame, "block extreme deltas");
+    Table::BlockTable oddBlocks(dir + "/odd.cbt", cutoff);
+    check(oddBlocks.find(U64(1) << 63, e) && oddBlocks.find(UINT64_MAX, e)
+          && !oddBlocks.find(256, e), "block extreme lookups");
+
+    /*Mixed formats in a merge*/
+    vector<string> inputs = { dir + "/block.cbt", dir + "/t1.bin" };
+    Table::merge(inputs, dir + "/mergedblock.cbt", cutoff);
+    map<uint64_t, Table::Entry> merged = readTable(dir + "/mergedblock.cbt",
+                                                   cutoff);
+    map<uint64_t, Table::Entry> expected = readTable(dir + "/t1.bin", cutoff);
+    expected.insert(fromCbt.begin(), fromCbt.end());
+    check(merged.size() == expected.size(), "block merge");
+
+    /*Lazy loading through HashTable*/
+    HashTable *table = HashTable::load(dir + "/block.cbt");
+    check(table->size() == 0 && table->storedEntries() == entries.size(),
+          "lazy load");
+    Node *n = table->probe(entries[1000].key);
+    check(n && (uint32_t)n->getStatus() == entries[1000].learn
+          && table->size() == 1, "lazy probe");
+    check(!table->probe(entries[1000].key + 1), "lazy probe miss");
+    NodeArena *arena = table->newArena();
+    Node *fresh = arena->create(2, "", Node::PENDING);
+    check(table->findOrInsert(entries[2000].key, fresh) != fresh,
+          "stored entry wins");
+    check(table->findOrInsert(2, fresh) == fresh, "new entry inserted");
+    table->save(dir + "/block2.cbt");
+    delete table;
+    table = HashTable::load(dir + "/block2.cbt");
+    check(table->storedEntries() == entries.size() + 1, "lazy save");
+    delete table;
+}
+
+void testTableCache(const string &dir)
+{
+    Out::output("Testing table cache\n");
+    uint16_t cutoff = Options::getInstance().getCutoffThreshold();
+    /*A tiny budget : every table is dropped as soon as it is released*/
+    TableCache cache(1);
+    cache.addFile("a", dir + "/hash.bin");
+    uint64_t serial = 0;
+    {
+        TableCache::Pin p = cache.acquire("a", "");
+        TableCache::Pin q = cache.acquire("a", "");
+        check(p.get() && p->size() == 1000, "lazy table load");
+        check(p.get() == q.get() && p.serial() == q.serial(),
+              "pinned table shared");
+        serial = p.serial();
+    }
+    TableCache::Pin p = cache.acquire("a", "");
+    check(p.get() && p.serial() != serial, "released table dropped");
+    p.release();
+
+    string newFile = dir + "/cache.bin";
+    remove(newFile.c_str());
+    {
+        TableCache::Pin b = cache.acquire("b", newFile);
+        check(b.get() && b->size() == 0, "new table created");
+        NodeArena *arena = b->newArena();
+        b->findOrInsert(42, arena->create(42, "", Node::DRAW));
+    }
+    check(readTable(newFile, cutoff).size() == 1, "dropped table autosaved");
+    TableCache::Pin b = cache.acquire("b", newFile);
+    check(b.get() && b->findVal(42), "dropped table reloaded");
+}
+
+void testShardedTable(const string &dir)
+{
+    Out::output("Testing sharded table\n");
+    uint16_t cutoff = Options::getInstance().getCutoffThreshold();
+    map<uint64_t, uint32_t> content;
+    for (uint64_t k = 1; k <= 2000; k++)
+        content[k * 0x9E3779B97F4A7C15ULL] = Node::DRAW;
+    writeTable(dir + "/sharded-in.bin", cutoff, content);
+    string spill = dir + "/spill";
+    {
+        /*A tiny budget : every shard is spilled as soon as it is released*/
+        ShardedTable table(4, 1, spill);
+        table.load(dir + "/sharded-in.bin");
+        check(table.shardOf(0xF000000000000001ULL) == 15, "shard by prefix");
+        check(Utils::filesFromDir(spill, Table::BLOCK_EXTENSION).size() == 16,
+              "input split in shards");
+        bool allFound = true;
+        for (auto entry : content) {
+            TableCache::Pin shard = table.acquire(entry.first);
+            allFound &= shard->probe(entry.first) != nullptr;
+        }
+        check(allFound, "positions found in spilled shards");
+        /*New positions in every shard, spilled and brought back*/
+        for (uint64_t s = 0; s < 16; s++) {
+            uint64_t key = (s << 60) | 42;
+            TableCache::Pin shard = table.acquire(key);
+            shard->findOrInsert(key, shard->newArena()->create(key, "",
+                                                               Node::DRAW));
+            content[key] = Node::DRAW;
+        }
+        TableCache::Pin shard = table.acquire((7ULL << 60) | 42);
+        check(shard->probe((7ULL << 60) | 42), "new position spilled");
+        shard.release();
+        string out = dir + "/sharded-out.bin";
+        /*Loaded back from its shard files only if it doesn't exist*/
+        unlink(out.c_str());
+        table.save(out);
+        map<uint64_t, Table::Entry> saved;
+        for (unsigned int i = 0; i < table.shardCount(); i++) {
+            map<uint64_t, Table::Entry> part =
+                readTable(table.savedFile(out, i), cutoff);
+            saved.insert(part.begin(), part.end());
+        }
+        bool same = saved.size() == content.size();
+        for (auto entry : content)
+            same &= saved.count(entry.first)
+                    && saved[entry.first].learn == entry.second;
+        check(same, "shards saved in their own file");
+        /*Only the shards acquired since the last save are written again*/
+        unlink(table.savedFile(out, 3).c_str());
+        uint64_t key = (7ULL << 60) | 43;
+        shard = table.acquire(key);
+        shard->findOrInsert(key, shard->newArena()->create(key, "",
+                                                           Node::DRAW));
+        content[key] = Node::DRAW;
+        shard.release();
+        table.save(out);
+        struct stat st;
+        check(stat(table.savedFile(out, 3).c_str(), &st) != 0
+              && readTable(table.savedFile(out, 7), cutoff).count(key),
+              "unchanged shards skipped");
+    }
+    check(Utils::filesFromDir(spill, Table::BLOCK_EXTENSION).empty(),
+          "spill files removed");
+    {
+        ShardedTable table(4, 0, spill);
+        table.load(dir + "/sharded-out.bin");
+        bool allFound = true;
+        for (auto entry : content) {
+            if ((entry.first >> 60) == 3)
+                continue;
+            TableCache::Pin shard = table.acquire(entry.first);
+            allFound &= shard->probe(entry.first) != nullptr;
+        }
+        check(allFound, "shard files loaded");
+    }
+    check(Utils::filesFromDir(spill, Table::BLOCK_EXTENSION).empty(),
+          "spill files removed");
+}
+
+void testBloom()
+{
+    Out::output("Testing bloom filter\n");
+    BloomFilter bloom(100000, 0.01);
+    uint64_t key = 0x123456789ABCDEFULL;
+    vector<uint64_t> keys;
+    for (int i = 0; i < 100000; i++) {
+        /*xorshift, to get Zobrist-like keys*/
+        key ^= key << 13;
+        key ^= key >> 7;
+        key ^= key << 17;
+        keys.push_back(key);
+        bloom.add(key);
+    }
+    bool allFound = true;
+    for (uint64_t k : keys)
+        allFound &= bloom.mayContain(k);
+    check(allFound, "no false negative");
+    int falsePositives = 0;
+    for (int i = 0; i < 100000; i++) {
+        key ^= key << 13;
+        key ^= key >> 7;
+        key ^= key << 17;
+        falsePositives += bloom.mayContain(key);
+    }
+    /*Blocked filters are a bit worse than the theoretical rate*/
+    check(falsePositives < 2000, "false positive rate ("
+          + to_string(falsePositives) + "/100000)");
+
+    /*The same keys in a filter sized for a hundredth of them*/
+    BloomFilter small(1000, 0.01);
+    for (uint64_t k : keys)
+        small.add(k);
+    check(small.stages() > 1, "full filter grows");
+    allFound = true;
+    for (uint64_t k : keys)
+        allFound &= small.mayContain(k);
+    check(allFound, "no false negative after growing");
+    falsePositives = 0;
+    for (int i = 0; i < 100000; i++) {
+        key ^= key << 13;
+        key ^= key >> 7;
+        key ^= key << 17;
+        falsePositives += small.mayContain(key);
+    }
+    /*The chain stays under twice the target*/
+    check(falsePositives < 4000, "false positive rate after growing ("
+          + to_string(falsePositives) + "/100000)");
+}
+
+void writeBlockTable(const string &file, const vector<uint64_t> &keys)
+{
+    Table::Writer w(file, Options::getInstance().getCutoffThreshold(),
+                    Table::BLOCK);
+    for (uint64_t k : keys) {
+        Table::Entry e;
+        e.key = k;
+        e.learn = Node::AGAINST;
+        w.write(e);
+    }
+}
+
+void testSavedBloom(const string &dir)
+{
+    Out::output("Testing saved bloom filters\n");
+    string file = dir + "/bloom.cbt";
+    string saved = Table::bloomFile(file);
+    vector<uint64_t> keys;
+    for (uint64_t k = 1; k <= 20000; k++)
+        keys.push_back(k * 1000003);
+    writeBlockTable(file, keys);
+    check(fileSize(saved) > 0, "filter saved with the block table");
+
+    HashTable *table = HashTable::load(file);
+    table->enableBloom();
+    check(table->blockDecodes() == 0, "saved filter mapped without decoding");
+    bool allFound = true;
+    for (uint64_t k : keys)
+        allFound &= table->bloom()->mayContain(k);
+    check(allFound, "mapped filter has the keys");
+    delete table;
+
+    /*A filter saved for another version of the table must not be used*/
+    rename(saved.c_str(), (saved + ".old").c_str());
+    keys.resize(10000);
+    writeBlockTable(file, keys);
+    rename((saved + ".old").c_str(), saved.c_str());
+    table = HashTable::load(file);
+    table->enableBloom();
+    check(table->blockDecodes() > 0, "stale filter rebuilt");
+    delete table;
+    table = HashTable::load(file);
+    table->enableBloom();
+    check(table->blockDecodes() == 0, "rebuilt filter saved");
+    delete table;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+        Err::handle("You must provide a directory for the test tables");
+    string dir(argv[1]);
+
+    testMerge(dir);
+    testHashTable(dir);
+    testBlockTable(dir);
+    testTableCache(dir);
+    testShardedTable(dir);
+    testBloom();
+    testSavedBloom(dir);
+
+    Out::output("End of tests\n");
+    Out::output("Test passed : " + to_string(tests - failures) + "/"
+                + to_string(tests) + "\n");
+    return (failures) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#
+# Matfinder, a program to help chess engines to find mat
+#
+# Copyright© 2013 Philippe Virouleau
+#
+# You can contact me at firstname.lastname@imag.fr
+# (Replace "firstname" and "lastname" with my actual names)
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+ALL_TARGETS += testtables
+CLEAN_TARGETS += clean-testtables
+CHECK_TARGETS += check-testtables
+
+
+testtables_SOURCES           := $(wildcard src/*.cpp)
+testtables_SOURCES_CXX       := $(wildcard tests/tables/*.cxx)
+testtables_HEADERS_DEP       := $(wildcard include/*.h)
+
+testtables_OBJECTS := $(testtables_SOURCES:.cpp=.o)
+testtables_OBJECTS += $(testtables_SOURCES_CXX:.cxx=.o)
+
+
+canonical_path := ../$(shell basename $(shell pwd -P))
+
+tests/tables/%.o: tests/tables/%.cxx $(testtables_HEADERS_DEP)
+	echo "[Tables Tester] CXX $<"
+	$(CXX) $(CPPFLAGS) $(CFLAGS) -c -o $@ ${canonical_path}/$<
+
+testtables: $(testtables_OBJECTS)
+	echo "[Tables Tester] Link tester"
+	$(CXX) -o $@ $^ $(LIBS) $(LDFLAGS)
+
+check-testtables: testtables
+	echo "[Tables Tester] Check 1"
+	mkdir -p tests/tables/output
+	./testtables tests/tables/output
+
+clean-testtables:
+	echo "[Tables Tester] Clean"
+	rm -f $(testtables_OBJECTS) testtables
+	rm -rf tests/tables/output
@@ -0,0 +1,279 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "Output.h"
+#include "Options.h"
+#include "ConfigParser.h"
+#include "Utils.h"
+
+using namespace std;
+
+/*
+ * Run engines for finders on other hosts (see remote_engines) : each
+ * connection gets a new engine, whose standard input and output are
+ * relayed to the socket. The engine is killed when the connection is
+ * closed. There is no authentication, only listen on trusted networks.
+ */
+
+string usage()
+{
+    ostringstream oss;
+    oss << "Usage : engined [options]\n";
+    oss << "\n";
+    oss << "Options\n";
+    oss << "    --engine=path, -e path\n";
+    oss << "        The engine to run (default is the engine path from the\n";
+    oss << "        configuration).\n";
+    oss << "    --port=port, -p port\n";
+    oss << "        The port to listen on (default is 7878).\n";
+    oss << "    --bind=address, -b address\n";
+    oss << "        The address to listen on (default is 127.0.0.1, use\n";
+    oss << "        0.0.0.0 to accept finders from other hosts).\n";
+    oss << "    --config_file=file, -c file\n";
+    oss << "        Gives an additional configuration file.\n";
+    oss << "    --verbose=level, -v level\n";
+    oss << "        Defines the verbose level.\n";
+    oss << "    --help, -h\n";
+    oss << "        Show this help message.\n";
+    return oss.str();
+}
+
+/*SIGPIPE is ignored, a closed peer is reported as an error*/
+static bool writeAll(int fd, const char *buf, size_t size)
+{
+    while (size) {
+        ssize_t written = write(fd, buf, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += written;
+        size -= written;
+    }
+    return true;
+}
+
+/*Relay between the socket and a new engine, until one of them is done*/
+static void serve(int sock, const string engine, const string peer)
+{
+    int in[2], out[2], err[2];
+    if (Utils::pipeCloexec(in) || Utils::pipeCloexec(out)
+        || Utils::pipeCloexec(err)) {
+        Err::output("pipe() : Error creating the pipes for " + peer);
+        close(sock);
+        return;
+    }
+    string name = engine.substr(engine.find_last_of("/") + 1);
+    pid_t pid;
+    int rc = Utils::spawnProcess(engine, name, in[0], out[1], err[1], pid);
+    close(in[0]);
+    close(out[1]);
+    close(err[1]);
+    if (rc) {
+        Err::output("Engine execution failed : " + engine + " ("
+                    + to_string(rc) + ")");
+        close(in[1]);
+        close(out[0]);
+        close(err[0]);
+        close(sock);
+        return;
+    }
+    Out::output("Engine " + to_string(pid) + " started for " + peer + "\n", 1);
+
+    char buf[65536];
+    struct pollfd fds[3] = {{sock, POLLIN, 0}, {out[0], POLLIN, 0},
+                            {err[0], POLLIN, 0}};
+    bool done = false;
+    while (!done) {
+        if (poll(fds, (fds[2].fd < 0) ? 2 : 3, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < 3 && !done; i++) {
+            if (fds[i].fd < 0 || !fds[i].revents)
+                continue;
+            ssize_t size = read(fds[i].fd, buf, sizeof(buf));
+            if (size < 0 && errno == EINTR)
+                continue;
+            if (i == 2) {
+                /*Engine's stderr stays on this host*/
+                if (size <= 0) {
+                    close(err[0]);
+                    fds[2].fd = err[0] = -1;
+                } else {
+                    Out::output(name + " (stderr) : " + string(buf, size), 2);
+                }
+                continue;
+            }
+            int to = (i == 0) ? in[1] : sock;
+            done = size <= 0 || !writeAll(to, buf, size);
+        }
+    }
+
+    /*Let the engine quit on end of file, then kill it*/
+    close(in[1]);
+    close(sock);
+    int status;
+    for (int i = 0; i < 10 && !waitpid(pid, &status, WNOHANG); i++)
+        usleep(100000);
+    if (!waitpid(pid, &status, WNOHANG)) {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    close(out[0]);
+    if (err[0] >= 0)
+        close(err[0]);
+    Out::output("Engine " + to_string(pid) + " for " + peer + " exited\n", 1);
+}
+
+int main(int argc, char **argv)
+{
+    const static struct option long_options[] =
+    {
+        {"help", no_argument, 0, 'h'},
+        {"verbose", required_argument, 0, 'v'},
+        {"engine", required_argument, 0, 'e'},
+        {"port", required_argument, 0, 'p'},
+        {"bind", required_argument, 0, 'b'},
+        {"config_file", required_argument, 0, 'c'},
+        {0, 0, 0, 0}
+    };
+
+    Options &opt = Options::getInstance();
+    try {
+        Config defconf;
+        opt.addConfig(defconf);
+    } catch (...) {
+        Out::output("No default configuration file found\n", 1);
+    }
+
+    int c;
+    int option_index = 0;
+    string engine;
+    string port = "7878";
+    string bindAddress = "127.0.0.1";
+    while ((c = getopt_long(argc, argv, "hv:e:p:b:c:",
+                            long_options, &option_index)) != -1) {
+        switch (c) {
+            case 'v':
+                try {
+                    opt.setVerboseLevel(stoi(optarg));
+                } catch (...) {
+                    Err::handle("Error parsing verbose level");
+                }
+                break;
+            case 'e':
+                engine = optarg;
+                break;
+            case 'p':
+                port = optarg;
+                break;
+            case 'b':
+                bindAddress = optarg;
+                break;
+            case 'c':
+                try {
+                    Config user(optarg);
+                    opt.addConfig(user);
+                } catch (...) {
+                    Err::handle("Unable to load user-defined configuration file");
+                }
+                break;
+            case 'h':
+                Out::output(usage());
+                exit(EXIT_SUCCESS);
+            case '?':
+                exit(EXIT_FAILURE);
+            default:
+                abort();
+        }
+    }
+    if (optind != argc) {
+        Err::output(usage());
+        exit(EXIT_FAILURE);
+    }
+    if (engine.empty())
+        engine = opt.getEngineFullpath();
+    /*A finder going away must not kill the daemon*/
+    signal(SIGPIPE, SIG_IGN);
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *address;
+    int rc = getaddrinfo(bindAddress.c_str(), port.c_str(), &hints, &address);
+    if (rc)
+        Err::handle("engined : " + string(gai_strerror(rc)));
+    int server = socket(address->ai_family, address->ai_socktype,
+                        address->ai_protocol);
+    if (server < 0)
+        Err::handle("socket()", errno);
+    fcntl(server, F_SETFD, FD_CLOEXEC);
+    int one = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(server, address->ai_addr, address->ai_addrlen)
+        || listen(server, 16))
+        Err::handle("Unable to listen on " + bindAddress + ":" + port);
+    freeaddrinfo(address);
+    Out::output("Serving " + engine + " on " + bindAddress + ":" + port
+                + "\n");
+
+    while (true) {
+        struct sockaddr_storage peerAddress;
+        socklen_t peerSize = sizeof(peerAddress);
+        int sock = accept(server, (struct sockaddr *)&peerAddress, &peerSize);
+        if (sock < 0) {
+            if (errno != EINTR)
+                Err::output("accept() : " + to_string(errno));
+            continue;
+        }
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        char host[NI_MAXHOST], service[NI_MAXSERV];
+        string peer = "unknown peer";
+        if (!getnameinfo((struct sockaddr *)&peerAddress, peerSize, host,
+                         sizeof(host), service, sizeof(service),
+                         NI_NUMERICHOST | NI_NUMERICSERV))
+            peer = string(host) + ":" + service;
+        thread(serve, sock, engine, peer).detach();
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#
+# Matfinder, a program to help chess engines to find mat
+#
+# Copyright© 2013 Philippe Virouleau
+#
+# You can contact me at firstname.lastname@imag.fr
+# (Replace "firstname" and "lastname" with my actual names)
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+ALL_TARGETS += engined
+CLEAN_TARGETS += clean-engined
+
+engined_SOURCES           := $(wildcard src/*.cpp)
+engined_SOURCES_CXX       := $(wildcard tools/engined/*.cxx)
+engined_HEADERS_DEP       := $(wildcard include/*.h)
+
+engined_OBJECTS := $(engined_SOURCES:.cpp=.o)
+engined_OBJECTS += $(engined_SOURCES_CXX:.cxx=.o)
+
+
+canonical_path := ../$(shell basename $(shell pwd -P))
+
+tools/engined/%.o: tools/engined/%.cxx $(engined_HEADERS_DEP)
+	echo "[engined] CXX $<"
+	$(CXX) $(CPPFLAGS) $(CFLAGS) -c -o $@ ${canonical_path}/$<
+
+engined: $(engined_OBJECTS)
+	echo "[engined] Link engined"
+	$(CXX) -o $@ $^ $(LIBS) $(LDFLAGS)
+
+clean-engined:
+	echo "[engined] Clean"
+	rm -f $(engined_OBJECTS) engined
@@ -0,0 +1,74 @@
+#!/bin/bash
+#
+# Runs matfinder and oraclefinder on the gardner positions with 1 to 64 mock
+# engines, and reports the searches per second and the lock contention.
+# Usage : tools/mockengine/finderbench.sh [engine numbers]
+# The think time of the mock engine (ms) can be set with LATENCY.
+#
+
+ENGINES=${@:-1 2 4 8 16 32 64}
+LATENCY=${LATENCY:-10}
+ROOT=`pwd`
+OUT=$ROOT/bench_finders
+
+rm -rf $OUT
+mkdir -p $OUT
+
+# The engine path can't take arguments
+engine()
+{
+    cat > $1 <<EOF
+#!/bin/sh
+exec $ROOT/mockengine -V gardner -l $LATENCY $2
+EOF
+    chmod +x $1
+}
+
+# $1 : file, $2 : engine, $3 : engine number, $4 : tables folder
+config()
+{
+    cat > $1 <<EOF
+[engine]
+    path = $2
+    variant = gardner
+[finder]
+    engine_number = $3
+    verbose_level = 1
+    cutoff_threshold = 150
+[matfinder]
+    lines = 2
+    mate_threshold = 800
+    split_subtrees = true
+[oraclefinder]
+    oracle_side = white
+    table_folder = $4
+EOF
+}
+
+# The ramp closes all the matfinder lines within a few moves, the clock
+# keeps the oracle lines balanced for a few moves only
+engine $OUT/matengine.sh "-e ramp -g 200"
+engine $OUT/oracleengine.sh "-e clock -g 25"
+
+# $1 : finder, $2 : engine number, $3 : positions
+run()
+{
+    local dir=$OUT/$1-$2
+    mkdir -p $dir/tables
+    config $dir/rc $OUT/${1/finder/engine}.sh $2 $dir/tables
+    ./$1 -c $dir/rc -f $3 > $dir/output 2>&1
+    if [ $? -ne 0 ]; then
+        echo "$1 failed with $2 engines, see $dir/output"
+        return
+    fi
+    local stats=`grep "^\[Stats\] [0-9]* searches" $dir/output`
+    printf "%-13s %8s %9s %10s %11s\n" $1 $2 \
+        `echo $stats | sed 's/.*\] \([0-9]*\) searches in \([0-9.]*\) s (\([0-9]*\) .*/\1 \2 \3/'`
+    grep "^\[Stats\] Lock" $dir/output | sed 's/\[Stats\] /    /'
+}
+
+printf "%-13s %8s %9s %10s %11s\n" finder engines searches time searches/s
+for n in $ENGINES; do
+    run matfinder $n position_files/gardner/black_win.fen
+    run oraclefinder $n position_files/gardner/valid_pos2
+done
@@ -0,0 +1,458 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <getopt.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "Movegen.h"
+#include "Options.h"
+#include "Output.h"
+#include "SimpleChessboard.h"
+
+using namespace std;
+using namespace Board;
+
+/*
+ * A deterministic UCI engine, to run the finders without a real engine :
+ * each root move is scored with one ply and a pluggable evaluation, and the
+ * scores of the searched positions are kept like a transposition table
+ * would (so that the finders can backtrack as with a real engine).
+ * The think time is the same for every search, whatever the go limits, and
+ * the info lines of each depth are spread over it.
+ */
+
+string usage()
+{
+    ostringstream oss;
+    oss << "Usage : mockengine [options]\n";
+    oss << "\n";
+    oss << "Options\n";
+    oss << "    --eval=name, -e name\n";
+    oss << "        The evaluation of the positions, one of\n";
+    oss << "        material (default), ramp, clock or zero.\n";
+    oss << "        ramp adds growth centipawns per move for white to the\n";
+    oss << "        material, so that every line ends up above the\n";
+    oss << "        thresholds. clock only counts the moves.\n";
+    oss << "    --growth=cp, -g cp\n";
+    oss << "        Centipawns per move for ramp and clock (default 50).\n";
+    oss << "    --latency=ms, -l ms\n";
+    oss << "        The think time of each search (default 0).\n";
+    oss << "    --depth=depth, -d depth\n";
+    oss << "        Number of info lines per multipv (default 5).\n";
+    oss << "    --variant=name, -V name\n";
+    oss << "        standard (default), gardner or losalamos.\n";
+    oss << "    --fault=kind, -f kind\n";
+    oss << "        Fail at the search given by -n, to test the finders :\n";
+    oss << "        crash exits when receiving go, hang ignores it, deaf\n";
+    oss << "        closes its input, answers and waits forever.\n";
+    oss << "    --search=n, -n n\n";
+    oss << "        The search of this process which fails (default 1).\n";
+    oss << "    --log=file, -L file\n";
+    oss << "        Append the commands received to file.\n";
+    oss << "    --help, -h\n";
+    oss << "        Show this help message.\n";
+    return oss.str();
+}
+
+typedef function<int(Position &)> Evaluation;
+
+/*Keeps apart the lines of equal value*/
+static int jitter(Position &pos)
+{
+    return (int)(pos.hash() % 17) - 8;
+}
+
+/*White's point of view, in centipawns*/
+static int material(Position &pos)
+{
+    static const int value[] = {0, 100, 300, 300, 500, 900, 0};
+    int score = 0;
+    for (Color c : {WHITE, BLACK})
+        for (Square s : pos.pieces_squares(c))
+            score += (c == WHITE ? 1 : -1) * value[kind_of(pos.piece_on(s))];
+    return score + jitter(pos);
+}
+
+static int fullmove(Position &pos)
+{
+    string fen = pos.fen();
+    return atoi(fen.substr(fen.find_last_of(' ') + 1).c_str());
+}
+
+static int growth = 50;
+
+/*
+ * The finders only send fens, so the engine never sees repetitions : the
+ * move number is part of the key, else shuffling lines would be scored
+ * forever with the value of their first occurrence.
+ */
+static uint64_t tableKey(Position &pos)
+{
+    return pos.hash() ^ (fullmove(pos) * 0x9E3779B97F4A7C15ULL);
+}
+
+static const map<string, Evaluation> evaluations = {
+    {"material", material},
+    {"ramp", [](Position &pos) {
+        return material(pos) + growth * fullmove(pos);
+    }},
+    {"clock", [](Position &pos) {
+        return growth * fullmove(pos) + jitter(pos);
+    }},
+    {"zero", [](Position &) { return 0; }}
+};
+
+/*Scores are from the side to move, mates are MATE minus the plies*/
+static const int MATE = 32000;
+static const int MATE_BOUND = MATE - 1000;
+
+class MockEngine {
+    public:
+        MockEngine(Evaluation eval, int latency, int depth,
+                   const string &fault, int failAt, const string &log) :
+            eval_(eval), latency_(latency), depth_(depth), fault_(fault),
+            failAt_(failAt)
+        {
+            if (!log.empty())
+                log_.open(log, ios::app);
+        }
+        void run();
+    private:
+        /*Return false on quit*/
+        bool command(const string &line);
+        void go(istringstream &is);
+        /*Wait for ms, or until stop. Return false on quit*/
+        bool think(int ms, bool &stopped);
+        bool readLine(string &line, int timeout);
+        int score(Position &pos);
+        static string uciScore(int score);
+
+        Evaluation eval_;
+        const int latency_;
+        const int depth_;
+        const string fault_;
+        const int failAt_;
+        int searches_ = 0;
+        ofstream log_;
+        unsigned int multiPV_ = 1;
+        Position pos_;
+        unordered_map<uint64_t, int> table_;
+        string input_;
+        deque<string> pending_;
+        bool quit_ = false;
+};
+
+void MockEngine::run()
+{
+    string line;
+    while (!quit_) {
+        if (!pending_.empty()) {
+            line = pending_.front();
+            pending_.pop_front();
+        } else if (!readLine(line, -1)) {
+            break;
+        }
+        if (!command(line))
+            break;
+    }
+}
+
+bool MockEngine::readLine(string &line, int timeout)
+{
+    size_t end;
+    while ((end = input_.find('\n')) == string::npos) {
+        struct pollfd fd = {0, POLLIN, 0};
+        if (poll(&fd, 1, timeout) <= 0)
+            return false;
+        char buf[4096];
+        ssize_t size = read(0, buf, sizeof(buf));
+        if (size <= 0) {
+            quit_ = true;
+            return false;
+        }
+        input_.append(buf, size);
+    }
+    line = input_.substr(0, end);
+    input_.erase(0, end + 1);
+    return true;
+}
+
+bool MockEngine::command(const string &line)
+{
+    istringstream is(line);
+    string token;
+    is >> token;
+    if (log_.is_open())
+        log_ << line << endl;
+    if (token == "uci") {
+        cout << "id name mockengine\n"
+             << "option name MultiPV type spin default 1 min 1 max 500\n"
+             << "uciok" << endl;
+    } else if (token == "isready") {
+        cout << "readyok" << endl;
+    } else if (token == "setoption") {
+        string name, value;
+        is >> token >> name >> token >> value;
+        if (name == "MultiPV")
+            multiPV_ = max(1, atoi(value.c_str()));
+    } else if (token == "ucinewgame") {
+        table_.clear();
+    } else if (token == "position") {
+        is >> token;
+        string fen;
+        if (token == "startpos")
+            fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+        while (is >> token && token != "moves")
+            fen += (fen.empty() ? "" : " ") + token;
+        pos_.clear();
+        try {
+            pos_.set(fen);
+        } catch (const InvalidFenException &e) {
+            Err::output(e.what());
+            return true;
+        }
+        while (is >> token)
+            pos_.tryAndApplyMove(token);
+    } else if (token == "go") {
+        bool fail = (++searches_ == failAt_);
+        if (fail && fault_ == "crash")
+            exit(EXIT_FAILURE);
+        if (fail && fault_ == "hang")
+            return true;
+        /*Before bestmove, so that the next command can't get through*/
+        if (fail && fault_ == "deaf")
+            close(0);
+        go(is);
+        /*Writes to the engine fail, but it is still running*/
+        while (fail && fault_ == "deaf")
+            pause();
+    } else if (token == "quit") {
+        return false;
+    }
+    return !quit_;
+}
+
+int MockEngine::score(Position &pos)
+{
+    auto known = table_.find(tableKey(pos));
+    if (known != table_.end())
+        return known->second;
+    if (gen_all(pos).empty())
+        return pos.kingInCheck(pos.side_to_move()) ? -MATE : 0;
+    int white = eval_(pos);
+    return (pos.side_to_move() == WHITE) ? white : -white;
+}
+
+string MockEngine::uciScore(int score)
+{
+    if (score > MATE_BOUND)
+        return "mate " + to_string((MATE - score + 1) / 2);
+    if (score < -MATE_BOUND)
+        return "mate -" + to_string((MATE + score) / 2);
+    return "cp " + to_string(score);
+}
+
+void MockEngine::go(istringstream &is)
+{
+    auto start = chrono::steady_clock::now();
+    set<string> searchmoves;
+    string token;
+    bool restricted = false;
+    while (is >> token) {
+        if (token == "searchmoves")
+            restricted = true;
+        else if (restricted)
+            searchmoves.insert(token);
+    }
+
+    vector<pair<int, string>> lines;
+    for (Move m : gen_all(pos_)) {
+        string mv = move_to_string(m);
+        if (restricted && !searchmoves.count(mv))
+            continue;
+        if (!pos_.tryAndApplyMove(m))
+            continue;
+        int value = -score(pos_);
+        pos_.undoLastMove();
+        /*One more ply to the mate*/
+        if (value > MATE_BOUND)
+            value--;
+        else if (value < -MATE_BOUND)
+            value++;
+        lines.push_back(make_pair(value, mv));
+    }
+    stable_sort(lines.begin(), lines.end(),
+                [](const pair<int, string> &a, const pair<int, string> &b) {
+                    return a.first > b.first;
+                });
+    /*
+     * Even with searchmoves, as real engines do : the finders rely on it
+     * to see a reply they closed when searching its parent again.
+     */
+    if (!lines.empty())
+        table_[tableKey(pos_)] = lines[0].first;
+    if (lines.size() > multiPV_)
+        lines.resize(multiPV_);
+
+    bool stopped = false;
+    for (int depth = 1; depth <= depth_; depth++) {
+        if (!stopped && !think(latency_ / depth_, stopped))
+            return;
+        if (stopped && depth > 1)
+            break;
+        int ms = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - start).count();
+        ostringstream oss;
+        if (lines.empty())
+            oss << "info depth 0 score "
+                << uciScore(pos_.kingInCheck(pos_.side_to_move()) ? -MATE : 0)
+                << "\n";
+        for (unsigned int i = 0; i < lines.size(); i++)
+            oss << "info depth " << depth << " seldepth " << depth
+                << " multipv " << i + 1 << " score "
+                << uciScore(lines[i].first) << " nodes " << depth * 1000
+                << " time " << ms << " pv " << lines[i].second << "\n";
+        cout << oss.str() << flush;
+    }
+    cout << "bestmove " << (lines.empty() ? "(none)" : lines[0].second)
+         << endl;
+}
+
+bool MockEngine::think(int ms, bool &stopped)
+{
+    auto end = chrono::steady_clock::now() + chrono::milliseconds(ms);
+    string line;
+    while (true) {
+        int left = chrono::duration_cast<chrono::milliseconds>(
+                end - chrono::steady_clock::now()).count();
+        if (left <= 0)
+            return true;
+        if (!readLine(line, left))
+            return !quit_;
+        istringstream is(line);
+        string token;
+        is >> token;
+        /*Answered while searching, as real engines do*/
+        if (token == "isready") {
+            cout << "readyok" << endl;
+        } else if (token == "stop") {
+            stopped = true;
+            return true;
+        } else if (token == "quit") {
+            quit_ = true;
+            return false;
+        } else {
+            pending_.push_back(line);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const static struct option long_options[] =
+    {
+        {"help", no_argument, 0, 'h'},
+        {"eval", required_argument, 0, 'e'},
+        {"growth", required_argument, 0, 'g'},
+        {"latency", required_argument, 0, 'l'},
+        {"depth", required_argument, 0, 'd'},
+        {"variant", required_argument, 0, 'V'},
+        {"fault", required_argument, 0, 'f'},
+        {"search", required_argument, 0, 'n'},
+        {"log", required_argument, 0, 'L'},
+        {0, 0, 0, 0}
+    };
+
+    Options &opt = Options::getInstance();
+    int c;
+    int option_index = 0;
+    string eval = "material";
+    int latency = 0;
+    int depth = 5;
+    string fault, log;
+    int failAt = 1;
+    try {
+        while ((c = getopt_long(argc, argv, "he:g:l:d:V:f:n:L:",
+                                long_options, &option_index)) != -1) {
+            switch (c) {
+                case 'e':
+                    eval = optarg;
+                    break;
+                case 'g':
+                    growth = stoi(optarg);
+                    break;
+                case 'l':
+                    latency = stoi(optarg);
+                    break;
+                case 'd':
+                    depth = max(1, stoi(optarg));
+                    break;
+                case 'V':
+                    opt.setVariant(optarg);
+                    break;
+                case 'f':
+                    fault = optarg;
+                    break;
+                case 'n':
+                    failAt = stoi(optarg);
+                    break;
+                case 'L':
+                    log = optarg;
+                    break;
+                case 'h':
+                    Out::output(usage());
+                    exit(EXIT_SUCCESS);
+                case '?':
+                    exit(EXIT_FAILURE);
+                default:
+                    abort();
+            }
+        }
+    } catch (...) {
+        Err::output(usage());
+        exit(EXIT_FAILURE);
+    }
+    if (optind != argc || !evaluations.count(eval)
+        || (!fault.empty() && fault != "crash" && fault != "hang"
+            && fault != "deaf")) {
+        Err::output(usage());
+        exit(EXIT_FAILURE);
+    }
+
+    MockEngine engine(evaluations.at(eval), latency, depth, fault, failAt,
+                      log);
+    engine.run();
+    return 0;
+}
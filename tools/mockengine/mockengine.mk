@@ -0,0 +1,49 @@
+#
+# Matfinder, a program to help chess engines to find mat
+#
+# Copyright© 2013 Philippe Virouleau
+#
+# You can contact me at firstname.lastname@imag.fr
+# (Replace "firstname" and "lastname" with my actual names)
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+ALL_TARGETS += mockengine
+CLEAN_TARGETS += clean-mockengine
+
+mockengine_SOURCES           := $(wildcard src/*.cpp)
+mockengine_SOURCES_CXX       := $(wildcard tools/mockengine/*.cxx)
+mockengine_HEADERS_DEP       := $(wildcard include/*.h)
+
+mockengine_OBJECTS := $(mockengine_SOURCES:.cpp=.o)
+mockengine_OBJECTS += $(mockengine_SOURCES_CXX:.cxx=.o)
+
+
+canonical_path := ../$(shell basename $(shell pwd -P))
+
+tools/mockengine/%.o: tools/mockengine/%.cxx $(mockengine_HEADERS_DEP)
+	echo "[mockengine] CXX $<"
+	$(CXX) $(CPPFLAGS) $(CFLAGS) -c -o $@ ${canonical_path}/$<
+
+mockengine: $(mockengine_OBJECTS)
+	echo "[mockengine] Link mockengine"
+	$(CXX) -o $@ $^ $(LIBS) $(LDFLAGS)
+
+bench-finders: mockengine matfinder oraclefinder
+	tools/mockengine/finderbench.sh $(ENGINES)
+
+clean-mockengine:
+	echo "[mockengine] Clean"
+	rm -f $(mockengine_OBJECTS) mockengine
+	rm -rf bench_finders
@@ -0,0 +1,148 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "Output.h"
+#include "Options.h"
+#include "ConfigParser.h"
+#include "TableIO.h"
+
+using namespace std;
+
+/*
+ * Merge several sorted tables (as written by oraclefinder) into one, with
+ * a k-way merge : only one buffer per input is kept in memory.
+ */
+
+string usage()
+{
+    ostringstream oss;
+    oss << "Usage : tablemerge [options] -o output.bin input1.bin input2.bin ...\n";
+    oss << "\n";
+    oss << "Options\n";
+    oss << "    --output_file=file, -o file\n";
+    oss << "        The merged table (required). It is written in the compressed\n";
+    oss << "        block format if its name ends with .cbt, inputs may use both.\n";
+    oss << "    --cutoff=value, -t value\n";
+    oss << "        Threshold cutoff of the merged table. Every input must have\n";
+    oss << "        been built with a cutoff greater or equal to this value.\n";
+    oss << "        (default is the cutoff_threshold from the configuration)\n";
+    oss << "    --config_file=file, -c file\n";
+    oss << "        Gives an additional configuration file.\n";
+    oss << "    --verbose=level, -v level\n";
+    oss << "        Defines the verbose level.\n";
+    oss << "    --help, -h\n";
+    oss << "        Show this help message.\n";
+    oss << "\n";
+    oss << "When the same position is in several tables, the status with the\n";
+    oss << "highest priority is kept : mate > threshold > draw > pending.\n";
+    return oss.str();
+}
+
+int main(int argc, char **argv)
+{
+    const static struct option long_options[] =
+    {
+        {"help", no_argument, 0, 'h'},
+        {"verbose", required_argument, 0, 'v'},
+        {"output_file", required_argument, 0, 'o'},
+        {"cutoff", required_argument, 0, 't'},
+        {"config_file", required_argument, 0, 'c'},
+        {0, 0, 0, 0}
+    };
+
+    Options &opt = Options::getInstance();
+    try {
+        Config defconf;
+        opt.addConfig(defconf);
+    } catch (...) {
+        Out::output("No default configuration file found\n", 1);
+    }
+
+    int c;
+    int option_index = 0;
+    int cutoff = -1;
+    string output;
+    while ((c = getopt_long(argc, argv, "hv:o:t:c:",
+                            long_options, &option_index)) != -1) {
+        switch (c) {
+            case 'v':
+                try {
+                    opt.setVerboseLevel(stoi(optarg));
+                } catch (...) {
+                    Err::handle("Error parsing verbose level");
+                }
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 't':
+                try {
+                    cutoff = stoi(optarg);
+                } catch (...) {
+                    Err::handle("Error parsing cutoff");
+                }
+                break;
+            case 'c':
+                try {
+                    Config user(optarg);
+                    opt.addConfig(user);
+                } catch (...) {
+                    Err::handle("Unable to load user-defined configuration file");
+                }
+                break;
+            case 'h':
+                Out::output(usage());
+                exit(EXIT_SUCCESS);
+            case '?':
+                exit(EXIT_FAILURE);
+            default:
+                abort();
+        }
+    }
+
+    vector<string> inputs;
+    for (int i = optind; i < argc; i++)
+        inputs.push_back(argv[i]);
+    if (output.empty() || inputs.empty()) {
+        Err::output(usage());
+        exit(EXIT_FAILURE);
+    }
+    if (cutoff < 0)
+        cutoff = opt.getCutoffThreshold();
+    if (cutoff <= 0 || cutoff > UINT16_MAX)
+        Err::handle("Invalid cutoff : " + to_string(cutoff));
+
+    Out::output("Merging " + to_string(inputs.size()) + " tables into "
+                + output + " (cutoff " + to_string(cutoff) + ")\n");
+    Table::MergeStat stat = Table::merge(inputs, output, (uint16_t)cutoff);
+    Out::output("Wrote " + to_string(stat.entries) + " entries, "
+                + to_string(stat.conflicts) + " duplicated positions ("
+                + to_string(stat.statusConflicts)
+                + " with a different status).\n");
+    return EXIT_SUCCESS;
+}
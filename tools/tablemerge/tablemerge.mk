@@ -0,0 +1,45 @@
+#
+# Matfinder, a program to help chess engines to find mat
+#
+# Copyright© 2013 Philippe Virouleau
+#
+# You can contact me at firstname.lastname@imag.fr
+# (Replace "firstname" and "lastname" with my actual names)
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+ALL_TARGETS += tablemerge
+CLEAN_TARGETS += clean-tablemerge
+
+tablemerge_SOURCES           := $(wildcard src/*.cpp)
+tablemerge_SOURCES_CXX       := $(wildcard tools/tablemerge/*.cxx)
+tablemerge_HEADERS_DEP       := $(wildcard include/*.h)
+
+tablemerge_OBJECTS := $(tablemerge_SOURCES:.cpp=.o)
+tablemerge_OBJECTS += $(tablemerge_SOURCES_CXX:.cxx=.o)
+
+
+canonical_path := ../$(shell basename $(shell pwd -P))
+
+tools/tablemerge/%.o: tools/tablemerge/%.cxx $(tablemerge_HEADERS_DEP)
+	echo "[tablemerge] CXX $<"
+	$(CXX) $(CPPFLAGS) $(CFLAGS) -c -o $@ ${canonical_path}/$<
+
+tablemerge: $(tablemerge_OBJECTS)
+	echo "[tablemerge] Link tablemerge"
+	$(CXX) -o $@ $^ $(LIBS) $(LDFLAGS)
+
+clean-tablemerge:
+	echo "[tablemerge] Clean"
+	rm -f $(tablemerge_OBJECTS) tablemerge
@@ -0,0 +1,308 @@
+/*
+ * Matfinder, a program to help chess engines to find mat
+ *
+ * Copyright© 2013 Philippe Virouleau
+ *
+ * You can contact me at firstname.lastname@imag.fr
+ * (Replace "firstname" and "lastname" with my actual names)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Output.h"
+#include "Options.h"
+#include "Hashing.h"
+#include "TableIO.h"
+
+using namespace std;
+
+/*
+ * Statistics about table files, computed directly on the mapped file :
+ * no Node is ever built, so this runs at the speed of the disk.
+ */
+
+/*Number of buckets for the key space distribution (top bits of the key)*/
+#define KEY_BUCKET_BITS 4
+/*Learn values below this are counted in an array, others in a map*/
+#define FAST_LEARN_VALUES 1024
+
+struct TableStat {
+    uint16_t cutoff = 0;
+    uint64_t entries = 0;
+    uint64_t unsorted = 0;
+    uint64_t duplicates = 0;
+    uint64_t minKey = UINT64_MAX;
+    uint64_t maxKey = 0;
+    uint64_t lastKey = 0;
+    uint64_t withMove = 0;
+    uint64_t withWeight = 0;
+    vector<uint64_t> fastLearn;
+    map<uint32_t, uint64_t> otherLearn;
+    vector<uint64_t> keyBuckets;
+    vector<uint64_t> moves;
+    /*Only for block tables*/
+    uint64_t blocks = 0;
+    uint64_t packedBlocks = 0;
+    uint64_t blockBytes = 0;
+
+    TableStat() : fastLearn(FAST_LEARN_VALUES, 0),
+        keyBuckets(1 << KEY_BUCKET_BITS, 0), moves(1 << 16, 0) {}
+};
+
+string usage()
+{
+    ostringstream oss;
+    oss << "Usage : tablestat [options] table1.bin [table2.cbt ...]\n";
+    oss << "\n";
+    oss << "Options\n";
+    oss << "    --moves=n, -m n\n";
+    oss << "        Number of most frequent moves to display (default is 10).\n";
+    oss << "    --verbose=level, -v level\n";
+    oss << "        Defines the verbose level.\n";
+    oss << "    --help, -h\n";
+    oss << "        Show this help message.\n";
+    return oss.str();
+}
+
+string percent(uint64_t part, uint64_t total)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%.2f%%", (total) ? 100.0 * part / total : 0.0);
+    return buf;
+}
+
+string statusName(uint32_t status)
+{
+    string name = Node::to_string((Node::StatusFlag)status);
+    name.erase(0, name.find_first_not_of(' '));
+    return name;
+}
+
+void account(const Table::Entry &e, TableStat &stat)
+{
+    if (stat.entries > 0) {
+        if (e.key < stat.lastKey)
+            stat.unsorted++;
+        else if (e.key == stat.lastKey)
+            stat.duplicates++;
+    }
+    stat.lastKey = e.key;
+    stat.entries++;
+    stat.minKey = min(stat.minKey, e.key);
+    stat.maxKey = max(stat.maxKey, e.key);
+    if (e.learn < FAST_LEARN_VALUES)
+        stat.fastLearn[e.learn]++;
+    else
+        stat.otherLearn[e.learn]++;
+    stat.keyBuckets[e.key >> (64 - KEY_BUCKET_BITS)]++;
+    stat.moves[e.move]++;
+    if (e.move)
+        stat.withMove++;
+    if (e.weight)
+        stat.withWeight++;
+}
+
+void scan(const char *data, size_t size, TableStat &stat)
+{
+    Table::Entry e;
+    for (size_t off = Table::ENTRY_SIZE; off + Table::ENTRY_SIZE <= size;
+         off += Table::ENTRY_SIZE) {
+        Table::decode(data + off, e);
+        account(e, stat);
+    }
+}
+
+void scanBlocks(const Table::BlockTable &table, TableStat &stat)
+{
+    vector<Table::Entry> block;
+    table.adviseSequential();
+    for (size_t b = 0; b < table.blockCount(); b++) {
+        table.readBlock(b, block);
+        for (const Table::Entry &e : block)
+            account(e, stat);
+        stat.blocks++;
+        stat.packedBlocks += Table::isPackedBlock(table.blockData(b));
+        stat.blockBytes += table.blockSize(b);
+    }
+}
+
+void report(const string &file, size_t size, TableStat &stat,
+            unsigned int topMoves)
+{
+    Out::output("Table " + file + "\n");
+    Out::output("  size : " + to_string(size) + " bytes, "
+                + to_string(stat.entries) + " entries\n");
+    if (stat.blocks) {
+        char bytesPerEntry[16];
+        snprintf(bytesPerEntry, sizeof(bytesPerEntry), "%.2f",
+                 (stat.entries) ? (double)stat.blockBytes / stat.entries : 0.0);
+        Out::output("  blocks : " + to_string(stat.blocks) + " ("
+                    + to_string(stat.packedBlocks) + " packed), "
+                    + bytesPerEntry + " bytes per entry\n");
+    } else if (size % Table::ENTRY_SIZE) {
+        Out::output("  warning : " + to_string(size % Table::ENTRY_SIZE)
+                    + " trailing bytes\n");
+    }
+    Out::output("  cutoff : " + to_string(stat.cutoff) + "\n");
+    if (stat.unsorted || stat.duplicates)
+        Out::output("  warning : " + to_string(stat.unsorted)
+                    + " unsorted and " + to_string(stat.duplicates)
+                    + " duplicated keys\n");
+
+    /*Status histogram, and per-flag counts derived from it*/
+    map<uint32_t, uint64_t> learn = stat.otherLearn;
+    for (uint32_t l = 0; l < FAST_LEARN_VALUES; l++)
+        if (stat.fastLearn[l])
+            learn[l] = stat.fastLearn[l];
+    Out::output("  status histogram :\n");
+    vector<uint64_t> flags(32, 0);
+    for (auto entry : learn) {
+        Out::output("    " + to_string(entry.first) + " ("
+                    + statusName(entry.first) + ") : "
+                    + to_string(entry.second) + " ("
+                    + percent(entry.second, stat.entries) + ")\n");
+        for (int bit = 0; bit < 32; bit++)
+            if (entry.first & (1u << bit))
+                flags[bit] += entry.second;
+    }
+    Out::output("  flags :\n");
+    for (int bit = 0; bit < 32; bit++) {
+        if (!flags[bit])
+            continue;
+        Out::output("    " + statusName(1u << bit) + " : "
+                    + to_string(flags[bit]) + "\n");
+    }
+    Out::output("  pending : " + to_string(flags[0]) + " ("
+                + percent(flags[0], stat.entries) + ")\n");
+
+    Out::output("  moves : " + to_string(stat.withMove) + " entries with a"
+                " move, " + to_string(stat.withWeight) + " with a weight\n");
+    vector<pair<uint64_t, uint16_t>> sorted;
+    for (uint32_t m = 1; m < stat.moves.size(); m++)
+        if (stat.moves[m])
+            sorted.push_back(make_pair(stat.moves[m], (uint16_t)m));
+    sort(sorted.rbegin(), sorted.rend());
+    Out::output("  distinct moves : " + to_string(sorted.size()) + "\n");
+    for (unsigned int i = 0; i < sorted.size() && i < topMoves; i++)
+        Out::output("    " + Board::polyglotToUci(sorted[i].second) + " : "
+                    + to_string(sorted[i].first) + "\n");
+
+    if (stat.entries) {
+        Out::output("  keys : [" + to_string(stat.minKey) + ", "
+                    + to_string(stat.maxKey) + "]\n");
+        Out::output("  key space (top " + to_string(KEY_BUCKET_BITS)
+                    + " bits) :\n");
+        for (size_t b = 0; b < stat.keyBuckets.size(); b++)
+            Out::output("    " + to_string(b) + " : "
+                        + to_string(stat.keyBuckets[b]) + " ("
+                        + percent(stat.keyBuckets[b], stat.entries) + ")\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const static struct option long_options[] =
+    {
+        {"help", no_argument, 0, 'h'},
+        {"verbose", required_argument, 0, 'v'},
+        {"moves", required_argument, 0, 'm'},
+        {0, 0, 0, 0}
+    };
+
+    Options &opt = Options::getInstance();
+    int c;
+    int option_index = 0;
+    unsigned int topMoves = 10;
+    while ((c = getopt_long(argc, argv, "hv:m:",
+                            long_options, &option_index)) != -1) {
+        switch (c) {
+            case 'v':
+                try {
+                    opt.setVerboseLevel(stoi(optarg));
+                } catch (...) {
+                    Err::handle("Error parsing verbose level");
+                }
+                break;
+            case 'm':
+                try {
+                    topMoves = stoi(optarg);
+                } catch (...) {
+                    Err::handle("Error parsing moves number");
+                }
+                break;
+            case 'h':
+                Out::output(usage());
+                exit(EXIT_SUCCESS);
+            case '?':
+                exit(EXIT_FAILURE);
+            default:
+                abort();
+        }
+    }
+    if (optind >= argc) {
+        Err::output(usage());
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = optind; i < argc; i++) {
+        string file(argv[i]);
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            Err::handle("Unable to open " + file);
+        struct stat st;
+        if (fstat(fd, &st))
+            Err::handle("Unable to stat " + file);
+        size_t size = st.st_size;
+        if (size < Table::ENTRY_SIZE)
+            Err::handle("Table " + file + " has no header");
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            Err::handle("Unable to map " + file);
+        madvise(map, size, MADV_SEQUENTIAL);
+        const char *data = static_cast<const char *>(map);
+
+        TableStat stat;
+        Table::Entry header;
+        Table::decode(data, header);
+        if (header.key == Table::BLOCK_MAGIC) {
+            /*Block tables are decoded block by block, through their index*/
+            Table::BlockTable table(file, 0);
+            stat.cutoff = table.cutoff();
+            scanBlocks(table, stat);
+        } else if (header.key == 0) {
+            stat.cutoff = header.move;
+            scan(data, size, stat);
+        } else {
+            Err::handle("Table " + file + " is not compatible with this"
+                        " version of the program !");
+        }
+        report(file, size, stat, topMoves);
+
+        munmap(map, size);
+        close(fd);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#
+# Matfinder, a program to help chess engines to find mat
+#
+# Copyright© 2013 Philippe Virouleau
+#
+# You can contact me at firstname.lastname@imag.fr
+# (Replace "firstname" and "lastname" with my actual names)
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+ALL_TARGETS += tablestat
+CLEAN_TARGETS += clean-tablestat
+
+tablestat_SOURCES           := $(wildcard src/*.cpp)
+tablestat_SOURCES_CXX       := $(wildcard tools/tablestat/*.cxx)
+tablestat_HEADERS_DEP       := $(wildcard include/*.h)
+
+tablestat_OBJECTS := $(tablestat_SOURCES:.cpp=.o)
+tablestat_OBJECTS += $(tablestat_SOURCES_CXX:.cxx=.o)
+
+
+canonical_path := ../$(shell basename $(shell pwd -P))
+
+tools/tablestat/%.o: tools/tablestat/%.cxx $(tablestat_HEADERS_DEP)
+	echo "[tablestat] CXX $<"
+	$(CXX) $(CPPFLAGS) $(CFLAGS) -c -o $@ ${canonical_path}/$<
+
+tablestat: $(tablestat_OBJECTS)
+	echo "[tablestat] Link tablestat"
+	$(CXX) -o $@ $^ $(LIBS) $(LDFLAGS)
+
+clean-tablestat:
+	echo "[tablestat] Clean"
+	rm -f $(tablestat_OBJECTS) tablestat